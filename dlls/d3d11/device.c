@@ -429,6 +429,7 @@ struct d3d11_command_list
     LONG refcount;
 
     struct list commands;
+    struct list blocks;
 
     struct wined3d_private_store private_store;
 };
@@ -441,16 +442,59 @@ struct d3d11_deferred_context
     LONG refcount;
 
     struct list commands;
+    struct list blocks;
 
     struct wined3d_private_store private_store;
 };
 
+/* Deferred calls are sub-allocated from blocks owned by the recording context,
+ * so that threads recording in parallel don't contend on the process heap.
+ * The blocks are handed over to the command list together with the calls. */
+#define DEFERRED_BLOCK_SIZE 0x10000
+
+struct deferred_block
+{
+    struct list entry;
+    SIZE_T size;
+    SIZE_T used;
+};
+
+#define DEFERRED_BLOCK_HEADER_SIZE ((sizeof(struct deferred_block) + 0xf) & ~(SIZE_T)0xf)
+
+static void free_deferred_blocks(struct list *blocks)
+{
+    struct deferred_block *block, *block2;
+
+    LIST_FOR_EACH_ENTRY_SAFE(block, block2, blocks, struct deferred_block, entry)
+    {
+        HeapFree(GetProcessHeap(), 0, block);
+    }
+    list_init(blocks);
+}
+
 static struct deferred_call *add_deferred_call(struct d3d11_deferred_context *context, size_t extra_size)
 {
+    struct deferred_block *block = NULL;
     struct deferred_call *call;
+    SIZE_T size, block_size;
 
-    if (!(call = HeapAlloc(GetProcessHeap(), 0, sizeof(*call) + extra_size)))
-        return NULL;
+    /* Keep calls 16 byte aligned, mapped data relies on it. */
+    size = (sizeof(*call) + extra_size + 0xf) & ~(SIZE_T)0xf;
+
+    if (!list_empty(&context->blocks))
+        block = LIST_ENTRY(list_tail(&context->blocks), struct deferred_block, entry);
+    if (!block || block->size - block->used < size)
+    {
+        block_size = max(DEFERRED_BLOCK_SIZE, DEFERRED_BLOCK_HEADER_SIZE + size);
+        if (!(block = HeapAlloc(GetProcessHeap(), 0, block_size)))
+            return NULL;
+        block->size = block_size;
+        block->used = DEFERRED_BLOCK_HEADER_SIZE;
+        list_add_tail(&context->blocks, &block->entry);
+    }
+
+    call = (struct deferred_call *)((BYTE *)block + block->used);
+    block->used += size;
 
     call->cmd = 0xdeadbeef;
     list_add_tail(&context->commands, &call->entry);
@@ -841,7 +885,6 @@ static void free_deferred_calls(struct list *commands)
         }
 
         list_remove(&call->entry);
-        HeapFree(GetProcessHeap(), 0, call);
     }
 }
 
@@ -1318,6 +1361,7 @@ static ULONG STDMETHODCALLTYPE d3d11_command_list_Release(ID3D11CommandList *ifa
     if (!refcount)
     {
         free_deferred_calls(&cmdlist->commands);
+        free_deferred_blocks(&cmdlist->blocks);
         wined3d_private_store_cleanup(&cmdlist->private_store);
         ID3D11Device_Release(cmdlist->device);
         HeapFree(GetProcessHeap(), 0, cmdlist);
@@ -2702,6 +2746,7 @@ static void state_apply(ID3D11DeviceContext1 *context, struct d3d11_state *state
 static void STDMETHODCALLTYPE d3d11_immediate_context_ExecuteCommandList(ID3D11DeviceContext1 *iface,
         ID3D11CommandList *command_list, BOOL restore_state)
 {
+    struct d3d_device *device = device_from_immediate_ID3D11DeviceContext1(iface);
     struct d3d11_command_list *cmdlist = unsafe_impl_from_ID3D11CommandList(command_list);
     struct d3d11_state *stateblock = NULL;
 
@@ -2711,10 +2756,13 @@ static void STDMETHODCALLTYPE d3d11_immediate_context_ExecuteCommandList(ID3D11D
         return;
 
     wined3d_mutex_lock();
+    /* Submit the whole command list to the command stream as one batch. */
+    wined3d_device_begin_batch(device->wined3d_device);
     if (restore_state) stateblock = state_capture(iface);
     exec_deferred_calls(iface, &cmdlist->commands);
     if (restore_state) state_apply(iface, stateblock);
     else ID3D11DeviceContext1_ClearState(iface);
+    wined3d_device_end_batch(device->wined3d_device);
     wined3d_mutex_unlock();
 }
 
@@ -4428,6 +4476,7 @@ static ULONG STDMETHODCALLTYPE d3d11_deferred_context_Release(ID3D11DeviceContex
     if (!refcount)
     {
         free_deferred_calls(&context->commands);
+        free_deferred_blocks(&context->blocks);
         wined3d_private_store_cleanup(&context->private_store);
         ID3D11Device_Release(context->device);
         HeapFree(GetProcessHeap(), 0, context);
@@ -5965,6 +6014,8 @@ static HRESULT STDMETHODCALLTYPE d3d11_deferred_context_FinishCommandList(ID3D11
 
     list_init(&object->commands);
     list_move_tail(&object->commands, &context->commands);
+    list_init(&object->blocks);
+    list_move_tail(&object->blocks, &context->blocks);
 
     ID3D11Device_AddRef(context->device);
     wined3d_private_store_init(&object->private_store);
@@ -6586,6 +6637,7 @@ static HRESULT STDMETHODCALLTYPE d3d11_device_CreateDeferredContext(ID3D11Device
     object->refcount = 1;
 
     list_init(&object->commands);
+    list_init(&object->blocks);
 
     ID3D11Device2_AddRef(iface);
     wined3d_private_store_init(&object->private_store);
@@ -2149,6 +2149,94 @@ static void test_draw_deferred_context(void)
     release_test_context(&test_context);
 }
 
+static void test_update_subresource_deferred_context(void)
+{
+    static const DWORD initial_data[] =
+    {
+        0xf800001f, 0x00000000, 0x07e0f800, 0x55555555,
+        0x001f07e0, 0xaaaaaaaa, 0xffff0000, 0xffffffff,
+    };
+    static const DWORD block_data[][2] =
+    {
+        {0x12345678, 0x9abcdef0},
+        {0x0badf00d, 0xdeadbeef},
+    };
+    struct d3d11_test_context test_context;
+    ID3D11DeviceContext *deferred_context;
+    D3D11_TEXTURE2D_DESC texture_desc;
+    ID3D11CommandList *command_list;
+    struct resource_readback rb;
+    ID3D11Texture2D *texture;
+    unsigned int x, y, i;
+    ID3D11Device *device;
+    const DWORD *block;
+    D3D11_BOX box;
+    HRESULT hr;
+
+    if (!init_test_context(&test_context, NULL))
+        return;
+
+    device = test_context.device;
+
+    hr = ID3D11Device_CreateDeferredContext(device, 0, &deferred_context);
+    ok(hr == S_OK, "Got unexpected hr %#x.\n", hr);
+
+    texture_desc.Width = 8;
+    texture_desc.Height = 8;
+    texture_desc.MipLevels = 1;
+    texture_desc.ArraySize = 1;
+    texture_desc.Format = DXGI_FORMAT_BC1_UNORM;
+    texture_desc.SampleDesc.Count = 1;
+    texture_desc.SampleDesc.Quality = 0;
+    texture_desc.Usage = D3D11_USAGE_DEFAULT;
+    texture_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    texture_desc.CPUAccessFlags = 0;
+    texture_desc.MiscFlags = 0;
+    hr = ID3D11Device_CreateTexture2D(device, &texture_desc, NULL, &texture);
+    ok(hr == S_OK, "Got unexpected hr %#x.\n", hr);
+
+    /* Several updates of the same block compressed texture in a single
+     * command list; each of them has to wait for the previous one. */
+    ID3D11DeviceContext_UpdateSubresource(deferred_context, (ID3D11Resource *)texture, 0,
+            NULL, initial_data, 2 * 8, 0);
+    for (i = 0; i < ARRAY_SIZE(block_data); ++i)
+    {
+        set_box(&box, 4 * i, 4 * i, 0, 4 * i + 4, 4 * i + 4, 1);
+        ID3D11DeviceContext_UpdateSubresource(deferred_context, (ID3D11Resource *)texture, 0,
+                &box, block_data[i], 8, 0);
+    }
+
+    hr = ID3D11DeviceContext_FinishCommandList(deferred_context, FALSE, &command_list);
+    ok(hr == S_OK, "Got unexpected hr %#x.\n", hr);
+    ID3D11DeviceContext_ExecuteCommandList(test_context.immediate_context, command_list, FALSE);
+    ID3D11CommandList_Release(command_list);
+
+    get_texture_readback(texture, 0, &rb);
+    for (y = 0; y < 2; ++y)
+    {
+        for (x = 0; x < 2; ++x)
+        {
+            block = get_readback_data(&rb, x, y, 0, 8);
+            if (x == y)
+            {
+                ok(block[0] == block_data[x][0] && block[1] == block_data[x][1],
+                        "Got unexpected block {0x%08x, 0x%08x} at (%u, %u).\n", block[0], block[1], x, y);
+            }
+            else
+            {
+                i = y * 4 + x * 2;
+                ok(block[0] == initial_data[i] && block[1] == initial_data[i + 1],
+                        "Got unexpected block {0x%08x, 0x%08x} at (%u, %u).\n", block[0], block[1], x, y);
+            }
+        }
+    }
+    release_resource_readback(&rb);
+
+    ID3D11Texture2D_Release(texture);
+    ID3D11DeviceContext_Release(deferred_context);
+    release_test_context(&test_context);
+}
+
 static void test_device_interfaces(const D3D_FEATURE_LEVEL feature_level)
 {
     struct device_desc device_desc;
@@ -29190,6 +29278,113 @@ static void test_staging_buffers(void)
     release_test_context(&test_context);
 }
 
+static void test_dynamic_buffer_upload(void)
+{
+    struct d3d11_test_context test_context;
+    D3D11_MAPPED_SUBRESOURCE map_desc;
+    ID3D11Buffer *dynamic, *buffer;
+    unsigned int i, j, value, *data;
+    D3D11_BUFFER_DESC buffer_desc;
+    ID3D11DeviceContext *context;
+    struct resource_readback rb;
+    ID3D11Device *device;
+    DWORD ticks;
+    HRESULT hr;
+
+    /* Enough iterations to go around a staging ring of a few megabytes
+     * several times. */
+    static const unsigned int buffer_size = 0x10000, iteration_count = 256;
+    static const unsigned int half = buffer_size / 2 / sizeof(*data);
+
+    if (!init_test_context(&test_context, NULL))
+        return;
+    device = test_context.device;
+    context = test_context.immediate_context;
+
+    buffer_desc.ByteWidth = buffer_size;
+    buffer_desc.Usage = D3D11_USAGE_DYNAMIC;
+    buffer_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    buffer_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    buffer_desc.MiscFlags = 0;
+    buffer_desc.StructureByteStride = 0;
+    hr = ID3D11Device_CreateBuffer(device, &buffer_desc, NULL, &dynamic);
+    ok(hr == S_OK, "Failed to create buffer, hr %#x.\n", hr);
+
+    ticks = GetTickCount();
+    for (i = 0; i < iteration_count; ++i)
+    {
+        hr = ID3D11DeviceContext_Map(context, (ID3D11Resource *)dynamic, 0, D3D11_MAP_WRITE_DISCARD, 0, &map_desc);
+        ok(hr == S_OK, "Failed to map buffer, hr %#x.\n", hr);
+        data = map_desc.pData;
+        for (j = 0; j < half; ++j)
+            data[j] = i << 16 | j;
+        ID3D11DeviceContext_Unmap(context, (ID3D11Resource *)dynamic, 0);
+
+        /* The data written by the DISCARD map has to survive. */
+        hr = ID3D11DeviceContext_Map(context, (ID3D11Resource *)dynamic, 0,
+                D3D11_MAP_WRITE_NO_OVERWRITE, 0, &map_desc);
+        ok(hr == S_OK, "Failed to map buffer, hr %#x.\n", hr);
+        data = map_desc.pData;
+        for (j = half; j < 2 * half; ++j)
+            data[j] = i << 16 | j;
+        ID3D11DeviceContext_Unmap(context, (ID3D11Resource *)dynamic, 0);
+
+        if (i % 64 && i != iteration_count - 1)
+            continue;
+
+        get_buffer_readback(dynamic, &rb);
+        for (j = 0; j < 2 * half; ++j)
+        {
+            value = get_readback_u32(&rb, j, 0, 0);
+            if (value != (i << 16 | j))
+                break;
+        }
+        ok(j == 2 * half, "Iteration %u: Got unexpected value %#x at %u.\n", i, value, j);
+        release_resource_readback(&rb);
+    }
+    trace("%u dynamic buffer maps took %u ms.\n", 2 * iteration_count, GetTickCount() - ticks);
+
+    buffer = create_buffer(device, D3D11_BIND_VERTEX_BUFFER, buffer_size, NULL);
+    data = heap_alloc(buffer_size);
+    ticks = GetTickCount();
+    for (i = 0; i < iteration_count; ++i)
+    {
+        for (j = 0; j < 2 * half; ++j)
+            data[j] = ~(i << 16 | j);
+        ID3D11DeviceContext_UpdateSubresource(context, (ID3D11Resource *)buffer, 0, NULL, data, 0, 0);
+        ID3D11DeviceContext_CopyResource(context, (ID3D11Resource *)dynamic, (ID3D11Resource *)buffer);
+    }
+    trace("%u buffer updates took %u ms.\n", iteration_count, GetTickCount() - ticks);
+
+    get_buffer_readback(dynamic, &rb);
+    for (j = 0; j < 2 * half; ++j)
+    {
+        value = get_readback_u32(&rb, j, 0, 0);
+        if (value != ~((iteration_count - 1) << 16 | j))
+            break;
+    }
+    ok(j == 2 * half, "Got unexpected value %#x at %u.\n", value, j);
+    release_resource_readback(&rb);
+
+    /* A NOOVERWRITE map after a GPU copy has to see the copied data. */
+    hr = ID3D11DeviceContext_Map(context, (ID3D11Resource *)dynamic, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &map_desc);
+    ok(hr == S_OK, "Failed to map buffer, hr %#x.\n", hr);
+    data[0] = 0xdeadbeef;
+    *(unsigned int *)map_desc.pData = data[0];
+    ID3D11DeviceContext_Unmap(context, (ID3D11Resource *)dynamic, 0);
+    get_buffer_readback(dynamic, &rb);
+    value = get_readback_u32(&rb, 0, 0, 0);
+    ok(value == 0xdeadbeef, "Got unexpected value %#x.\n", value);
+    value = get_readback_u32(&rb, 1, 0, 0);
+    ok(value == ~((iteration_count - 1) << 16 | 1), "Got unexpected value %#x.\n", value);
+    release_resource_readback(&rb);
+
+    heap_free(data);
+    ID3D11Buffer_Release(buffer);
+    ID3D11Buffer_Release(dynamic);
+    release_test_context(&test_context);
+}
+
 static void test_render_a8(void)
 {
     static const float black[] = {0.0f, 0.0f, 0.0f, 0.0f};
@@ -30152,6 +30347,7 @@ START_TEST(d3d11)
     queue_test(test_get_immediate_context);
     queue_test(test_create_deferred_context);
     queue_test(test_draw_deferred_context);
+    queue_test(test_update_subresource_deferred_context);
     queue_test(test_create_texture1d);
     queue_test(test_texture1d_interfaces);
     queue_test(test_create_texture2d);
@@ -30282,6 +30478,7 @@ START_TEST(d3d11)
     queue_test(test_sample_mask);
     queue_test(test_depth_clip);
     queue_test(test_staging_buffers);
+    queue_test(test_dynamic_buffer_upload);
     queue_test(test_render_a8);
     queue_test(test_standard_pattern);
     queue_test(test_desktop_window);
@@ -26885,6 +26885,105 @@ static void test_sample_attached_rendertarget(void)
     DestroyWindow(window);
 }
 
+static void test_shader_program_cache(void)
+{
+    unsigned int expected, pass, i;
+    IDirect3DPixelShader9 *ps;
+    IDirect3DDevice9 *device;
+    DWORD code[11], start;
+    IDirect3D9 *d3d;
+    D3DCOLOR color;
+    ULONG refcount;
+    D3DCAPS9 caps;
+    HWND window;
+    HRESULT hr;
+    float red;
+
+    static const struct vec3 quad[] =
+    {
+        {-1.0f, -1.0f, 0.1f},
+        {-1.0f,  1.0f, 0.1f},
+        { 1.0f, -1.0f, 0.1f},
+        { 1.0f,  1.0f, 0.1f},
+    };
+    static const DWORD ps_code[] =
+    {
+        0xffff0200,                                                 /* ps_2_0                 */
+        0x05000051, 0xa00f0000, 0x00000000, 0x00000000, 0x00000000, 0x3f800000,
+                /* def c0, 0.0, 0.0, 0.0, 1.0 */
+        0x02000001, 0x800f0800, 0xa0e40000,                         /* mov oC0, c0            */
+        0x0000ffff
+    };
+
+    window = create_window();
+    d3d = Direct3DCreate9(D3D_SDK_VERSION);
+    ok(!!d3d, "Failed to create a D3D object.\n");
+
+    /* Programs linked by the first device are stored in the program cache,
+     * and loaded from it by the second one. Both have to render the same
+     * result; the timings show the benefit of the cache, if any. */
+    for (pass = 0; pass < 2; ++pass)
+    {
+        if (!(device = create_device(d3d, window, window, TRUE)))
+        {
+            skip("Failed to create a D3D device, skipping tests.\n");
+            break;
+        }
+
+        hr = IDirect3DDevice9_GetDeviceCaps(device, &caps);
+        ok(SUCCEEDED(hr), "Failed to get device caps, hr %#x.\n", hr);
+        if (caps.PixelShaderVersion < D3DPS_VERSION(2, 0))
+        {
+            skip("No ps_2_0 support, skipping tests.\n");
+            IDirect3DDevice9_Release(device);
+            break;
+        }
+
+        hr = IDirect3DDevice9_SetFVF(device, D3DFVF_XYZ);
+        ok(SUCCEEDED(hr), "Failed to set FVF, hr %#x.\n", hr);
+        hr = IDirect3DDevice9_SetRenderState(device, D3DRS_LIGHTING, FALSE);
+        ok(SUCCEEDED(hr), "Failed to disable lighting, hr %#x.\n", hr);
+        hr = IDirect3DDevice9_SetRenderState(device, D3DRS_ZENABLE, FALSE);
+        ok(SUCCEEDED(hr), "Failed to disable depth test, hr %#x.\n", hr);
+
+        start = GetTickCount();
+        for (i = 0; i < 32; ++i)
+        {
+            memcpy(code, ps_code, sizeof(code));
+            red = (i * 8) / 255.0f;
+            memcpy(&code[3], &red, sizeof(red));
+
+            hr = IDirect3DDevice9_CreatePixelShader(device, code, &ps);
+            ok(SUCCEEDED(hr), "Failed to create pixel shader, hr %#x.\n", hr);
+            hr = IDirect3DDevice9_SetPixelShader(device, ps);
+            ok(SUCCEEDED(hr), "Failed to set pixel shader, hr %#x.\n", hr);
+
+            hr = IDirect3DDevice9_Clear(device, 0, NULL, D3DCLEAR_TARGET, 0x000000ff, 1.0f, 0);
+            ok(SUCCEEDED(hr), "Failed to clear, hr %#x.\n", hr);
+            hr = IDirect3DDevice9_BeginScene(device);
+            ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
+            hr = IDirect3DDevice9_DrawPrimitiveUP(device, D3DPT_TRIANGLESTRIP, 2, quad, sizeof(*quad));
+            ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
+            hr = IDirect3DDevice9_EndScene(device);
+            ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
+
+            expected = (i * 8) << 16;
+            color = getPixelColor(device, 320, 240);
+            ok(color_match(color, expected, 1), "Pass %u, shader %u: got unexpected color 0x%08x.\n",
+                    pass, i, color);
+
+            IDirect3DPixelShader9_Release(ps);
+        }
+        trace("Pass %u: drew with %u pixel shaders in %u ms.\n", pass, i, GetTickCount() - start);
+
+        refcount = IDirect3DDevice9_Release(device);
+        ok(!refcount, "Device has %u references left.\n", refcount);
+    }
+
+    IDirect3D9_Release(d3d);
+    DestroyWindow(window);
+}
+
 static void test_alpha_to_coverage(void)
 {
     static const struct
@@ -27235,4 +27334,5 @@ START_TEST(visual)
     test_draw_mapped_buffer();
     test_sample_attached_rendertarget();
     test_alpha_to_coverage();
+    test_shader_program_cache();
 }
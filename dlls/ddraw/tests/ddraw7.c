@@ -11542,6 +11542,165 @@ done:
     DestroyWindow(window);
 }
 
+static void test_colorkey_wide_texture(void)
+{
+    static struct
+    {
+        struct vec3 pos;
+        struct vec2 texcoord;
+    }
+    quad[] =
+    {
+        {{-1.0f, -1.0f, 0.0f}, {0.0f, 1.0f}},
+        {{-1.0f,  1.0f, 0.0f}, {0.0f, 0.0f}},
+        {{ 1.0f, -1.0f, 0.0f}, {1.0f, 1.0f}},
+        {{ 1.0f,  1.0f, 0.0f}, {1.0f, 0.0f}},
+    };
+
+    static const struct
+    {
+        unsigned int bpp;
+        DWORD key;
+        const char *name;
+        DDPIXELFORMAT fmt;
+    }
+    tests[] =
+    {
+        {
+            4, 0x00345678, "D3DFMT_X8R8G8B8",
+            {
+                sizeof(DDPIXELFORMAT), DDPF_RGB, 0,
+                {32}, {0x00ff0000}, {0x0000ff00}, {0x000000ff}, {0x00000000}
+            }
+        },
+        {
+            2, 0x5678, "D3DFMT_R5G6B5",
+            {
+                sizeof(DDPIXELFORMAT), DDPF_RGB, 0,
+                {16}, {0xf800}, {0x07e0}, {0x001f}, {0x0000}
+            }
+        },
+    };
+
+    /* Wide enough to exercise both vectorised and remainder paths of the
+     * color key conversion. */
+    static const unsigned int width = 19;
+
+    DDSURFACEDESC2 surface_desc, lock_desc;
+    IDirectDrawSurface7 *texture, *rt;
+    IDirect3DDevice7 *device;
+    unsigned int t, x, texel;
+    IDirectDraw7 *ddraw;
+    IDirect3D7 *d3d;
+    D3DCOLOR color;
+    ULONG refcount;
+    HWND window;
+    HRESULT hr;
+
+    window = create_window();
+    if (!(device = create_device(window, DDSCL_NORMAL)))
+    {
+        skip("Failed to create a 3D device, skipping test.\n");
+        DestroyWindow(window);
+        return;
+    }
+
+    hr = IDirect3DDevice7_GetDirect3D(device, &d3d);
+    ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+    hr = IDirect3D7_QueryInterface(d3d, &IID_IDirectDraw7, (void **)&ddraw);
+    ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+    IDirect3D7_Release(d3d);
+    hr = IDirect3DDevice7_GetRenderTarget(device, &rt);
+    ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+
+    if (ddraw_is_warp(ddraw))
+    {
+        win_skip("Skipping test on WARP driver.\n");
+        goto done;
+    }
+
+    hr = IDirect3DDevice7_SetRenderState(device, D3DRENDERSTATE_LIGHTING, FALSE);
+    ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+    hr = IDirect3DDevice7_SetRenderState(device, D3DRENDERSTATE_ZENABLE, D3DZB_FALSE);
+    ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+    hr = IDirect3DDevice7_SetRenderState(device, D3DRENDERSTATE_COLORKEYENABLE, TRUE);
+    ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+    hr = IDirect3DDevice7_SetTextureStageState(device, 0, D3DTSS_COLOROP, D3DTOP_MODULATE);
+    ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+    hr = IDirect3DDevice7_SetTextureStageState(device, 0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+    ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+    hr = IDirect3DDevice7_SetTextureStageState(device, 0, D3DTSS_COLORARG2, D3DTA_TFACTOR);
+    ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+    hr = IDirect3DDevice7_SetRenderState(device, D3DRENDERSTATE_TEXTUREFACTOR, 0x00000000);
+    ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+
+    memset(&lock_desc, 0, sizeof(lock_desc));
+    lock_desc.dwSize = sizeof(lock_desc);
+
+    for (t = 0; t < ARRAY_SIZE(tests); ++t)
+    {
+        memset(&surface_desc, 0, sizeof(surface_desc));
+        surface_desc.dwSize = sizeof(surface_desc);
+        surface_desc.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT | DDSD_CKSRCBLT;
+        surface_desc.ddsCaps.dwCaps = DDSCAPS_TEXTURE;
+        surface_desc.dwWidth = width;
+        surface_desc.dwHeight = 1;
+        U4(surface_desc).ddpfPixelFormat = tests[t].fmt;
+        surface_desc.ddckCKSrcBlt.dwColorSpaceLowValue = tests[t].key;
+        surface_desc.ddckCKSrcBlt.dwColorSpaceHighValue = tests[t].key;
+        hr = IDirectDraw7_CreateSurface(ddraw, &surface_desc, &texture, NULL);
+        ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+
+        /* Every third texel matches the key, the others are one off. */
+        hr = IDirectDrawSurface7_Lock(texture, NULL, &lock_desc, DDLOCK_WAIT, NULL);
+        ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+        for (x = 0; x < width; ++x)
+        {
+            texel = x % 3 == 1 ? tests[t].key : x % 3 ? tests[t].key + 1 : tests[t].key - 1;
+            if (tests[t].bpp == 4)
+                ((DWORD *)lock_desc.lpSurface)[x] = texel;
+            else
+                ((WORD *)lock_desc.lpSurface)[x] = texel;
+        }
+        hr = IDirectDrawSurface7_Unlock(texture, NULL);
+        ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+
+        hr = IDirect3DDevice7_SetTexture(device, 0, texture);
+        ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+
+        hr = IDirect3DDevice7_Clear(device, 0, NULL, D3DCLEAR_TARGET, 0x0000ff00, 1.0f, 0);
+        ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+        hr = IDirect3DDevice7_BeginScene(device);
+        ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+        hr = IDirect3DDevice7_DrawPrimitive(device, D3DPT_TRIANGLESTRIP, D3DFVF_XYZ | D3DFVF_TEX1, quad, 4, 0);
+        ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+        hr = IDirect3DDevice7_EndScene(device);
+        ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+
+        for (x = 0; x < width; ++x)
+        {
+            color = get_surface_color(rt, (2 * x + 1) * 640 / (2 * width), 240);
+            if (x % 3 == 1)
+                ok(compare_color(color, 0x0000ff00, 1), "Got unexpected color 0x%08x, format %s, texel %u.\n",
+                        color, tests[t].name, x);
+            else
+                ok(compare_color(color, 0x00000000, 1), "Got unexpected color 0x%08x, format %s, texel %u.\n",
+                        color, tests[t].name, x);
+        }
+
+        hr = IDirect3DDevice7_SetTexture(device, 0, NULL);
+        ok(hr == DD_OK, "Got unexpected hr %#x.\n", hr);
+        IDirectDrawSurface7_Release(texture);
+    }
+
+done:
+    IDirectDrawSurface7_Release(rt);
+    IDirectDraw7_Release(ddraw);
+    refcount = IDirect3DDevice7_Release(device);
+    ok(!refcount, "Device has %u references left.\n", refcount);
+    DestroyWindow(window);
+}
+
 static void test_range_colorkey(void)
 {
     IDirectDraw7 *ddraw;
@@ -17638,6 +17797,7 @@ START_TEST(ddraw7)
     test_color_fill();
     test_texcoordindex();
     test_colorkey_precision();
+    test_colorkey_wide_texture();
     test_range_colorkey();
     test_shademode();
     test_lockrect_invalid();
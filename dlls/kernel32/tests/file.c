@@ -5356,10 +5356,10 @@ static void test_GetFileAttributesExW(void)
 static void test_post_completion(void)
 {
     OVERLAPPED ovl, ovl2, *povl;
-    OVERLAPPED_ENTRY entries[2];
+    OVERLAPPED_ENTRY entries[2], many_entries[150];
     ULONG_PTR key;
     HANDLE port;
-    ULONG count;
+    ULONG count, i;
     DWORD size;
     BOOL ret;
 
@@ -5429,6 +5429,25 @@ static void test_post_completion(void)
     ok(!(ULONG)entries[1].Internal, "wrong internal %#x\n", (ULONG)entries[1].Internal);
     ok(entries[1].dwNumberOfBytesTransferred == 654, "wrong size %u\n", entries[1].dwNumberOfBytesTransferred);
 
+    /* more completions than fit in a single server reply */
+    for (i = 0; i < ARRAY_SIZE(many_entries) - 10; i++)
+    {
+        ret = PostQueuedCompletionStatus( port, i, 456, &ovl );
+        ok(ret, "PostQueuedCompletionStatus failed: %u\n", GetLastError());
+    }
+
+    count = 0xdeadbeef;
+    memset( many_entries, 0xcc, sizeof(many_entries) );
+    ret = pGetQueuedCompletionStatusEx( port, many_entries, ARRAY_SIZE(many_entries), &count, 0, FALSE );
+    ok(ret, "GetQueuedCompletionStatusEx failed\n");
+    ok(count == ARRAY_SIZE(many_entries) - 10, "wrong count %u\n", count);
+    for (i = 0; i < count; i++)
+    {
+        ok(many_entries[i].lpCompletionKey == 456, "%u: wrong key %lu\n", i, many_entries[i].lpCompletionKey);
+        ok(many_entries[i].dwNumberOfBytesTransferred == i, "%u: wrong size %u\n",
+           i, many_entries[i].dwNumberOfBytesTransferred);
+    }
+
     user_apc_ran = FALSE;
     QueueUserAPC( user_apc, GetCurrentThread(), 0 );
 
@@ -38,6 +38,22 @@
 #define HEAP_VALIDATE_ALL     0x20000000
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
+/* Wine-specific heap profiling counters, enabled with WINEHEAPPROFILE */
+#define HeapWineProfileInformation ((HEAP_INFORMATION_CLASS)0x1000)
+
+struct heap_wine_profile
+{
+    ULONGLONG live_bytes;
+    ULONGLONG peak_bytes;
+    ULONGLONG alloc_count;
+    ULONGLONG free_count;
+    ULONGLONG committed_bytes;
+    ULONGLONG free_bytes;
+    ULONGLONG largest_free_block;
+    ULONG     sample_rate;
+    ULONG     live_samples;
+};
+
 static BOOL (WINAPI *pHeapQueryInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T, PSIZE_T);
 static BOOL (WINAPI *pGetPhysicallyInstalledSystemMemory)(ULONGLONG *);
 static ULONG (WINAPI *pRtlGetNtGlobalFlags)(void);
@@ -892,6 +908,72 @@ static void test_HeapQueryInformation(void)
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
 }
 
+static void test_low_fragmentation_heap(void)
+{
+    ULONG info;
+    HANDLE heap;
+    BYTE *ptrs[256], *p;
+    SIZE_T size;
+    BOOL ret;
+    int i, j;
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed %u\n", GetLastError() );
+
+    info = 2;
+    SetLastError( 0xdeadbeef );
+    ret = HeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    if (!ret)
+    {
+        /* fails when heap debugging is enabled */
+        skip( "low fragmentation heap not available, error %u\n", GetLastError() );
+        HeapDestroy( heap );
+        return;
+    }
+
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation( heap, HeapCompatibilityInformation, &info, sizeof(info), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( info == 2, "expected 2, got %u\n", info );
+
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++)
+    {
+        ptrs[i] = HeapAlloc( heap, HEAP_ZERO_MEMORY, i );
+        ok( ptrs[i] != NULL, "HeapAlloc %u failed\n", i );
+        ok( !((ULONG_PTR)ptrs[i] % (2 * sizeof(void *))), "unaligned block %p\n", ptrs[i] );
+        size = HeapSize( heap, 0, ptrs[i] );
+        ok( size == i, "expected %u, got %lu\n", i, size );
+        for (j = 0; j < i; j++) if (ptrs[i][j]) break;
+        ok( j == i, "block %u not zeroed at %u\n", i, j );
+        memset( ptrs[i], 0xcc, i );
+        ok( HeapValidate( heap, 0, ptrs[i] ), "HeapValidate failed for %p\n", ptrs[i] );
+    }
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+
+    p = HeapReAlloc( heap, HEAP_ZERO_MEMORY, ptrs[10], 12 );
+    ok( p != NULL, "HeapReAlloc failed\n" );
+    ok( p[9] == 0xcc && !p[10] && !p[11], "wrong contents %x %x %x\n", p[9], p[10], p[11] );
+    ptrs[10] = p;
+    p = HeapReAlloc( heap, 0, ptrs[20], 4000 );
+    ok( p != NULL, "HeapReAlloc failed\n" );
+    ok( p[19] == 0xcc, "wrong contents %x\n", p[19] );
+    ok( HeapSize( heap, 0, p ) == 4000, "wrong size %lu\n", HeapSize( heap, 0, p ) );
+    ptrs[20] = p;
+
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++)
+    {
+        ret = HeapFree( heap, 0, ptrs[i] );
+        ok( ret, "HeapFree %u failed %u\n", i, GetLastError() );
+    }
+
+    info = 0;
+    SetLastError( 0xdeadbeef );
+    ret = HeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( !ret, "HeapSetInformation succeeded\n" );
+
+    ok( HeapDestroy( heap ), "HeapDestroy failed %u\n", GetLastError() );
+}
+
 static void test_heap_checks( DWORD flags )
 {
     BYTE old, *p, *p2;
@@ -1184,6 +1266,108 @@ static void test_child_heap( const char *arg )
     test_heap_checks( expect_heap );
 }
 
+static void test_child_heap_profile(void)
+{
+    struct heap_wine_profile profile;
+    void *ptrs[16];
+    HANDLE heap;
+    SIZE_T size;
+    BOOL ret;
+    int i;
+
+    pHeapQueryInformation = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapQueryInformation");
+
+    ret = pHeapQueryInformation( GetProcessHeap(), HeapWineProfileInformation, &profile, sizeof(profile), &size );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( size == sizeof(profile), "got size %lu\n", size );
+    ok( profile.sample_rate == 1, "got sample rate %u\n", profile.sample_rate );
+    ok( profile.alloc_count > 0, "got no allocations\n" );
+    ok( profile.peak_bytes >= profile.live_bytes, "got peak %s, live %s\n",
+        wine_dbgstr_longlong(profile.peak_bytes), wine_dbgstr_longlong(profile.live_bytes) );
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed %u\n", GetLastError() );
+    ret = pHeapQueryInformation( heap, HeapWineProfileInformation, &profile, sizeof(profile), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( !profile.live_bytes, "got live bytes %s\n", wine_dbgstr_longlong(profile.live_bytes) );
+    ok( !profile.alloc_count, "got alloc count %s\n", wine_dbgstr_longlong(profile.alloc_count) );
+
+    for (i = 0; i < ARRAY_SIZE(ptrs); i++)
+    {
+        ptrs[i] = HeapAlloc( heap, 0, 1000 );
+        ok( ptrs[i] != NULL, "HeapAlloc %u failed\n", i );
+    }
+    ret = pHeapQueryInformation( heap, HeapWineProfileInformation, &profile, sizeof(profile), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( profile.live_bytes == 16000, "got live bytes %s\n", wine_dbgstr_longlong(profile.live_bytes) );
+    ok( profile.peak_bytes == 16000, "got peak bytes %s\n", wine_dbgstr_longlong(profile.peak_bytes) );
+    ok( profile.alloc_count == 16, "got alloc count %s\n", wine_dbgstr_longlong(profile.alloc_count) );
+    ok( !profile.free_count, "got free count %s\n", wine_dbgstr_longlong(profile.free_count) );
+    ok( profile.committed_bytes >= 16000, "got committed bytes %s\n",
+        wine_dbgstr_longlong(profile.committed_bytes) );
+    ok( profile.live_samples >= 16, "got %u live samples\n", profile.live_samples );
+
+    for (i = 0; i < ARRAY_SIZE(ptrs) / 2; i++) HeapFree( heap, 0, ptrs[i] );
+    ret = pHeapQueryInformation( heap, HeapWineProfileInformation, &profile, sizeof(profile), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( profile.live_bytes == 8000, "got live bytes %s\n", wine_dbgstr_longlong(profile.live_bytes) );
+    ok( profile.peak_bytes == 16000, "got peak bytes %s\n", wine_dbgstr_longlong(profile.peak_bytes) );
+    ok( profile.free_count == 8, "got free count %s\n", wine_dbgstr_longlong(profile.free_count) );
+    ok( profile.free_bytes <= profile.committed_bytes, "got free bytes %s, committed %s\n",
+        wine_dbgstr_longlong(profile.free_bytes), wine_dbgstr_longlong(profile.committed_bytes) );
+    ok( profile.largest_free_block <= profile.free_bytes, "got largest free block %s, free %s\n",
+        wine_dbgstr_longlong(profile.largest_free_block), wine_dbgstr_longlong(profile.free_bytes) );
+
+    ok( HeapDestroy( heap ), "HeapDestroy failed %u\n", GetLastError() );
+}
+
+static void test_heap_profile( const char *argv0 )
+{
+    struct heap_wine_profile profile;
+    char buffer[MAX_PATH];
+    PROCESS_INFORMATION info;
+    STARTUPINFOA startup;
+    SIZE_T size;
+    BOOL ret;
+
+    if (GetEnvironmentVariableA( "WINEHEAPPROFILE", buffer, sizeof(buffer) ))
+    {
+        skip( "heap profiling is already enabled\n" );
+        return;
+    }
+
+    size = 0;
+    SetLastError( 0xdeadbeef );
+    ret = pHeapQueryInformation( GetProcessHeap(), HeapWineProfileInformation, &profile, sizeof(profile) - 1, &size );
+    ok( !ret, "HeapQueryInformation succeeded\n" );
+    if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+    {
+        win_skip( "HeapWineProfileInformation not supported, error %u\n", GetLastError() );
+        return;
+    }
+    ok( size == sizeof(profile), "got size %lu\n", size );
+
+    /* the counters are only kept when profiling is enabled */
+    SetLastError( 0xdeadbeef );
+    ret = pHeapQueryInformation( GetProcessHeap(), HeapWineProfileInformation, &profile, sizeof(profile), NULL );
+    ok( !ret, "HeapQueryInformation succeeded\n" );
+    ok( GetLastError() == ERROR_NOT_SUPPORTED, "got error %u\n", GetLastError() );
+
+    memset( &startup, 0, sizeof(startup) );
+    startup.cb = sizeof(startup);
+    SetEnvironmentVariableA( "WINEHEAPPROFILE", "1" );
+    sprintf( buffer, "%s heap.c profile", argv0 );
+    ret = CreateProcessA( NULL, buffer, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info );
+    ok( ret, "failed to create child process error %u\n", GetLastError() );
+    if (ret)
+    {
+        wait_child_process( info.hProcess );
+        CloseHandle( info.hThread );
+        CloseHandle( info.hProcess );
+    }
+    SetEnvironmentVariableA( "WINEHEAPPROFILE", NULL );
+}
+
 static void test_GetPhysicallyInstalledSystemMemory(void)
 {
     HMODULE kernel32 = GetModuleHandleA("kernel32.dll");
@@ -1226,7 +1410,8 @@ START_TEST(heap)
     argc = winetest_get_mainargs( &argv );
     if (argc >= 3)
     {
-        test_child_heap( argv[2] );
+        if (!strcmp( argv[2], "profile" )) test_child_heap_profile();
+        else test_child_heap( argv[2] );
         return;
     }
 
@@ -1245,6 +1430,8 @@ START_TEST(heap)
     test_sized_HeapReAlloc((1 << 20), 1);
 
     test_HeapQueryInformation();
+    test_low_fragmentation_heap();
+    test_heap_profile( argv[0] );
     test_GetPhysicallyInstalledSystemMemory();
 
     if (pRtlGetNtGlobalFlags)
@@ -31,6 +31,7 @@
 #include "winternl.h"
 #include "winnls.h"
 #include "winuser.h"
+#include "psapi.h"
 #include "wine/test.h"
 #include "delayloadhandler.h"
 
@@ -88,6 +89,7 @@ static BOOL (WINAPI *pIsWow64Process)(HANDLE,PBOOL);
 static BOOL (WINAPI *pWow64DisableWow64FsRedirection)(void **);
 static BOOL (WINAPI *pWow64RevertWow64FsRedirection)(void *);
 static HMODULE (WINAPI *pLoadPackagedLibrary)(LPCWSTR lpwLibFileName, DWORD Reserved);
+static BOOL (WINAPI *pK32QueryWorkingSetEx)(HANDLE, PVOID, DWORD);
 
 static PVOID RVAToAddr(DWORD_PTR rva, HMODULE module)
 {
@@ -4125,6 +4127,324 @@ static void test_HashLinks(void)
     ok(found, "Could not find kernel32\n");
 }
 
+/* resolve an export by walking the export directory, independently of the loader lookup */
+static FARPROC find_export( HMODULE module, const char *name )
+{
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const DWORD *names, *functions;
+    const WORD *ordinals;
+    const char *fwd, *sep;
+    char dll[MAX_PATH];
+    DWORD size, rva, ordinal;
+    int min, max, pos, res;
+
+    exports = pRtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &size );
+    if (!exports) return NULL;
+    names     = RVAToAddr( exports->AddressOfNames, module );
+    ordinals  = RVAToAddr( exports->AddressOfNameOrdinals, module );
+    functions = RVAToAddr( exports->AddressOfFunctions, module );
+
+    if (IS_INTRESOURCE( name ))
+        ordinal = LOWORD( name ) - exports->Base;
+    else
+    {
+        min = 0;
+        max = exports->NumberOfNames - 1;
+        for (;;)
+        {
+            if (min > max) return NULL;
+            pos = (min + max) / 2;
+            if (!(res = strcmp( RVAToAddr( names[pos], module ), name ))) break;
+            if (res > 0) max = pos - 1;
+            else min = pos + 1;
+        }
+        ordinal = ordinals[pos];
+    }
+    if (ordinal >= exports->NumberOfFunctions || !(rva = functions[ordinal])) return NULL;
+
+    /* forwarded export, resolve it in the target module */
+    if (rva >= (char *)exports - (char *)module && rva < (char *)exports - (char *)module + size)
+    {
+        fwd = RVAToAddr( rva, module );
+        if (!(sep = strrchr( fwd, '.' )) || sep - fwd >= sizeof(dll)) return NULL;
+        memcpy( dll, fwd, sep - fwd );
+        dll[sep - fwd] = 0;
+        if (!(module = GetModuleHandleA( dll )) && !(module = LoadLibraryA( dll ))) return NULL;
+        if (sep[1] == '#') return find_export( module, (const char *)(ULONG_PTR)atoi( sep + 2 ));
+        return find_export( module, sep + 1 );
+    }
+    return (FARPROC)((char *)module + rva);
+}
+
+static void test_export_lookup(void)
+{
+    static const char * const modules[] = { "ntdll.dll", "kernel32.dll", "kernelbase.dll" };
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const DWORD *names;
+    const char *name;
+    HMODULE module;
+    DWORD size, i, j;
+    FARPROC proc, expect;
+
+    for (i = 0; i < ARRAY_SIZE(modules); i++)
+    {
+        if (!(module = GetModuleHandleA( modules[i] ))) continue;
+        exports = pRtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &size );
+        ok( exports != NULL, "%s: no exports\n", modules[i] );
+        if (!exports) continue;
+        names = RVAToAddr( exports->AddressOfNames, module );
+
+        for (j = 0; j < exports->NumberOfNames; j++)
+        {
+            name = RVAToAddr( names[j], module );
+            expect = find_export( module, name );
+            proc = GetProcAddress( module, name );
+            if (!expect)
+            {
+                /* forwarded to a module that is not available */
+                ok( !proc, "%s.%s: got %p for an unresolvable export\n", modules[i], name, proc );
+                continue;
+            }
+            ok( proc != NULL, "%s.%s: lookup failed, error %u\n", modules[i], name, GetLastError() );
+            ok( proc == expect, "%s.%s: got %p, expected %p\n", modules[i], name, proc, expect );
+            /* the second lookup goes through any cached state built by the first one */
+            ok( GetProcAddress( module, name ) == proc, "%s.%s: got different addresses\n", modules[i], name );
+        }
+
+        SetLastError( 0xdeadbeef );
+        proc = GetProcAddress( module, "wine_nonexistent_export" );
+        ok( !proc, "%s: got %p for a nonexistent export\n", modules[i], proc );
+        ok( GetLastError() == ERROR_PROC_NOT_FOUND, "%s: wrong error %u\n", modules[i], GetLastError() );
+    }
+}
+
+/* check that the import address table of the main module agrees with GetProcAddress */
+static DWORD check_startup_imports(void)
+{
+    HMODULE module = GetModuleHandleA( NULL );
+    const IMAGE_IMPORT_DESCRIPTOR *imports;
+    const IMAGE_THUNK_DATA *import_list, *thunk_list;
+    const IMAGE_IMPORT_BY_NAME *import_name;
+    DWORD size, mismatches = 0;
+    HMODULE imp_mod;
+
+    imports = pRtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_IMPORT, &size );
+    if (!imports) return 0;
+
+    for (; imports->Name && imports->FirstThunk; imports++)
+    {
+        if (!U(*imports).OriginalFirstThunk) continue;
+        if (!(imp_mod = GetModuleHandleA( RVAToAddr( imports->Name, module ) ))) continue;
+        import_list = RVAToAddr( U(*imports).OriginalFirstThunk, module );
+        thunk_list = RVAToAddr( imports->FirstThunk, module );
+        for (; import_list->u1.Ordinal; import_list++, thunk_list++)
+        {
+            if (IMAGE_SNAP_BY_ORDINAL( import_list->u1.Ordinal )) continue;
+            import_name = RVAToAddr( import_list->u1.AddressOfData, module );
+            if ((ULONG_PTR)GetProcAddress( imp_mod, (const char *)import_name->Name ) !=
+                thunk_list->u1.Function)
+                mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+static void test_process_startup(void)
+{
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    char cmdline[MAX_PATH + 32];
+    DWORD ret, start, total = 0;
+    char **argv;
+    int i, count = 10;
+
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" loader startup", argv[0] );
+
+    /* the first run populates any per-prefix caches, only time the following ones */
+    for (i = 0; i <= count; i++)
+    {
+        start = GetTickCount();
+        ret = CreateProcessA( argv[0], cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+        ok( ret, "CreateProcess(%s) error %d\n", cmdline, GetLastError() );
+        if (!ret) return;
+        ret = WaitForSingleObject( pi.hProcess, 10000 );
+        ok( ret == WAIT_OBJECT_0, "child process failed to terminate\n" );
+        if (ret != WAIT_OBJECT_0) TerminateProcess( pi.hProcess, 0 );
+        if (i) total += GetTickCount() - start;
+        GetExitCodeProcess( pi.hProcess, &ret );
+        ok( !ret, "run %u: %u imports differ from GetProcAddress\n", i, ret );
+        CloseHandle( pi.hThread );
+        CloseHandle( pi.hProcess );
+    }
+    trace( "average process startup time %u ms\n", total / count );
+}
+
+/* create a dll with a single relocated pointer in its data section */
+static void create_reloc_dll( char dll_name[MAX_PATH] )
+{
+    struct
+    {
+        IMAGE_DOS_HEADER     dos;
+        IMAGE_NT_HEADERS     nt;
+        IMAGE_SECTION_HEADER sections[2];
+    } *headers;
+    IMAGE_BASE_RELOCATION *reloc;
+    char temp_path[MAX_PATH], *data;
+    DWORD size = 0x600, written;
+    HANDLE file;
+    BOOL ret;
+
+    data = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, size );
+    headers = (void *)data;
+    headers->dos = dos_header;
+    headers->nt = nt_header_template;
+    headers->nt.FileHeader.NumberOfSections = 2;
+    headers->nt.FileHeader.Characteristics &= ~IMAGE_FILE_RELOCS_STRIPPED;
+    headers->nt.OptionalHeader.SectionAlignment = 0x1000;
+    headers->nt.OptionalHeader.FileAlignment = 0x200;
+    headers->nt.OptionalHeader.SizeOfImage = 0x3000;
+    headers->nt.OptionalHeader.SizeOfHeaders = 0x200;
+    headers->nt.OptionalHeader.DllCharacteristics = IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE;
+    headers->nt.OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    headers->nt.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress = 0x2000;
+    headers->nt.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size = sizeof(*reloc) + 2 * sizeof(WORD);
+
+    memcpy( headers->sections[0].Name, ".data", 5 );
+    headers->sections[0].Misc.VirtualSize = 0x200;
+    headers->sections[0].VirtualAddress = 0x1000;
+    headers->sections[0].SizeOfRawData = 0x200;
+    headers->sections[0].PointerToRawData = 0x200;
+    headers->sections[0].Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ;
+    memcpy( headers->sections[1].Name, ".reloc", 6 );
+    headers->sections[1].Misc.VirtualSize = 0x200;
+    headers->sections[1].VirtualAddress = 0x2000;
+    headers->sections[1].SizeOfRawData = 0x200;
+    headers->sections[1].PointerToRawData = 0x400;
+    headers->sections[1].Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ |
+                                           IMAGE_SCN_MEM_DISCARDABLE;
+
+    /* the first pointer of the data section points to its second one */
+    *(ULONG_PTR *)(data + 0x200) = nt_header_template.OptionalHeader.ImageBase + 0x1000 + sizeof(ULONG_PTR);
+    reloc = (IMAGE_BASE_RELOCATION *)(data + 0x400);
+    reloc->VirtualAddress = 0x1000;
+    reloc->SizeOfBlock = sizeof(*reloc) + 2 * sizeof(WORD);
+    ((WORD *)(reloc + 1))[0] = (is_win64 ? IMAGE_REL_BASED_DIR64 : IMAGE_REL_BASED_HIGHLOW) << 12;
+
+    GetTempPathA( MAX_PATH, temp_path );
+    GetTempFileNameA( temp_path, "ldr", 0, dll_name );
+    file = CreateFileA( dll_name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0 );
+    ok( file != INVALID_HANDLE_VALUE, "failed to create %s err %u\n", dll_name, GetLastError() );
+    ret = WriteFile( file, data, size, &written, NULL );
+    ok( ret && written == size, "WriteFile error %u\n", GetLastError() );
+    CloseHandle( file );
+    HeapFree( GetProcessHeap(), 0, data );
+}
+
+/* map the relocation test dll away from its preferred base, and report the address to the parent */
+static void map_reloc_dll( const char *dll_name )
+{
+    void *preferred = (void *)nt_header_template.OptionalHeader.ImageBase, *reserved, *ptr = NULL;
+    PSAPI_WORKING_SET_EX_INFORMATION info;
+    HANDLE file, section, mapping;
+    ULONG_PTR *value, *result;
+    NTSTATUS status;
+    SIZE_T size = 0;
+    BOOL ret;
+
+    reserved = VirtualAlloc( preferred, 0x10000, MEM_RESERVE, PAGE_NOACCESS );
+    ok( reserved == preferred, "failed to reserve %p\n", preferred );
+
+    file = CreateFileA( dll_name, GENERIC_READ | GENERIC_EXECUTE, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0 );
+    ok( file != INVALID_HANDLE_VALUE, "failed to open %s err %u\n", dll_name, GetLastError() );
+    status = pNtCreateSection( &section, SECTION_MAP_READ | SECTION_MAP_EXECUTE | SECTION_QUERY, NULL, NULL,
+                               PAGE_EXECUTE_READ, SEC_IMAGE, file );
+    ok( !status, "NtCreateSection failed %x\n", status );
+    status = pNtMapViewOfSection( section, GetCurrentProcess(), &ptr, 0, 0, NULL, &size, 1, 0, PAGE_EXECUTE_READ );
+    ok( status == STATUS_IMAGE_NOT_AT_BASE || broken(!status) /* relocated by the kernel */,
+        "NtMapViewOfSection returned %x\n", status );
+    ok( ptr != preferred, "image mapped at its preferred base\n" );
+    if (!ptr)
+    {
+        CloseHandle( section );
+        CloseHandle( file );
+        return;
+    }
+
+    value = (ULONG_PTR *)((char *)ptr + 0x1000);
+    ok( *value == (ULONG_PTR)(value + 1), "pointer not relocated: %p, expected %p\n", (void *)*value, value + 1 );
+
+    /* the relocated page is not a private copy of the process */
+    info.VirtualAddress = value;
+    ret = pK32QueryWorkingSetEx( GetCurrentProcess(), &info, sizeof(info) );
+    ok( ret, "QueryWorkingSetEx failed %u\n", GetLastError() );
+    ok( info.VirtualAttributes.s.Valid, "relocated page not valid\n" );
+    ok( info.VirtualAttributes.s.Shared, "relocated page not shared\n" );
+
+    mapping = OpenFileMappingA( FILE_MAP_WRITE, FALSE, "winetest_image_cache" );
+    ok( mapping != 0, "OpenFileMapping failed %u\n", GetLastError() );
+    result = MapViewOfFile( mapping, FILE_MAP_WRITE, 0, 0, sizeof(*result) );
+    *result = (ULONG_PTR)ptr;
+    UnmapViewOfFile( result );
+    CloseHandle( mapping );
+
+    pNtUnmapViewOfSection( GetCurrentProcess(), ptr );
+    CloseHandle( section );
+    CloseHandle( file );
+    VirtualFree( reserved, 0, MEM_RELEASE );
+}
+
+static void test_image_cache(void)
+{
+    PROCESS_INFORMATION pi;
+    STARTUPINFOA si = { sizeof(si) };
+    char cmdline[2 * MAX_PATH + 32], dll_name[MAX_PATH];
+    ULONG_PTR *result, base[2];
+    HANDLE mapping;
+    char **argv;
+    DWORD ret;
+    int i;
+
+    if (!pK32QueryWorkingSetEx)
+    {
+        win_skip( "QueryWorkingSetEx not available\n" );
+        return;
+    }
+
+    mapping = CreateFileMappingA( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(*result),
+                                  "winetest_image_cache" );
+    ok( mapping != 0, "CreateFileMapping failed %u\n", GetLastError() );
+    result = MapViewOfFile( mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(*result) );
+
+    create_reloc_dll( dll_name );
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" loader image_cache \"%s\"", argv[0], dll_name );
+
+    /* the second process maps the pages relocated by the first one, after that one has exited */
+    for (i = 0; i < 2; i++)
+    {
+        *result = 0;
+        ret = CreateProcessA( argv[0], cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi );
+        ok( ret, "CreateProcess(%s) error %d\n", cmdline, GetLastError() );
+        if (!ret) break;
+        wait_child_process( pi.hProcess );
+        CloseHandle( pi.hThread );
+        CloseHandle( pi.hProcess );
+        base[i] = *result;
+        ok( base[i] != 0, "run %u: image not mapped\n", i );
+    }
+    /* pages are cached for a given address, the image is normally mapped at the same place */
+    if (i == 2 && base[0] != base[1])
+        skip( "image mapped at %p and %p, can't check sharing\n", (void *)base[0], (void *)base[1] );
+
+    UnmapViewOfFile( result );
+    CloseHandle( mapping );
+
+    /* cached pages don't keep the file busy */
+    ret = DeleteFileA( dll_name );
+    ok( ret, "DeleteFile failed %u\n", GetLastError() );
+}
+
 START_TEST(loader)
 {
     int argc;
@@ -4163,6 +4483,14 @@ START_TEST(loader)
     pWow64RevertWow64FsRedirection = (void *)GetProcAddress(kernel32, "Wow64RevertWow64FsRedirection");
     pResolveDelayLoadedAPI = (void *)GetProcAddress(kernel32, "ResolveDelayLoadedAPI");
     pLoadPackagedLibrary = (void *)GetProcAddress(kernel32, "LoadPackagedLibrary");
+    pK32QueryWorkingSetEx = (void *)GetProcAddress(kernel32, "K32QueryWorkingSetEx");
+
+    argc = winetest_get_mainargs(&argv);
+    if (argc == 3 && !strcmp(argv[2], "startup"))
+    {
+        ExitProcess( check_startup_imports() );
+        return;
+    }
 
     if (pIsWow64Process) pIsWow64Process( GetCurrentProcess(), &is_wow64 );
     GetSystemInfo( &si );
@@ -4170,6 +4498,12 @@ START_TEST(loader)
     dos_header.e_magic = IMAGE_DOS_SIGNATURE;
     dos_header.e_lfanew = sizeof(dos_header);
 
+    if (argc == 4 && !strcmp(argv[2], "image_cache"))
+    {
+        map_reloc_dll( argv[3] );
+        return;
+    }
+
     mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, 4096, "winetest_loader");
     ok(mapping != 0, "CreateFileMapping failed\n");
     child_failures = MapViewOfFile(mapping, FILE_MAP_READ|FILE_MAP_WRITE, 0, 0, 4096);
@@ -4180,7 +4514,6 @@ START_TEST(loader)
     else
         *child_failures = -1;
 
-    argc = winetest_get_mainargs(&argv);
     if (argc > 4)
     {
         test_dll_phase = atoi(argv[4]);
@@ -4199,6 +4532,9 @@ START_TEST(loader)
     test_LoadPackagedLibrary();
     test_wow64_redirection();
     test_HashLinks();
+    test_export_lookup();
+    test_process_startup();
+    test_image_cache();
     test_dll_file( "ntdll.dll" );
     test_dll_file( "kernel32.dll" );
     test_dll_file( "advapi32.dll" );
@@ -57,6 +57,9 @@ static NTSTATUS (WINAPI *pNtFreeVirtualMemory)(HANDLE, PVOID *, SIZE_T *, ULONG)
 static NTSTATUS (WINAPI *pNtQuerySystemTime)(LARGE_INTEGER *);
 static NTSTATUS (WINAPI *pNtWaitForSingleObject)(HANDLE, BOOLEAN, const LARGE_INTEGER *);
 static NTSTATUS (WINAPI *pNtWaitForMultipleObjects)(ULONG,const HANDLE*,BOOLEAN,BOOLEAN,const LARGE_INTEGER*);
+static DEBUG_BUFFER * (WINAPI *pRtlCreateQueryDebugBuffer)(ULONG,BOOLEAN);
+static NTSTATUS (WINAPI *pRtlDestroyQueryDebugBuffer)(DEBUG_BUFFER *);
+static NTSTATUS (WINAPI *pRtlQueryProcessLockInformation)(DEBUG_BUFFER *);
 static PSLIST_ENTRY (__fastcall *pRtlInterlockedPushListSList)(PSLIST_HEADER list, PSLIST_ENTRY first,
                                                                PSLIST_ENTRY last, ULONG count);
 static PSLIST_ENTRY (WINAPI *pRtlInterlockedPushListSListEx)(PSLIST_HEADER list, PSLIST_ENTRY first,
@@ -3097,6 +3100,107 @@ static void test_crit_section(void)
     ok(cs.DebugInfo == NULL, "Unexpected debug info pointer %p.\n", cs.DebugInfo);
 }
 
+static CRITICAL_SECTION contention_cs;
+static LONG contention_counter;
+
+static DWORD WINAPI crit_section_contention_thread(void *arg)
+{
+    int i;
+
+    for (i = 0; i < 100000; i++)
+    {
+        EnterCriticalSection(&contention_cs);
+        contention_counter++;
+        LeaveCriticalSection(&contention_cs);
+    }
+    return 0;
+}
+
+static void test_crit_section_lock_information(void)
+{
+    struct
+    {
+        ULONG count;
+        DEBUG_LOCK_INFORMATION locks[1];
+    } *locks;
+    DEBUG_BUFFER *buffer;
+    NTSTATUS status;
+    SYSTEM_INFO si;
+    ULONG i;
+
+    if (!pRtlQueryProcessLockInformation)
+    {
+        win_skip("RtlQueryProcessLockInformation is not available.\n");
+        return;
+    }
+
+    buffer = pRtlCreateQueryDebugBuffer(0, FALSE);
+    ok(!!buffer, "Failed to create debug buffer.\n");
+    status = pRtlQueryProcessLockInformation(buffer);
+    ok(!status, "Got unexpected status %#x.\n", status);
+    locks = buffer->LockInformation;
+    ok(!!locks, "Got NULL lock information.\n");
+
+    for (i = 0; i < locks->count; ++i)
+    {
+        if (locks->locks[i].Address == &contention_cs)
+            break;
+    }
+
+    GetSystemInfo(&si);
+    if (i < locks->count)
+    {
+        ok(!locks->locks[i].Type, "Got unexpected type %u.\n", locks->locks[i].Type);
+        ok(locks->locks[i].ContentionCount, "Got zero contention count.\n");
+        ok(locks->locks[i].EntryCount <= locks->locks[i].ContentionCount,
+                "Got entry count %u, contention count %u.\n",
+                locks->locks[i].EntryCount, locks->locks[i].ContentionCount);
+    }
+    else
+    {
+        /* Contention isn't guaranteed with a single processor, and Windows
+         * only reports sections that have debug info. */
+        ok(si.dwNumberOfProcessors == 1 || broken(!pInitializeCriticalSectionEx),
+                "Contended critical section not reported.\n");
+    }
+
+    pRtlDestroyQueryDebugBuffer(buffer);
+}
+
+static void test_crit_section_contention(void)
+{
+    HANDLE threads[4];
+    DWORD ret;
+    int i;
+
+    /* Win8+ only lists sections with debug info in the lock information */
+    if (pInitializeCriticalSectionEx)
+        pInitializeCriticalSectionEx(&contention_cs, 4000, RTL_CRITICAL_SECTION_FLAG_FORCE_DEBUG_INFO);
+    else
+        InitializeCriticalSectionAndSpinCount(&contention_cs, 4000);
+    contention_counter = 0;
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+        threads[i] = CreateThread(NULL, 0, crit_section_contention_thread, NULL, 0, NULL);
+    ret = WaitForMultipleObjects(ARRAY_SIZE(threads), threads, TRUE, 60000);
+    ok(ret == WAIT_OBJECT_0, "WaitForMultipleObjects returned %u\n", ret);
+    ok(contention_counter == ARRAY_SIZE(threads) * 100000, "got counter %d\n", contention_counter);
+    for (i = 0; i < ARRAY_SIZE(threads); i++) CloseHandle(threads[i]);
+
+    /* a lower spin count bounds the spinning, without breaking the lock */
+    SetCriticalSectionSpinCount(&contention_cs, 1);
+    contention_counter = 0;
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+        threads[i] = CreateThread(NULL, 0, crit_section_contention_thread, NULL, 0, NULL);
+    ret = WaitForMultipleObjects(ARRAY_SIZE(threads), threads, TRUE, 60000);
+    ok(ret == WAIT_OBJECT_0, "WaitForMultipleObjects returned %u\n", ret);
+    ok(contention_counter == ARRAY_SIZE(threads) * 100000, "got counter %d\n", contention_counter);
+    for (i = 0; i < ARRAY_SIZE(threads); i++) CloseHandle(threads[i]);
+
+    test_crit_section_lock_information();
+
+    DeleteCriticalSection(&contention_cs);
+}
+
 static int zigzag_state, zigzag_count[2], zigzag_stop;
 
 static DWORD CALLBACK zigzag_event0(void *arg)
@@ -3204,6 +3308,9 @@ START_TEST(sync)
     pNtQuerySystemTime = (void *)GetProcAddress(hntdll, "NtQuerySystemTime");
     pNtWaitForSingleObject = (void *)GetProcAddress(hntdll, "NtWaitForSingleObject");
     pNtWaitForMultipleObjects = (void *)GetProcAddress(hntdll, "NtWaitForMultipleObjects");
+    pRtlCreateQueryDebugBuffer = (void *)GetProcAddress(hntdll, "RtlCreateQueryDebugBuffer");
+    pRtlDestroyQueryDebugBuffer = (void *)GetProcAddress(hntdll, "RtlDestroyQueryDebugBuffer");
+    pRtlQueryProcessLockInformation = (void *)GetProcAddress(hntdll, "RtlQueryProcessLockInformation");
     pRtlInterlockedPushListSList = (void *)GetProcAddress(hntdll, "RtlInterlockedPushListSList");
     pRtlInterlockedPushListSListEx = (void *)GetProcAddress(hntdll, "RtlInterlockedPushListSListEx");
 
@@ -3239,4 +3346,5 @@ START_TEST(sync)
     test_apc_deadlock();
     test_zigzag_event();
     test_crit_section();
+    test_crit_section_contention();
 }
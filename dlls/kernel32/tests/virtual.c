@@ -4452,6 +4452,72 @@ todo_wine
     CloseHandle(mapping);
 }
 
+static DWORD touch_pages(char *mem, SIZE_T size)
+{
+    DWORD start = GetTickCount();
+    unsigned int i, j, pos = 0;
+
+    /* pseudo-random accesses one page apart, to defeat the caches and stress the TLB */
+    for (j = 0; j < 8; j++)
+        for (i = 0; i < size / 4096 * 16; i++)
+        {
+            pos = pos * 1103515245 + 12345;
+            mem[(pos % (size / 4096)) * 4096 + (i & 0xfff)]++;
+        }
+    return GetTickCount() - start;
+}
+
+static void test_large_pages(void)
+{
+    SIZE_T large_page_size = GetLargePageMinimum(), size;
+    DWORD large_time, small_time;
+    char *mem, *small;
+
+    if (!large_page_size)
+    {
+        skip("large pages are not supported\n");
+        return;
+    }
+    ok(!(large_page_size & (large_page_size - 1)), "large page size %#lx is not a power of 2\n", large_page_size);
+
+    SetLastError(0xdeadbeef);
+    mem = VirtualAlloc(NULL, large_page_size / 2, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    ok(!mem, "VirtualAlloc succeeded\n");
+    ok(GetLastError() == ERROR_INVALID_PARAMETER || GetLastError() == ERROR_PRIVILEGE_NOT_HELD,
+       "got error %u\n", GetLastError());
+
+    SetLastError(0xdeadbeef);
+    mem = VirtualAlloc(NULL, large_page_size, MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+    ok(!mem, "VirtualAlloc succeeded\n");
+    ok(GetLastError() == ERROR_INVALID_PARAMETER || GetLastError() == ERROR_PRIVILEGE_NOT_HELD,
+       "got error %u\n", GetLastError());
+
+    size = max(large_page_size, 32 * 1024 * 1024) & ~(large_page_size - 1);
+    SetLastError(0xdeadbeef);
+    mem = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (!mem && GetLastError() == ERROR_PRIVILEGE_NOT_HELD)
+    {
+        win_skip("no privilege to allocate large pages\n");
+        return;
+    }
+    ok(mem != NULL, "VirtualAlloc failed, error %u\n", GetLastError());
+    if (!mem) return;
+    ok(!((UINT_PTR)mem & (min(large_page_size, 0x200000) - 1)), "large page allocation %p is not aligned\n", mem);
+
+    small = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(small != NULL, "VirtualAlloc failed, error %u\n", GetLastError());
+
+    memset(mem, 0, size);
+    memset(small, 0, size);
+    large_time = touch_pages(mem, size);
+    small_time = touch_pages(small, size);
+    trace("%lu MB with %lu KB pages: %u ms, with normal pages: %u ms\n",
+          size >> 20, large_page_size >> 10, large_time, small_time);
+
+    ok(VirtualFree(small, 0, MEM_RELEASE), "VirtualFree failed, error %u\n", GetLastError());
+    ok(VirtualFree(mem, 0, MEM_RELEASE), "VirtualFree failed, error %u\n", GetLastError());
+}
+
 START_TEST(virtual)
 {
     int argc;
@@ -4529,6 +4595,7 @@ START_TEST(virtual)
     test_IsBadWritePtr();
     test_IsBadCodePtr();
     test_write_watch();
+    test_large_pages();
 #if defined(__i386__) || defined(__x86_64__)
     test_stack_commit();
 #endif
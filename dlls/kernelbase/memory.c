@@ -33,6 +33,7 @@
 #include "winnls.h"
 #include "winternl.h"
 #include "winerror.h"
+#include "ddk/wdm.h"
 
 #include "kernelbase.h"
 #include "wine/exception.h"
@@ -41,6 +42,8 @@
 WINE_DEFAULT_DEBUG_CHANNEL(heap);
 WINE_DECLARE_DEBUG_CHANNEL(virtual);
 
+static const KSHARED_USER_DATA *user_shared_data = (KSHARED_USER_DATA *)0x7ffe0000;
+
 
 /***********************************************************************
  * Virtual memory functions
@@ -64,7 +67,7 @@ BOOL WINAPI DECLSPEC_HOTPATCH FlushViewOfFile( const void *base, SIZE_T size )
  */
 SIZE_T WINAPI GetLargePageMinimum(void)
 {
-    return 2 * 1024 * 1024;
+    return user_shared_data->LargePageMinimum;
 }
 
 
@@ -24,6 +24,7 @@
 #include "config.h"
 #include "msvcrt.h"
 #include "mtdll.h"
+#include "wine/list.h"
 #include "wine/debug.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(msvcrt);
@@ -39,9 +40,7 @@ WINE_DEFAULT_DEBUG_CHANNEL(msvcrt);
     ((((DWORD_PTR)((char *)ptr + alignment + sizeof(void *) + offset)) & \
       ~(alignment - 1)) - offset))
 
-#define SB_HEAP_ALIGN 16
-
-static HANDLE heap, sb_heap;
+static HANDLE heap;
 
 typedef int (CDECL *MSVCRT_new_handler_func)(MSVCRT_size_t size);
 
@@ -53,51 +52,263 @@ static unsigned int MSVCRT_amblksiz = 16;
 /* FIXME - According to documentation it should be 480 bytes, at runtime default is 0 */
 static MSVCRT_size_t MSVCRT_sbh_threshold = 0;
 
-static void* msvcrt_heap_alloc(DWORD flags, MSVCRT_size_t size)
+/* small blocks heap
+ *
+ * Blocks below the threshold are carved out of 64k slabs holding blocks of
+ * a single size class, without any per-block header. Each thread keeps a
+ * magazine of free blocks per size class, so that most allocations and
+ * frees don't need to take the heap lock.
+ */
+
+#define SBH_SLAB_SIZE     0x10000                    /* size and alignment of a slab */
+#define SBH_BLOCK_ALIGN   16                         /* size class granularity */
+#define SBH_MAX_SIZE      1024                       /* max. rounded threshold */
+#define SBH_NB_CLASSES    (SBH_MAX_SIZE / SBH_BLOCK_ALIGN)
+#define SBH_MAGAZINE_SIZE 16                         /* max. cached blocks per thread and class */
+#define SBH_SLAB_MAGIC    0x48425353                 /* "SSBH" */
+
+struct sbh_slab
+{
+    DWORD        magic;
+    unsigned int class;   /* size class of the blocks */
+    unsigned int used;    /* number of blocks not in the free list */
+    unsigned int count;   /* total number of blocks */
+    void        *free;    /* list of free blocks */
+    struct list  entry;   /* entry in the list of slabs with free blocks */
+    struct list  slabs;   /* entry in the list of all slabs */
+};
+
+#define SBH_SLAB_HEADER   ((sizeof(struct sbh_slab) + SBH_BLOCK_ALIGN - 1) & ~(SBH_BLOCK_ALIGN - 1))
+
+struct sbh_magazine
 {
-    if(size < MSVCRT_sbh_threshold)
+    unsigned int count;
+    void        *blocks[SBH_MAGAZINE_SIZE];
+};
+
+struct sbh_cache
+{
+    struct sbh_magazine magazines[SBH_NB_CLASSES];
+};
+
+static struct list sbh_free_slabs[SBH_NB_CLASSES];  /* slabs with free blocks, per size class */
+static struct list sbh_all_slabs = LIST_INIT( sbh_all_slabs );
+
+#ifndef _WIN64
+static unsigned int sbh_slab_map[0x10000 / 32];  /* bitmap of the 64k regions used by slabs */
+#endif
+
+static inline BOOL sbh_is_block(const void *ptr)
+{
+#ifdef _WIN64
+    return FALSE;  /* no small blocks heap on 64-bit */
+#else
+    ULONG_PTR index = (ULONG_PTR)ptr / SBH_SLAB_SIZE;
+    return ptr && (sbh_slab_map[index / 32] & (1u << (index % 32)));
+#endif
+}
+
+static inline void sbh_set_slab_map(const struct sbh_slab *slab, BOOL set)
+{
+#ifndef _WIN64
+    ULONG_PTR index = (ULONG_PTR)slab / SBH_SLAB_SIZE;
+    if (set) sbh_slab_map[index / 32] |= 1u << (index % 32);
+    else sbh_slab_map[index / 32] &= ~(1u << (index % 32));
+#endif
+}
+
+static inline struct sbh_slab *sbh_get_slab(const void *ptr)
+{
+    return (struct sbh_slab *)((ULONG_PTR)ptr & ~(ULONG_PTR)(SBH_SLAB_SIZE - 1));
+}
+
+static inline MSVCRT_size_t sbh_block_size(unsigned int class)
+{
+    return (class + 1) * SBH_BLOCK_ALIGN;
+}
+
+/* get the current thread magazine for a size class
+ *
+ * Frees don't create the thread data, they may happen while the thread or
+ * the process is shutting down. */
+static struct sbh_magazine *sbh_get_magazine(unsigned int class, BOOL create)
+{
+    DWORD err = GetLastError();  /* TlsGetValue resets the last error */
+    thread_data_t *data;
+
+    if (msvcrt_tls_index == TLS_OUT_OF_INDEXES) return NULL;
+    if (create)
+        data = msvcrt_get_thread_data();
+    else
+        data = TlsGetValue(msvcrt_tls_index);
+    SetLastError(err);
+
+    if (!data) return NULL;
+    if (!data->sbh_cache && (!create ||
+        !(data->sbh_cache = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*data->sbh_cache)))))
+        return NULL;
+    return &data->sbh_cache->magazines[class];
+}
+
+/* allocate a new slab for a size class, heap lock must be held */
+static struct sbh_slab *sbh_create_slab(unsigned int class)
+{
+    MSVCRT_size_t size = sbh_block_size(class);
+    struct sbh_slab *slab;
+    char *block;
+    unsigned int i;
+
+    /* virtual allocations are always 64k aligned */
+    if (!(slab = VirtualAlloc(NULL, SBH_SLAB_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE)))
+        return NULL;
+
+    slab->magic = SBH_SLAB_MAGIC;
+    slab->class = class;
+    slab->used  = 0;
+    slab->count = (SBH_SLAB_SIZE - SBH_SLAB_HEADER) / size;
+    slab->free  = NULL;
+    block = (char *)slab + SBH_SLAB_HEADER + (slab->count - 1) * size;
+    for (i = 0; i < slab->count; i++, block -= size)
     {
-        void *memblock, *temp, **saved;
+        *(void **)block = slab->free;
+        slab->free = block;
+    }
+    list_add_head(&sbh_free_slabs[class], &slab->entry);
+    list_add_tail(&sbh_all_slabs, &slab->slabs);
+    sbh_set_slab_map(slab, TRUE);
+    TRACE("new slab %p for size %lu\n", slab, size);
+    return slab;
+}
 
-        temp = HeapAlloc(sb_heap, flags, size+sizeof(void*)+SB_HEAP_ALIGN);
-        if(!temp) return NULL;
+/* return a block to its slab, heap lock must be held */
+static void sbh_release_block(void *ptr)
+{
+    struct sbh_slab *slab = sbh_get_slab(ptr);
+
+    *(void **)ptr = slab->free;
+    if (!slab->free) list_add_head(&sbh_free_slabs[slab->class], &slab->entry);
+    slab->free = ptr;
 
-        memblock = ALIGN_PTR(temp, SB_HEAP_ALIGN, 0);
-        saved = SAVED_PTR(memblock);
-        *saved = temp;
-        return memblock;
+    /* release empty slabs, as long as there are others for the same class */
+    if (!--slab->used && list_count(&sbh_free_slabs[slab->class]) > 1)
+    {
+        list_remove(&slab->entry);
+        list_remove(&slab->slabs);
+        sbh_set_slab_map(slab, FALSE);
+        VirtualFree(slab, 0, MEM_RELEASE);
     }
+}
 
-    return HeapAlloc(heap, flags, size);
+/* fill half of an empty magazine with blocks from the slabs */
+static BOOL sbh_refill(struct sbh_magazine *magazine, unsigned int class)
+{
+    struct sbh_slab *slab;
+    struct list *ptr;
+
+    LOCK_HEAP;
+    while (magazine->count < SBH_MAGAZINE_SIZE / 2)
+    {
+        if ((ptr = list_head(&sbh_free_slabs[class])))
+            slab = LIST_ENTRY(ptr, struct sbh_slab, entry);
+        else if (!(slab = sbh_create_slab(class)))
+            break;
+
+        while (slab->free && magazine->count < SBH_MAGAZINE_SIZE / 2)
+        {
+            magazine->blocks[magazine->count++] = slab->free;
+            slab->free = *(void **)slab->free;
+            slab->used++;
+        }
+        if (!slab->free) list_remove(&slab->entry);
+    }
+    UNLOCK_HEAP;
+    return magazine->count != 0;
 }
 
-static void* msvcrt_heap_realloc(DWORD flags, void *ptr, MSVCRT_size_t size)
+/* return the oldest blocks of a magazine to the slabs */
+static void sbh_flush(struct sbh_magazine *magazine, unsigned int count)
 {
-    if(sb_heap && ptr && !HeapValidate(heap, 0, ptr))
+    unsigned int i;
+
+    LOCK_HEAP;
+    for (i = 0; i < count; i++) sbh_release_block(magazine->blocks[i]);
+    UNLOCK_HEAP;
+    memmove(magazine->blocks, magazine->blocks + count, (magazine->count - count) * sizeof(void *));
+    magazine->count -= count;
+}
+
+static void *sbh_alloc(DWORD flags, MSVCRT_size_t size)
+{
+    unsigned int class = size ? (size - 1) / SBH_BLOCK_ALIGN : 0;
+    struct sbh_magazine *magazine;
+    void *ret;
+
+    if (!(magazine = sbh_get_magazine(class, TRUE))) return NULL;
+    if (!magazine->count && !sbh_refill(magazine, class)) return NULL;
+
+    ret = magazine->blocks[--magazine->count];
+    if (flags & HEAP_ZERO_MEMORY) memset(ret, 0, sbh_block_size(class));
+    return ret;
+}
+
+static void sbh_free(void *ptr)
+{
+    struct sbh_slab *slab = sbh_get_slab(ptr);
+    struct sbh_magazine *magazine;
+
+    if (!(magazine = sbh_get_magazine(slab->class, FALSE)))
     {
-        /* TODO: move data to normal heap if it exceeds sbh_threshold limit */
-        void *memblock, *temp, **saved;
-        MSVCRT_size_t old_padding, new_padding, old_size;
-
-        saved = SAVED_PTR(ptr);
-        old_padding = (char*)ptr - (char*)*saved;
-        old_size = HeapSize(sb_heap, 0, *saved);
-        if(old_size == -1)
-            return NULL;
-        old_size -= old_padding;
+        LOCK_HEAP;
+        sbh_release_block(ptr);
+        UNLOCK_HEAP;
+        return;
+    }
+    if (magazine->count == SBH_MAGAZINE_SIZE) sbh_flush(magazine, SBH_MAGAZINE_SIZE / 2);
+    magazine->blocks[magazine->count++] = ptr;
+}
 
-        temp = HeapReAlloc(sb_heap, flags, *saved, size+sizeof(void*)+SB_HEAP_ALIGN);
-        if(!temp) return NULL;
+/* release the small blocks cached by a thread */
+void msvcrt_free_sbh_cache(thread_data_t *data)
+{
+    struct sbh_cache *cache = data->sbh_cache;
+    unsigned int i;
 
-        memblock = ALIGN_PTR(temp, SB_HEAP_ALIGN, 0);
-        saved = SAVED_PTR(memblock);
-        new_padding = (char*)memblock - (char*)temp;
+    if (!cache) return;
 
-        if(new_padding != old_padding)
-            memmove(memblock, (char*)temp+old_padding, old_size>size ? size : old_size);
+    data->sbh_cache = NULL;
+    for (i = 0; i < SBH_NB_CLASSES; i++)
+        if (cache->magazines[i].count) sbh_flush(&cache->magazines[i], cache->magazines[i].count);
+    HeapFree(GetProcessHeap(), 0, cache);
+}
 
-        *saved = temp;
-        return memblock;
+static void* msvcrt_heap_alloc(DWORD flags, MSVCRT_size_t size)
+{
+    void *ret;
+
+    if(size < MSVCRT_sbh_threshold && (ret = sbh_alloc(flags, size)))
+        return ret;
+
+    return HeapAlloc(heap, flags, size);
+}
+
+static void* msvcrt_heap_realloc(DWORD flags, void *ptr, MSVCRT_size_t size)
+{
+    if(sbh_is_block(ptr))
+    {
+        MSVCRT_size_t old_size = sbh_block_size(sbh_get_slab(ptr)->class);
+        void *ret;
+
+        if(size <= old_size)
+            return ptr;
+        if(flags & HEAP_REALLOC_IN_PLACE_ONLY)
+            return NULL;
+
+        /* the new block goes to the normal heap if it exceeds the threshold */
+        if(!(ret = msvcrt_heap_alloc(flags, size)))
+            return NULL;
+        memcpy(ret, ptr, old_size);
+        sbh_free(ptr);
+        return ret;
     }
 
     return HeapReAlloc(heap, flags, ptr, size);
@@ -105,10 +316,10 @@ static void* msvcrt_heap_realloc(DWORD flags, void *ptr, MSVCRT_size_t size)
 
 static BOOL msvcrt_heap_free(void *ptr)
 {
-    if(sb_heap && ptr && !HeapValidate(heap, 0, ptr))
+    if(sbh_is_block(ptr))
     {
-        void **saved = SAVED_PTR(ptr);
-        return HeapFree(sb_heap, 0, *saved);
+        sbh_free(ptr);
+        return TRUE;
     }
 
     return HeapFree(heap, 0, ptr);
@@ -116,11 +327,8 @@ static BOOL msvcrt_heap_free(void *ptr)
 
 static MSVCRT_size_t msvcrt_heap_size(void *ptr)
 {
-    if(sb_heap && ptr && !HeapValidate(heap, 0, ptr))
-    {
-        void **saved = SAVED_PTR(ptr);
-        return HeapSize(sb_heap, 0, *saved);
-    }
+    if(sbh_is_block(ptr))
+        return sbh_block_size(sbh_get_slab(ptr)->class);
 
     return HeapSize(heap, 0, ptr);
 }
@@ -243,8 +451,7 @@ void* CDECL _expand(void* mem, MSVCRT_size_t size)
  */
 int CDECL _heapchk(void)
 {
-  if (!HeapValidate(heap, 0, NULL) ||
-          (sb_heap && !HeapValidate(sb_heap, 0, NULL)))
+  if (!HeapValidate(heap, 0, NULL))
   {
     msvcrt_set_errno(GetLastError());
     return MSVCRT__HEAPBADNODE;
@@ -257,8 +464,7 @@ int CDECL _heapchk(void)
  */
 int CDECL _heapmin(void)
 {
-  if (!HeapCompact( heap, 0 ) ||
-          (sb_heap && !HeapCompact( sb_heap, 0 )))
+  if (!HeapCompact( heap, 0 ))
   {
     if (GetLastError() != ERROR_CALL_NOT_IMPLEMENTED)
       msvcrt_set_errno(GetLastError());
@@ -274,8 +480,8 @@ int CDECL _heapwalk(struct MSVCRT__heapinfo* next)
 {
   PROCESS_HEAP_ENTRY phe;
 
-  if (sb_heap)
-      FIXME("small blocks heap not supported\n");
+  if (MSVCRT_sbh_threshold)
+      FIXME("small blocks heap blocks are not enumerated\n");
 
   LOCK_HEAP;
   phe.lpData = next->_pentry;
@@ -528,13 +734,6 @@ int CDECL _set_sbh_threshold(MSVCRT_size_t threshold)
   if(threshold > 1016)
      return 0;
 
-  if(!sb_heap)
-  {
-      sb_heap = HeapCreate(0, 0, 0);
-      if(!sb_heap)
-          return 0;
-  }
-
   MSVCRT_sbh_threshold = (threshold+0xf) & ~0xf;
   return 1;
 #endif
@@ -867,13 +1066,22 @@ int CDECL MSVCRT_strncpy_s(char *dest, MSVCRT_size_t numberOfElements,
 
 BOOL msvcrt_init_heap(void)
 {
+    unsigned int i;
+
+    for (i = 0; i < SBH_NB_CLASSES; i++) list_init(&sbh_free_slabs[i]);
     heap = HeapCreate(0, 0, 0);
     return heap != NULL;
 }
 
 void msvcrt_destroy_heap(void)
 {
+    struct sbh_slab *slab, *next;
+
     HeapDestroy(heap);
-    if(sb_heap)
-        HeapDestroy(sb_heap);
+    LIST_FOR_EACH_ENTRY_SAFE(slab, next, &sbh_all_slabs, struct sbh_slab, slabs)
+    {
+        sbh_set_slab_map(slab, FALSE);
+        VirtualFree(slab, 0, MEM_RELEASE);
+    }
+    list_init(&sbh_all_slabs);
 }
@@ -58,6 +58,7 @@ static inline BOOL msvcrt_free_tls(void)
     ERR("TlsFree() failed!\n");
     return FALSE;
   }
+  msvcrt_tls_index = TLS_OUT_OF_INDEXES;
   return TRUE;
 }
 
@@ -79,6 +80,8 @@ static inline void msvcrt_free_tls_mem(void)
         free_locinfo(tls->locinfo);
         free_mbcinfo(tls->mbcinfo);
     }
+    msvcrt_free_sbh_cache(tls);
+    TlsSetValue(msvcrt_tls_index, NULL);
   }
   HeapFree(GetProcessHeap(), 0, tls);
 }
@@ -413,6 +413,51 @@ static void test_aligned(void)
     test_aligned_offset_realloc(256, 128, 64, 112);
 }
 
+static void test_sbheap_classes(void)
+{
+    static const unsigned int sizes[] = {1, 15, 16, 17, 100, 511, 512, 1000, 1008, 1009, 1016, 1023, 1024, 2000};
+    unsigned char *mem[ARRAY_SIZE(sizes)];
+    unsigned int i, j, size;
+
+    /* allocate and fill blocks in every size class up to the maximal threshold */
+    for (size = 1; size < 1024; size++)
+    {
+        unsigned char *block = malloc(size);
+
+        ok(block != NULL, "malloc(%u) failed\n", size);
+        ok(!((UINT_PTR)block & 0xf), "incorrect alignment (%p)\n", block);
+        ok(_msize(block) >= size, "_msize(%u) = %u\n", size, (unsigned int)_msize(block));
+        memset(block, size & 0xff, size);
+        for (j = 0; j < size; j++)
+            if (block[j] != (size & 0xff)) break;
+        ok(j == size, "%u: block corrupted at %u\n", size, j);
+        free(block);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        mem[i] = malloc(sizes[i]);
+        ok(mem[i] != NULL, "malloc(%u) failed\n", sizes[i]);
+        memset(mem[i], i + 1, sizes[i]);
+    }
+
+    /* grow and shrink each block across the threshold and size classes */
+    for (i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        unsigned int new_size = sizes[ARRAY_SIZE(sizes) - 1 - i];
+        unsigned int keep = sizes[i] < new_size ? sizes[i] : new_size;
+
+        mem[i] = realloc(mem[i], new_size);
+        ok(mem[i] != NULL, "realloc(%u, %u) failed\n", sizes[i], new_size);
+        for (j = 0; j < keep; j++)
+            if (mem[i][j] != i + 1) break;
+        ok(j == keep, "realloc(%u, %u) corrupted data at %u\n", sizes[i], new_size, j);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++)
+        free(mem[i]);
+}
+
 static void test_sbheap(void)
 {
     void *mem;
@@ -439,6 +484,16 @@ static void test_sbheap(void)
     threshold = _get_sbh_threshold();
     ok(threshold == 1008, "threshold = %d\n", threshold);
 
+    ok(!_set_sbh_threshold(1017), "_set_sbh_threshold succeeded\n");
+    threshold = _get_sbh_threshold();
+    ok(threshold == 1008, "threshold = %d\n", threshold);
+
+    ok(_set_sbh_threshold(1016), "_set_sbh_threshold failed\n");
+    threshold = _get_sbh_threshold();
+    ok(threshold == 1024, "threshold = %d\n", threshold);
+
+    test_sbheap_classes();
+
     free(mem);
 
     mem = malloc(1);
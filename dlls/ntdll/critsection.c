@@ -40,15 +40,6 @@
 WINE_DEFAULT_DEBUG_CHANNEL(ntdll);
 WINE_DECLARE_DEBUG_CHANNEL(relay);
 
-static inline void small_pause(void)
-{
-#ifdef __i386__
-    __asm__ __volatile__( "rep;nop" : : : "memory" );
-#else
-    __asm__ __volatile__( "" : : : "memory" );
-#endif
-}
-
 static void *no_debug_info_marker = (void *)(ULONG_PTR)-1;
 
 static BOOL crit_section_has_debuginfo(const RTL_CRITICAL_SECTION *crit)
@@ -56,6 +47,65 @@ static BOOL crit_section_has_debuginfo(const RTL_CRITICAL_SECTION *crit)
     return crit->DebugInfo != NULL && crit->DebugInfo != no_debug_info_marker;
 }
 
+/* Recent number of spins needed to acquire the sections, indexed by a hash of
+ * their address. The spin count of a section is only used as an upper bound. */
+static LONG spin_estimates[64];
+
+static inline LONG *get_spin_estimate( const RTL_CRITICAL_SECTION *crit )
+{
+    return &spin_estimates[((ULONG_PTR)crit >> 4) % ARRAY_SIZE(spin_estimates)];
+}
+
+/* Contention statistics of the sections that have been contended, in an open
+ * addressing table indexed by a hash of their address. */
+#define LOCK_STATS_SIZE 256
+
+static struct lock_stats
+{
+    RTL_CRITICAL_SECTION *crit;
+    ULONG                 contentions;  /* number of acquisitions that found the section busy */
+    ULONG                 waits;        /* number of acquisitions that had to block */
+} lock_stats[LOCK_STATS_SIZE];
+
+#define DELETED_LOCK_STATS ((RTL_CRITICAL_SECTION *)1)
+
+static struct lock_stats *get_lock_stats( RTL_CRITICAL_SECTION *crit, BOOL create )
+{
+    unsigned int i, pos = ((ULONG_PTR)crit >> 4) % LOCK_STATS_SIZE;
+    RTL_CRITICAL_SECTION *cur;
+    int free = -1;
+
+    for (i = 0; i < LOCK_STATS_SIZE; i++, pos = (pos + 1) % LOCK_STATS_SIZE)
+    {
+        if ((cur = lock_stats[pos].crit) == crit) return &lock_stats[pos];
+        if (cur == DELETED_LOCK_STATS && free == -1) free = pos;
+        if (!cur) break;
+    }
+    if (!create) return NULL;
+    if (free == -1)
+    {
+        if (i == LOCK_STATS_SIZE) return NULL;  /* table is full */
+        free = pos;
+    }
+    cur = lock_stats[free].crit;
+    if ((cur && cur != DELETED_LOCK_STATS) ||
+        interlocked_cmpxchg_ptr( (void **)&lock_stats[free].crit, crit, cur ) != cur)
+        return get_lock_stats( crit, FALSE );  /* the slot has been taken meanwhile */
+    lock_stats[free].contentions = 0;
+    lock_stats[free].waits = 0;
+    return &lock_stats[free];
+}
+
+/* record a contended acquisition; must be called with the section held */
+static void record_lock_contention( RTL_CRITICAL_SECTION *crit, BOOL waited )
+{
+    struct lock_stats *stats = get_lock_stats( crit, TRUE );
+
+    if (!stats) return;
+    stats->contentions++;
+    if (waited) stats->waits++;
+}
+
 #ifdef __linux__
 
 static int wait_op = 128; /*FUTEX_WAIT|FUTEX_PRIVATE_FLAG*/
@@ -388,6 +438,9 @@ ULONG WINAPI RtlSetCriticalSectionSpinCount( RTL_CRITICAL_SECTION *crit, ULONG s
  */
 NTSTATUS WINAPI RtlDeleteCriticalSection( RTL_CRITICAL_SECTION *crit )
 {
+    struct lock_stats *stats;
+
+    if ((stats = get_lock_stats( crit, FALSE ))) stats->crit = DELETED_LOCK_STATS;
     crit->LockCount      = -1;
     crit->RecursionCount = 0;
     crit->OwningThread   = 0;
@@ -481,6 +534,7 @@ NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
         RtlRaiseException( &rec );
     }
     if (crit_section_has_debuginfo( crit )) crit->DebugInfo->ContentionCount++;
+    record_lock_contention( crit, TRUE );
     return STATUS_SUCCESS;
 }
 
@@ -544,18 +598,28 @@ NTSTATUS WINAPI RtlEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
 {
     if (crit->SpinCount)
     {
-        ULONG count;
+        LONG *estimate = get_spin_estimate( crit );
+        ULONG count, limit;
 
         if (RtlTryEnterCriticalSection( crit )) return STATUS_SUCCESS;
-        for (count = crit->SpinCount; count > 0; count--)
+
+        /* spin for up to twice as long as recently needed, within the spin count */
+        limit = min( crit->SpinCount, (ULONG)*estimate * 2 + 16 );
+        for (count = 0; count < limit; count++)
         {
             if (crit->LockCount > 0) break;  /* more than one waiter, don't bother spinning */
             if (crit->LockCount == -1)       /* try again */
             {
-                if (interlocked_cmpxchg( &crit->LockCount, 0, -1 ) == -1) goto done;
+                if (interlocked_cmpxchg( &crit->LockCount, 0, -1 ) == -1)
+                {
+                    *estimate += ((LONG)count - *estimate) / 8;
+                    record_lock_contention( crit, FALSE );
+                    goto done;
+                }
             }
             small_pause();
         }
+        *estimate += ((LONG)count - *estimate) / 8;
     }
 
     if (interlocked_inc( &crit->LockCount ))
@@ -685,3 +749,53 @@ NTSTATUS WINAPI RtlLeaveCriticalSection( RTL_CRITICAL_SECTION *crit )
     }
     return STATUS_SUCCESS;
 }
+
+
+/***********************************************************************
+ *           RtlQueryProcessLockInformation   (NTDLL.@)
+ *
+ * Retrieves the contention statistics of the critical sections of the process.
+ *
+ * PARAMS
+ *  buffer [I/O] Debug buffer receiving the lock information.
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS. buffer->LockInformation points to a DEBUG_LOCKS
+ *           structure, which is freed by RtlDestroyQueryDebugBuffer().
+ *  Failure: STATUS_NO_MEMORY.
+ *
+ * NOTES
+ *  Only the sections that have been contended are reported. ContentionCount
+ *  counts the acquisitions that found the section busy, EntryCount the ones
+ *  that had to block after spinning.
+ */
+NTSTATUS WINAPI RtlQueryProcessLockInformation( DEBUG_BUFFER *buffer )
+{
+    DEBUG_LOCKS *locks;
+    RTL_CRITICAL_SECTION *crit;
+    ULONG i, count = 0;
+
+    for (i = 0; i < LOCK_STATS_SIZE; i++)
+        if (lock_stats[i].crit && lock_stats[i].crit != DELETED_LOCK_STATS) count++;
+
+    if (!(locks = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                   offsetof( DEBUG_LOCKS, Locks[count] ) )))
+        return STATUS_NO_MEMORY;
+
+    for (i = 0; i < LOCK_STATS_SIZE && locks->NumberOfLocks < count; i++)
+    {
+        DEBUG_LOCK_INFORMATION *info = &locks->Locks[locks->NumberOfLocks];
+
+        crit = lock_stats[i].crit;
+        if (!crit || crit == DELETED_LOCK_STATS) continue;
+        info->Address         = crit;
+        info->Type            = 0;  /* critical section */
+        info->ContentionCount = lock_stats[i].contentions;
+        info->EntryCount      = lock_stats[i].waits;
+        locks->NumberOfLocks++;
+    }
+
+    RtlFreeHeap( GetProcessHeap(), 0, buffer->LockInformation );
+    buffer->LockInformation = locks;
+    return STATUS_SUCCESS;
+}
@@ -56,12 +56,10 @@ static void dump_DEBUG_LOCK_INFORMATION(const DEBUG_LOCK_INFORMATION *iBuf)
 {
   TRACE( "LOCK_INFORMATION:%p\n", iBuf );
 
-  if (NULL == iBuf) return ;
-
   TRACE( "Address:%p\n", iBuf->Address );
   TRACE( "Type:%d\n", iBuf->Type );
   TRACE( "CreatorBackTraceIndex:%d\n", iBuf->CreatorBackTraceIndex );
-  TRACE( "OwnerThreadId:%d\n", iBuf->OwnerThreadId );
+  TRACE( "OwnerThreadId:%lx\n", iBuf->OwnerThreadId );
   TRACE( "ActiveCount:%d\n", iBuf->ActiveCount );
   TRACE( "ContentionCount:%d\n", iBuf->ContentionCount );
   TRACE( "EntryCount:%d\n", iBuf->EntryCount );
@@ -70,23 +68,33 @@ static void dump_DEBUG_LOCK_INFORMATION(const DEBUG_LOCK_INFORMATION *iBuf)
   TRACE( "NumberOfExclusiveWaiters:%d\n", iBuf->NumberOfExclusiveWaiters );
 }
 
+static void dump_DEBUG_LOCKS(const DEBUG_LOCKS *iBuf)
+{
+  ULONG i;
+
+  TRACE( "LOCKS:%p\n", iBuf );
+  if (NULL == iBuf) return ;
+  TRACE( "NumberOfLocks:%d\n", iBuf->NumberOfLocks );
+  for (i = 0; i < iBuf->NumberOfLocks; i++) dump_DEBUG_LOCK_INFORMATION(&iBuf->Locks[i]);
+}
+
 static void dump_DEBUG_BUFFER(const DEBUG_BUFFER *iBuf)
 {
   if (NULL == iBuf) return ;
   TRACE( "SectionHandle:%p\n", iBuf->SectionHandle);
   TRACE( "SectionBase:%p\n", iBuf->SectionBase);
   TRACE( "RemoteSectionBase:%p\n", iBuf->RemoteSectionBase);
-  TRACE( "SectionBaseDelta:%d\n", iBuf->SectionBaseDelta);
+  TRACE( "SectionBaseDelta:%lx\n", iBuf->SectionBaseDelta);
   TRACE( "EventPairHandle:%p\n", iBuf->EventPairHandle);
   TRACE( "RemoteThreadHandle:%p\n", iBuf->RemoteThreadHandle);
   TRACE( "InfoClassMask:%x\n", iBuf->InfoClassMask);
-  TRACE( "SizeOfInfo:%d\n", iBuf->SizeOfInfo);
-  TRACE( "AllocatedSize:%d\n", iBuf->AllocatedSize);
-  TRACE( "SectionSize:%d\n", iBuf->SectionSize);
+  TRACE( "SizeOfInfo:%lu\n", iBuf->SizeOfInfo);
+  TRACE( "AllocatedSize:%lu\n", iBuf->AllocatedSize);
+  TRACE( "SectionSize:%lu\n", iBuf->SectionSize);
   TRACE( "BackTraceInfo:%p\n", iBuf->BackTraceInformation);
   dump_DEBUG_MODULE_INFORMATION(iBuf->ModuleInformation);
   dump_DEBUG_HEAP_INFORMATION(iBuf->HeapInformation);
-  dump_DEBUG_LOCK_INFORMATION(iBuf->LockInformation);
+  dump_DEBUG_LOCKS(iBuf->LockInformation);
 }
 
 PDEBUG_BUFFER WINAPI RtlCreateQueryDebugBuffer(IN ULONG iSize, IN BOOLEAN iEventPair) 
@@ -136,9 +144,7 @@ NTSTATUS WINAPI RtlQueryProcessDebugInformation(IN ULONG iProcessId, IN ULONG iD
      iBuf->HeapInformation = info;
    }
    if (iDebugInfoMask & PDI_LOCKS) {
-     PDEBUG_LOCK_INFORMATION info = RtlAllocateHeap(GetProcessHeap(), 0, sizeof(DEBUG_LOCK_INFORMATION));
-     memset(info, 0, sizeof(DEBUG_LOCK_INFORMATION));
-     iBuf->LockInformation = info;
+     nts = RtlQueryProcessLockInformation(iBuf);
    }
    TRACE("returns:%p\n", iBuf);
    dump_DEBUG_BUFFER(iBuf);
@@ -111,6 +111,7 @@
 #include "wine/exception.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(file);
+WINE_DECLARE_DEBUG_CHANNEL(namecache);
 
 /* just in case... */
 #undef VFAT_IOCTL_READDIR_BOTH
@@ -189,7 +190,7 @@ struct dir_data_buffer
 struct dir_data_names
 {
     const WCHAR *long_name;          /* long file name in Unicode */
-    const WCHAR *short_name;         /* short file name in Unicode */
+    const WCHAR *short_name;         /* short file name in Unicode, NULL if not generated yet */
     const char  *unix_name;          /* Unix file name in host encoding */
 };
 
@@ -201,11 +202,14 @@ struct dir_data
     struct file_identity    id;      /* directory file identity */
     struct dir_data_names  *names;   /* directory file names */
     struct dir_data_buffer *buffer;  /* head of data buffers list */
+    DIR                    *dir;     /* directory stream for the next batch, NULL once complete */
+    BOOL                    stream;  /* entries are returned batch by batch, unsorted */
 };
 
 static const unsigned int dir_data_buffer_initial_size = 4096;
 static const unsigned int dir_data_cache_initial_size  = 256;
 static const unsigned int dir_data_names_initial_size  = 64;
+static const unsigned int dir_data_batch_size          = 4096;
 
 static struct dir_data **dir_data_cache;
 static unsigned int dir_data_cache_size;
@@ -226,6 +230,35 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
 };
 RTL_CRITICAL_SECTION dir_section = { &critsect_debug, -1, 0, 0, 0, 0 };
 
+/* cache of case-insensitive name lookups, keyed by directory identity and
+ * name, and valid as long as the directory modification time doesn't change */
+
+#define NAME_CACHE_ENTRIES   512   /* number of cache entries, must be a power of 2 */
+#define NAME_CACHE_NAME_LEN  64    /* max. length of a cached name in chars */
+#define NAME_CACHE_UNIX_LEN  128   /* max. size of a cached unix name */
+#define NAME_CACHE_MIN_AGE   2     /* min. age in seconds of the directory mtime */
+
+struct name_cache_entry
+{
+    struct file_identity dir;                            /* identity of the directory, ino 0 if unused */
+    ULONGLONG            mtime;                          /* directory modification time in ns */
+    USHORT               name_len;                       /* length of the name in chars */
+    WCHAR                name[NAME_CACHE_NAME_LEN];      /* name that was looked up */
+    char                 unix_name[NAME_CACHE_UNIX_LEN]; /* unix name found, empty if not found */
+};
+
+static struct name_cache_entry *name_cache;
+static unsigned int name_cache_hits, name_cache_misses, name_cache_stale;
+
+static RTL_CRITICAL_SECTION name_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG name_cache_section_debug =
+{
+    0, 0, &name_cache_section,
+    { &name_cache_section_debug.ProcessLocksList, &name_cache_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": name_cache_section") }
+};
+static RTL_CRITICAL_SECTION name_cache_section = { &name_cache_section_debug, -1, 0, 0, 0, 0 };
+
 
 /* check if a given Unicode char is OK in a DOS short name */
 static inline BOOL is_invalid_dos_char( WCHAR ch )
@@ -311,6 +344,11 @@ static inline BOOL has_wildcard( const UNICODE_STRING *mask )
     return FALSE;
 }
 
+static inline BOOL is_match_all_mask( const UNICODE_STRING *mask )
+{
+    return !mask || (mask->Length == sizeof(WCHAR) && mask->Buffer[0] == '*');
+}
+
 /* get space from the current directory data buffer, allocating a new one if necessary */
 static void *get_dir_data_space( struct dir_data *data, unsigned int size )
 {
@@ -368,7 +406,8 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
         data->names = names;
     }
 
-    if (short_name[0])
+    if (!short_name) names[data->count].short_name = NULL;
+    else if (short_name[0])
     {
         if (!(names[data->count].short_name = add_dir_data_nameW( data, short_name ))) return FALSE;
     }
@@ -380,18 +419,27 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
     return TRUE;
 }
 
-/* free the complete directory data structure */
-static void free_dir_data( struct dir_data *data )
+/* free the names of the directory data, keeping the names array */
+static void clear_dir_data_names( struct dir_data *data )
 {
     struct dir_data_buffer *buffer, *next;
 
-    if (!data) return;
-
     for (buffer = data->buffer; buffer; buffer = next)
     {
         next = buffer->next;
         RtlFreeHeap( GetProcessHeap(), 0, buffer );
     }
+    data->buffer = NULL;
+    data->count = data->pos = 0;
+}
+
+/* free the complete directory data structure */
+static void free_dir_data( struct dir_data *data )
+{
+    if (!data) return;
+
+    clear_dir_data_names( data );
+    if (data->dir) closedir( data->dir );
     RtlFreeHeap( GetProcessHeap(), 0, data->names );
     RtlFreeHeap( GetProcessHeap(), 0, data );
 }
@@ -1438,6 +1486,25 @@ static BOOLEAN match_filename( const UNICODE_STRING *name_str, const UNICODE_STR
 }
 
 
+/***********************************************************************
+ *           generate_short_name
+ *
+ * Generate the short name of a file if its long name is not a valid 8.3 name.
+ * The buffer must have room for 13 characters.
+ */
+static int generate_short_name( const UNICODE_STRING *long_name, WCHAR *short_name )
+{
+    BOOLEAN spaces;
+    int len = 0;
+
+    if (!RtlIsNameLegalDOS8Dot3( long_name, NULL, &spaces ) || spaces)
+        len = hash_short_file_name( long_name, short_name );
+    short_name[len] = 0;
+    wcsupr( short_name );
+    return len;
+}
+
+
 /***********************************************************************
  *           append_entry
  *
@@ -1463,17 +1530,19 @@ static BOOL append_entry( struct dir_data *data, const char *long_name,
     {
         short_len = ntdll_umbstowcs( short_name, strlen(short_name),
                                      short_nameW, ARRAY_SIZE( short_nameW ) - 1 );
+        short_nameW[short_len] = 0;
+        wcsupr( short_nameW );
     }
-    else  /* generate a short name if necessary */
+    else if (mask && !match_filename( &str, mask ))
     {
-        BOOLEAN spaces;
-
-        short_len = 0;
-        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
-            short_len = hash_short_file_name( &str, short_nameW );
+        /* the short name is needed to match the mask, otherwise it's generated on demand */
+        short_len = generate_short_name( &str, short_nameW );
+    }
+    else
+    {
+        TRACE( "long %s mask %s\n", debugstr_w( long_nameW ), debugstr_us( mask ));
+        return add_dir_data_names( data, long_nameW, NULL, long_name );
     }
-    short_nameW[short_len] = 0;
-    wcsupr( short_nameW );
 
     TRACE( "long %s short %s mask %s\n",
            debugstr_w( long_nameW ), debugstr_w( short_nameW ), debugstr_us( mask ));
@@ -1504,6 +1573,8 @@ static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, I
     union file_directory_info *info;
     struct stat st;
     ULONG name_len, start, dir_size, attributes;
+    const WCHAR *short_name = names->short_name;
+    WCHAR short_nameW[13];
 
     if (get_file_info( names->unix_name, &st, &attributes ) == -1)
     {
@@ -1535,6 +1606,15 @@ static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, I
         fill_file_info( &st, attributes, info, class );
     }
 
+    if (!short_name && (class == FileBothDirectoryInformation || class == FileIdBothDirectoryInformation))
+    {
+        UNICODE_STRING str;
+
+        RtlInitUnicodeString( &str, names->long_name );
+        generate_short_name( &str, short_nameW );
+        short_name = short_nameW;
+    }
+
     switch (class)
     {
     case FileDirectoryInformation:
@@ -1553,15 +1633,15 @@ static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, I
 
     case FileBothDirectoryInformation:
         info->both.EaSize = 0; /* FIXME */
-        info->both.ShortNameLength = wcslen( names->short_name ) * sizeof(WCHAR);
-        memcpy( info->both.ShortName, names->short_name, info->both.ShortNameLength );
+        info->both.ShortNameLength = wcslen( short_name ) * sizeof(WCHAR);
+        memcpy( info->both.ShortName, short_name, info->both.ShortNameLength );
         info->both.FileNameLength = name_len;
         break;
 
     case FileIdBothDirectoryInformation:
         info->id_both.EaSize = 0; /* FIXME */
-        info->id_both.ShortNameLength = wcslen( names->short_name ) * sizeof(WCHAR);
-        memcpy( info->id_both.ShortName, names->short_name, info->id_both.ShortNameLength );
+        info->id_both.ShortNameLength = wcslen( short_name ) * sizeof(WCHAR);
+        memcpy( info->id_both.ShortName, short_name, info->id_both.ShortNameLength );
         info->id_both.FileNameLength = name_len;
         break;
 
@@ -1745,34 +1825,83 @@ static NTSTATUS read_directory_data_stat( struct dir_data *data, const char *uni
 }
 
 
+/***********************************************************************
+ *           read_directory_readdir_batch
+ *
+ * Read directory entries from a directory stream. In streaming mode, reading
+ * stops after a batch of entries and the stream is kept in the directory data,
+ * otherwise the stream is read until the end and closed.
+ */
+static NTSTATUS read_directory_data_readdir_batch( struct dir_data *data, DIR *dir,
+                                                   const UNICODE_STRING *mask )
+{
+    struct dirent *de;
+    unsigned int count = 0;
+
+    data->dir = NULL;
+    while ((de = readdir( dir )))
+    {
+        if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
+        if (!append_entry( data, de->d_name, NULL, mask ))
+        {
+            closedir( dir );
+            return STATUS_NO_MEMORY;
+        }
+        if (data->stream && ++count >= dir_data_batch_size)
+        {
+            data->dir = dir;
+            return STATUS_SUCCESS;
+        }
+    }
+    closedir( dir );
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           read_directory_readdir
  *
  * Read a directory using the POSIX readdir interface; helper for NtQueryDirectoryFile.
+ * Listings without a mask are streamed, since they don't need to be read
+ * completely before returning the first entries.
  */
 static NTSTATUS read_directory_data_readdir( struct dir_data *data, const UNICODE_STRING *mask )
 {
-    struct dirent *de;
-    NTSTATUS status = STATUS_NO_MEMORY;
+    NTSTATUS status;
     DIR *dir = opendir( "." );
 
     if (!dir) return STATUS_NO_SUCH_FILE;
 
-    if (!append_entry( data, ".", NULL, mask )) goto done;
-    if (!append_entry( data, "..", NULL, mask )) goto done;
-    while ((de = readdir( dir )))
+    if (!append_entry( data, ".", NULL, mask ) || !append_entry( data, "..", NULL, mask ))
     {
-        if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
-        if (!append_entry( data, de->d_name, NULL, mask )) goto done;
+        closedir( dir );
+        return STATUS_NO_MEMORY;
     }
-    status = STATUS_SUCCESS;
-
-done:
-    closedir( dir );
+    data->stream = is_match_all_mask( mask );
+    status = read_directory_data_readdir_batch( data, dir, mask );
+    if (!data->dir) data->stream = FALSE;  /* small enough to be read at once */
     return status;
 }
 
 
+/***********************************************************************
+ *           read_next_dir_data_batch
+ *
+ * Replace the directory data by the next batch of a streamed directory.
+ * Returns FALSE when there are no more entries.
+ */
+static BOOL read_next_dir_data_batch( struct dir_data *data )
+{
+    while (data->dir)
+    {
+        clear_dir_data_names( data );
+        if (read_directory_data_readdir_batch( data, data->dir, NULL )) return FALSE;
+        if (data->count) return TRUE;
+    }
+    return FALSE;
+}
+
+
 /***********************************************************************
  *           read_directory_data
  *
@@ -1839,19 +1968,21 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
         return status;
     }
 
-    /* sort filenames, but not "." and ".." */
+    /* sort filenames, but not "." and "..", unless the directory is too large
+     * to be read at once */
     i = 0;
     if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
     if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
-    if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
+    if (i < data->count && !data->dir)
+        qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
 
     if (data->count)
     {
-        /* release unused space */
-        if (data->buffer)
+        /* release unused space, unless more batches are still to be read into it */
+        if (data->buffer && !data->dir)
             RtlReAllocateHeap( GetProcessHeap(), HEAP_REALLOC_IN_PLACE_ONLY, data->buffer,
                                offsetof( struct dir_data_buffer, data[data->buffer->pos] ));
-        if (data->count < data->size)
+        if (data->count < data->size && !data->dir)
             RtlReAllocateHeap( GetProcessHeap(), HEAP_REALLOC_IN_PLACE_ONLY, data->names,
                                data->count * sizeof(*data->names) );
         if (!fstat( fd, &st ))
@@ -1876,7 +2007,7 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
  * Retrieve the cached directory data, or initialize it if necessary.
  */
 static NTSTATUS get_cached_dir_data( HANDLE handle, struct dir_data **data_ret, int fd,
-                                     const UNICODE_STRING *mask )
+                                     const UNICODE_STRING *mask, BOOLEAN restart_scan )
 {
     unsigned int i;
     int entry = -1, free_entries[16];
@@ -1921,6 +2052,13 @@ static NTSTATUS get_cached_dir_data( HANDLE handle, struct dir_data **data_ret,
         dir_data_cache_size = size;
     }
 
+    /* the first batches of a streamed directory are no longer available */
+    if (restart_scan && dir_data_cache[entry] && dir_data_cache[entry]->stream)
+    {
+        free_dir_data( dir_data_cache[entry] );
+        dir_data_cache[entry] = NULL;
+    }
+
     if (!dir_data_cache[entry]) status = init_cached_dir_data( &dir_data_cache[entry], fd, mask );
 
     *data_ret = dir_data_cache[entry];
@@ -1992,13 +2130,13 @@ NTSTATUS WINAPI DECLSPEC_HOTPATCH NtQueryDirectoryFile( HANDLE handle, HANDLE ev
     cwd = open( ".", O_RDONLY );
     if (fchdir( fd ) != -1)
     {
-        if (!(status = get_cached_dir_data( handle, &data, fd, mask )))
+        if (!(status = get_cached_dir_data( handle, &data, fd, mask, restart_scan )))
         {
             union file_directory_info *last_info = NULL;
 
             if (restart_scan) data->pos = 0;
 
-            while (!status && data->pos < data->count)
+            while (!status && (data->pos < data->count || read_next_dir_data_batch( data )))
             {
                 status = get_dir_data_entry( data, buffer, io, length, info_class, &last_info );
                 if (!status || status == STATUS_BUFFER_OVERFLOW) data->pos++;
@@ -2023,6 +2161,102 @@ NTSTATUS WINAPI DECLSPEC_HOTPATCH NtQueryDirectoryFile( HANDLE handle, HANDLE ev
 }
 
 
+/* get the modification time of a directory in nanoseconds */
+static ULONGLONG get_dir_mtime( const struct stat *st )
+{
+    ULONGLONG ret = (ULONGLONG)st->st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    ret += st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    ret += st->st_mtimespec.tv_nsec;
+#endif
+    return ret;
+}
+
+/* return the cache slot of a name */
+static struct name_cache_entry *get_name_cache_entry( const struct stat *st, const WCHAR *name, int length )
+{
+    unsigned int i, hash = (unsigned int)st->st_ino ^ (unsigned int)st->st_dev;
+
+    for (i = 0; i < length; i++)
+        hash = hash * 65599 + RtlUpcaseUnicodeChar( name[i] );
+    return &name_cache[hash & (NAME_CACHE_ENTRIES - 1)];
+}
+
+/***********************************************************************
+ *           name_cache_lookup
+ *
+ * Look up the result of a previous directory scan for a name. st is the
+ * stat of the directory. On a hit, the unix name is copied to unix_name,
+ * or set to an empty string if the file didn't exist.
+ */
+static BOOL name_cache_lookup( const struct stat *st, const WCHAR *name, int length, char *unix_name )
+{
+    struct name_cache_entry *entry;
+    BOOL ret = FALSE;
+
+    if (length > NAME_CACHE_NAME_LEN) return FALSE;
+
+    RtlEnterCriticalSection( &name_cache_section );
+    if (name_cache)
+    {
+        entry = get_name_cache_entry( st, name, length );
+        if (is_same_file( &entry->dir, st ) && entry->name_len == length &&
+            !RtlCompareUnicodeStrings( entry->name, length, name, length, TRUE ))
+        {
+            if (entry->mtime == get_dir_mtime( st ))
+            {
+                strcpy( unix_name, entry->unix_name );
+                ret = TRUE;
+            }
+            else
+            {
+                entry->dir.ino = 0;
+                name_cache_stale++;
+            }
+        }
+    }
+    if (ret) name_cache_hits++;
+    else name_cache_misses++;
+    if (!((name_cache_hits + name_cache_misses) % 1024))
+        TRACE_(namecache)( "%u hits, %u misses, %u stale\n",
+                           name_cache_hits, name_cache_misses, name_cache_stale );
+    RtlLeaveCriticalSection( &name_cache_section );
+    return ret;
+}
+
+/***********************************************************************
+ *           name_cache_insert
+ *
+ * Store the result of a directory scan, unix_name is empty if the name
+ * wasn't found. Directories modified very recently are not cached, since
+ * a further change could happen without changing the mtime.
+ */
+static void name_cache_insert( const struct stat *st, const WCHAR *name, int length, const char *unix_name )
+{
+    struct name_cache_entry *entry;
+
+    if (length > NAME_CACHE_NAME_LEN || strlen( unix_name ) >= NAME_CACHE_UNIX_LEN) return;
+    if (st->st_mtime + NAME_CACHE_MIN_AGE > time( NULL )) return;
+
+    RtlEnterCriticalSection( &name_cache_section );
+    if (!name_cache)
+        name_cache = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                      NAME_CACHE_ENTRIES * sizeof(*name_cache) );
+    if (name_cache)
+    {
+        entry = get_name_cache_entry( st, name, length );
+        entry->dir.dev  = st->st_dev;
+        entry->dir.ino  = st->st_ino;
+        entry->mtime    = get_dir_mtime( st );
+        entry->name_len = length;
+        memcpy( entry->name, name, length * sizeof(WCHAR) );
+        strcpy( entry->unix_name, unix_name );
+    }
+    RtlLeaveCriticalSection( &name_cache_section );
+}
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2038,7 +2272,8 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     BOOLEAN spaces, is_name_8_dot_3;
     DIR *dir;
     struct dirent *de;
-    struct stat st;
+    struct stat st, dir_st;
+    BOOL use_cache = FALSE;
     int ret;
 
     /* try a shortcut for this directory */
@@ -2071,6 +2306,19 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
 
     if (!is_name_8_dot_3 && !get_dir_case_sensitivity( unix_name )) goto not_found;
 
+    /* check if the directory was already searched for this name */
+
+    if (!stat( unix_name, &dir_st ))
+    {
+        use_cache = TRUE;
+        if (name_cache_lookup( &dir_st, name, length, unix_name + pos ))
+        {
+            if (!unix_name[pos]) goto not_found;
+            unix_name[pos - 1] = '/';
+            goto success;
+        }
+    }
+
     /* now look for it through the directory */
 
 #ifdef VFAT_IOCTL_READDIR_BOTH
@@ -2102,7 +2350,7 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
                             strcpy( unix_name + pos, kde[1].d_name );
                             RtlLeaveCriticalSection( &dir_section );
                             close( fd );
-                            goto success;
+                            goto found;
                         }
                     }
                     ret = ntdll_umbstowcs( kde[0].d_name, strlen(kde[0].d_name),
@@ -2113,7 +2361,7 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
                                 kde[1].d_name[0] ? kde[1].d_name : kde[0].d_name );
                         RtlLeaveCriticalSection( &dir_section );
                         close( fd );
-                        goto success;
+                        goto found;
                     }
                     if (ioctl( fd, VFAT_IOCTL_READDIR_BOTH, (long)kde ) == -1)
                     {
@@ -2145,7 +2393,7 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
         {
             strcpy( unix_name + pos, de->d_name );
             closedir( dir );
-            goto success;
+            goto found;
         }
 
         if (!is_name_8_dot_3) continue;
@@ -2159,16 +2407,19 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
             {
                 strcpy( unix_name + pos, de->d_name );
                 closedir( dir );
-                goto success;
+                goto found;
             }
         }
     }
     closedir( dir );
+    if (use_cache) name_cache_insert( &dir_st, name, length, "" );
 
 not_found:
     unix_name[pos - 1] = 0;
     return STATUS_OBJECT_PATH_NOT_FOUND;
 
+found:
+    if (use_cache) name_cache_insert( &dir_st, name, length, unix_name + pos );
 success:
     if (is_win_dir && !lstat( unix_name, &st )) *is_win_dir = is_same_file( &windir, &st );
     return STATUS_SUCCESS;
@@ -287,6 +287,10 @@ static NTSTATUS get_object( HANDLE handle, struct esync **obj )
         return STATUS_INVALID_HANDLE;
     }
 
+    /* don't bother the server with handles we already know to be invalid */
+    if (server_get_shared_handle( handle, NULL, NULL, NULL, NULL ) == STATUS_INVALID_HANDLE)
+        return STATUS_INVALID_HANDLE;
+
     /* We need to try grabbing it from the server. */
     server_enter_uninterrupted_section( &fd_cache_section, &sigset );
     if (!(*obj = get_cached_object( handle )))
@@ -525,15 +529,6 @@ NTSTATUS esync_open_event( HANDLE *handle, ACCESS_MASK access,
     return open_esync( ESYNC_AUTO_EVENT, handle, access, attr ); /* doesn't matter which */
 }
 
-static inline void small_pause(void)
-{
-#ifdef __i386__
-    __asm__ __volatile__( "rep;nop" : : : "memory" );
-#else
-    __asm__ __volatile__( "" : : : "memory" );
-#endif
-}
-
 /* Manual-reset events are actually racier than other objects in terms of shm
  * state. With other objects, races don't matter, because we only treat the shm
  * state as a hint that lets us skip poll()—we still have to read(). But with
@@ -3083,6 +3083,27 @@ NTSTATUS WINAPI NtQueryInformationFile( HANDLE hFile, PIO_STATUS_BLOCK io,
 
     if (class <= 0 || class >= FileMaximumInformation)
         return io->u.Status = STATUS_INVALID_INFO_CLASS;
+    if ((class == FileAccessInformation || class == FileModeInformation) && len >= sizeof(ULONG))
+    {
+        /* the access rights and options of a handle never change, use the fd cache */
+        enum server_fd_type type;
+        unsigned int access;
+
+        if (!server_get_fd_info( hFile, &type, &access, &options ) &&
+            (type == FD_TYPE_FILE || type == FD_TYPE_DIR))
+        {
+            if (class == FileAccessInformation)
+                ((FILE_ACCESS_INFORMATION *)ptr)->AccessFlags = access;
+            else
+                ((FILE_MODE_INFORMATION *)ptr)->Mode = options & (FILE_WRITE_THROUGH |
+                                                                  FILE_SEQUENTIAL_ONLY |
+                                                                  FILE_NO_INTERMEDIATE_BUFFERING |
+                                                                  FILE_SYNCHRONOUS_IO_ALERT |
+                                                                  FILE_SYNCHRONOUS_IO_NONALERT);
+            io->Information = sizeof(ULONG);
+            return io->u.Status = STATUS_SUCCESS;
+        }
+    }
     if (!info_sizes[class])
         return server_get_file_info( hFile, io, ptr, len, class );
     if (len < info_sizes[class])
@@ -64,15 +64,6 @@ struct futex_wait_block
 };
 #include "poppack.h"
 
-static inline void small_pause(void)
-{
-#if defined(__i386__) || defined(__x86_64__)
-    __asm__ __volatile__( "rep;nop" : : : "memory" );
-#else
-    __asm__ __volatile__( "" : : : "memory" );
-#endif
-}
-
 static inline int futex_wait_multiple( const struct futex_wait_block *futexes,
         int count, const struct timespec *timeout )
 {
@@ -263,6 +254,10 @@ static NTSTATUS get_object( HANDLE handle, struct fsync **obj )
         return STATUS_NOT_IMPLEMENTED;
     }
 
+    /* don't bother the server with handles we already know to be invalid */
+    if (server_get_shared_handle( handle, NULL, NULL, NULL, NULL ) == STATUS_INVALID_HANDLE)
+        return STATUS_INVALID_HANDLE;
+
     /* We need to try grabbing it from the server. */
     SERVER_START_REQ( get_fsync_idx )
     {
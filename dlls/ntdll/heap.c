@@ -24,10 +24,14 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 #ifdef HAVE_VALGRIND_MEMCHECK_H
 #include <valgrind/memcheck.h>
 #else
@@ -41,6 +45,7 @@
 #include "winnt.h"
 #include "winternl.h"
 #include "ntdll_misc.h"
+#include "wine/library.h"
 #include "wine/list.h"
 #include "wine/rbtree.h"
 #include "wine/debug.h"
@@ -93,6 +98,8 @@ typedef struct
 #define ARENA_PENDING_MAGIC    0xbedead
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
+#define ARENA_LFH_MAGIC        0x48464c
+#define ARENA_LFH_FREE_MAGIC   0x46464c
 
 #define ARENA_INUSE_FILLER     0x55
 #define ARENA_TAIL_FILLER      0xab
@@ -130,6 +137,34 @@ C_ASSERT( sizeof(ARENA_LARGE) % LARGE_ALIGNMENT == 0 );
 /* number of free lists */
 #define HEAP_NB_FREE_LISTS  128
 
+/* max. size of the blocks allocated from the low fragmentation heap */
+#define LFH_MAX_SIZE     512
+/* number of LFH size classes */
+#define LFH_NB_BINS      (LFH_MAX_SIZE / ALIGNMENT)
+/* number of LFH affinity slots, must be a power of 2 */
+#define LFH_NB_SLOTS     8
+/* size of the heap blocks that get split into LFH blocks */
+#define LFH_GROUP_SIZE   0x10000
+/* size of the LFH groups hash table, must be a power of 2 */
+#define LFH_GROUP_HASH_SIZE 8192
+
+/* low fragmentation heap front-end, one lock-free free list per slot and size class */
+struct lfh
+{
+    SLIST_HEADER     bins[LFH_NB_SLOTS][LFH_NB_BINS];
+    LONG             group_count;   /* number of entries in the groups hash table */
+    char            *groups[LFH_GROUP_HASH_SIZE]; /* insert-only hash table of the groups, by 64k page */
+};
+
+/* per-heap profiling counters */
+struct heap_profile
+{
+    SIZE_T           live_bytes;    /* bytes currently allocated */
+    SIZE_T           peak_bytes;    /* max. value of live_bytes */
+    SIZE_T           alloc_count;   /* number of allocations */
+    SIZE_T           free_count;    /* number of frees */
+};
+
 struct tagHEAP;
 
 typedef struct tagSUBHEAP
@@ -164,6 +199,8 @@ typedef struct tagHEAP
     struct list     *freeList;      /* Free lists */
     struct wine_rb_tree freeTree;   /* Free tree */
     unsigned long    freeMask[HEAP_NB_FREE_LISTS / (8 * sizeof(unsigned long))];
+    struct lfh      *lfh;           /* Low fragmentation heap, NULL if not enabled */
+    struct heap_profile profile;    /* Profiling counters, if profiling is enabled */
 } HEAP;
 
 #define HEAP_FREEMASK_BLOCK    (8 * sizeof(unsigned long))
@@ -1009,6 +1046,8 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         heap->flags         = flags;
         heap->magic         = HEAP_MAGIC;
         heap->grow_size     = max( HEAP_DEF_SIZE, totalSize );
+        heap->lfh           = NULL;
+        memset( &heap->profile, 0, sizeof(heap->profile) );
         list_init( &heap->subheap_list );
         list_init( &heap->large_list );
 
@@ -1576,6 +1615,539 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
 }
 
 
+/* heap profiling, enabled with WINEHEAPPROFILE=<sample rate>[,<dump interval in seconds>] */
+
+#define HEAP_PROFILE_MAX_SAMPLES  16384  /* max. number of live sampled allocations */
+#define HEAP_PROFILE_MAX_FRAMES   8      /* max. backtrace depth of a sample */
+#define HEAP_PROFILE_HASH_SIZE    4096   /* size of the samples hash table, must be a power of 2 */
+
+struct heap_sample
+{
+    struct heap_sample *next;     /* next sample in hash chain or free list */
+    HEAP               *heap;     /* heap the block was allocated from */
+    const void         *ptr;      /* address of the block */
+    SIZE_T              size;     /* size of the block */
+    ULONG               hash;     /* hash of the backtrace */
+    USHORT              frames;   /* number of backtrace frames */
+    void               *backtrace[HEAP_PROFILE_MAX_FRAMES];
+};
+
+static ULONG heap_profile_rate;            /* sample one allocation out of this many, 0 if disabled */
+static LONG heap_profile_counter;          /* number of allocations since the last sample */
+static ULONG heap_profile_interval;        /* interval between periodic dumps in ms, 0 if disabled */
+static LONG heap_profile_next_dump;        /* tick count of the next periodic dump */
+static unsigned int heap_profile_live;     /* number of live samples */
+static struct heap_sample *heap_samples;   /* preallocated sample array */
+static struct heap_sample *heap_sample_free_list;
+static struct heap_sample *heap_sample_hash[HEAP_PROFILE_HASH_SIZE];
+
+static RTL_CRITICAL_SECTION heap_profile_section;
+static RTL_CRITICAL_SECTION_DEBUG heap_profile_section_debug =
+{
+    0, 0, &heap_profile_section,
+    { &heap_profile_section_debug.ProcessLocksList, &heap_profile_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": heap_profile_section") }
+};
+static RTL_CRITICAL_SECTION heap_profile_section = { &heap_profile_section_debug, -1, 0, 0, 0, 0 };
+
+static inline struct heap_sample **heap_sample_bucket( const void *ptr )
+{
+    return &heap_sample_hash[((ULONG_PTR)ptr / ALIGNMENT) & (HEAP_PROFILE_HASH_SIZE - 1)];
+}
+
+
+/***********************************************************************
+ *           heap_profile_init
+ */
+static void heap_profile_init(void)
+{
+    const char *env = getenv( "WINEHEAPPROFILE" );
+    char *interval;
+    SIZE_T i, size = HEAP_PROFILE_MAX_SAMPLES * sizeof(*heap_samples);
+    void *ptr = NULL;
+
+    if (!env || !(heap_profile_rate = strtoul( env, &interval, 10 ))) return;
+    if (*interval == ',') heap_profile_interval = strtoul( interval + 1, NULL, 10 ) * 1000;
+
+    if (NtAllocateVirtualMemory( NtCurrentProcess(), &ptr, 0, &size, MEM_COMMIT, PAGE_READWRITE ))
+    {
+        heap_profile_rate = 0;
+        return;
+    }
+    heap_samples = ptr;
+    for (i = 0; i < HEAP_PROFILE_MAX_SAMPLES; i++)
+    {
+        heap_samples[i].next = heap_sample_free_list;
+        heap_sample_free_list = &heap_samples[i];
+    }
+
+    heap_profile_next_dump = NtGetTickCount() + heap_profile_interval;
+    MESSAGE( "wine: heap profiling enabled, sampling 1 allocation out of %u\n", heap_profile_rate );
+}
+
+
+/***********************************************************************
+ *           heap_get_usage
+ *
+ * Compute the committed and free space of a heap, to estimate fragmentation.
+ */
+static void heap_get_usage( HEAP *heap, SIZE_T *committed, SIZE_T *free, SIZE_T *largest )
+{
+    SUBHEAP *subheap;
+    ARENA_LARGE *large;
+
+    *committed = *free = *largest = 0;
+
+    enter_critical_section( &heap->critSection );
+    LIST_FOR_EACH_ENTRY( subheap, &heap->subheap_list, SUBHEAP, entry )
+    {
+        char *ptr = (char *)subheap->base + subheap->headerSize;
+        char *end = (char *)subheap->base + subheap->commitSize;
+
+        *committed += subheap->commitSize;
+        while (ptr < end)
+        {
+            SIZE_T size = *(DWORD *)ptr & ARENA_SIZE_MASK;
+
+            if (*(DWORD *)ptr & ARENA_FLAG_FREE)
+            {
+                size = min( size, end - ptr - sizeof(ARENA_FREE) );
+                *free += size;
+                *largest = max( *largest, size );
+                ptr += sizeof(ARENA_FREE) + (*(DWORD *)ptr & ARENA_SIZE_MASK);
+            }
+            else ptr += sizeof(ARENA_INUSE) + size;
+        }
+    }
+    LIST_FOR_EACH_ENTRY( large, &heap->large_list, ARENA_LARGE, entry )
+        *committed += large->block_size;
+    leave_critical_section( &heap->critSection );
+}
+
+
+/***********************************************************************
+ *           heap_profile_add_sample
+ */
+static void heap_profile_add_sample( HEAP *heap, const void *ptr, SIZE_T size )
+{
+    struct heap_sample *sample, **bucket = heap_sample_bucket( ptr );
+    void *backtrace[HEAP_PROFILE_MAX_FRAMES];
+    ULONG hash;
+    USHORT frames;
+
+    /* skip ourselves and the heap function */
+    frames = RtlCaptureStackBackTrace( 2, HEAP_PROFILE_MAX_FRAMES, backtrace, &hash );
+
+    RtlEnterCriticalSection( &heap_profile_section );
+    if ((sample = heap_sample_free_list))
+    {
+        heap_sample_free_list = sample->next;
+        sample->heap   = heap;
+        sample->ptr    = ptr;
+        sample->size   = size;
+        sample->hash   = hash;
+        sample->frames = frames;
+        memcpy( sample->backtrace, backtrace, frames * sizeof(void *) );
+        sample->next   = *bucket;
+        *bucket = sample;
+        heap_profile_live++;
+    }
+    RtlLeaveCriticalSection( &heap_profile_section );
+}
+
+
+/***********************************************************************
+ *           heap_profile_remove_samples
+ *
+ * Remove the sample of a block, or all samples of a heap if ptr is NULL.
+ */
+static void heap_profile_remove_samples( HEAP *heap, const void *ptr )
+{
+    struct heap_sample *sample, **prev;
+    unsigned int i;
+
+    RtlEnterCriticalSection( &heap_profile_section );
+    for (i = 0; i < HEAP_PROFILE_HASH_SIZE; i++)
+    {
+        prev = ptr ? heap_sample_bucket( ptr ) : &heap_sample_hash[i];
+        while ((sample = *prev))
+        {
+            if (sample->heap != heap || (ptr && sample->ptr != ptr))
+            {
+                prev = &sample->next;
+                continue;
+            }
+            *prev = sample->next;
+            sample->next = heap_sample_free_list;
+            heap_sample_free_list = sample;
+            heap_profile_live--;
+        }
+        if (ptr) break;  /* only one bucket to look at */
+    }
+    RtlLeaveCriticalSection( &heap_profile_section );
+}
+
+
+/***********************************************************************
+ *           heap_sample_compare
+ *
+ * Sort samples by backtrace, then by heap.
+ */
+static int heap_sample_compare( const void *p1, const void *p2 )
+{
+    const struct heap_sample *s1 = *(const struct heap_sample * const *)p1;
+    const struct heap_sample *s2 = *(const struct heap_sample * const *)p2;
+
+    if (s1->hash != s2->hash) return s1->hash < s2->hash ? -1 : 1;
+    if (s1->frames != s2->frames) return s1->frames - s2->frames;
+    return memcmp( s1->backtrace, s2->backtrace, s1->frames * sizeof(void *) );
+}
+
+
+/***********************************************************************
+ *           heap_profile_dump
+ *
+ * Write the heap counters and the sampled live allocations grouped by call site.
+ */
+static void heap_profile_dump(void)
+{
+    struct heap_sample **sorted, *sample;
+    SIZE_T committed, free, largest, size = HEAP_PROFILE_MAX_SAMPLES * sizeof(*sorted);
+    unsigned int i, j, count = 0;
+    struct list *entry;
+    void *ptr = NULL;
+    const char *config_dir = wine_get_config_dir();
+    char *name;
+    FILE *file;
+    HEAP *heap;
+    int fd;
+
+    if (!config_dir) return;
+    if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, strlen(config_dir) + 32 ))) return;
+    sprintf( name, "%s/heap-profile-%u.txt", config_dir, getpid() );
+    if ((fd = open( name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600 )) == -1 ||
+        !(file = fdopen( fd, "w" )))
+    {
+        ERR( "failed to create %s\n", name );
+        if (fd != -1) close( fd );
+        RtlFreeHeap( GetProcessHeap(), 0, name );
+        return;
+    }
+
+    enter_critical_section( &processHeap->critSection );
+    for (heap = processHeap, entry = &processHeap->entry; heap; )
+    {
+        heap_get_usage( heap, &committed, &free, &largest );
+        fprintf( file, "heap %p: live %lu peak %lu allocs %lu frees %lu committed %lu free %lu largest free %lu\n",
+                 heap, heap->profile.live_bytes, heap->profile.peak_bytes, heap->profile.alloc_count,
+                 heap->profile.free_count, committed, free, largest );
+        entry = list_next( &processHeap->entry, entry );
+        heap = entry ? LIST_ENTRY( entry, HEAP, entry ) : NULL;
+    }
+    leave_critical_section( &processHeap->critSection );
+
+    if (!NtAllocateVirtualMemory( NtCurrentProcess(), &ptr, 0, &size, MEM_COMMIT, PAGE_READWRITE ))
+    {
+        sorted = ptr;
+        RtlEnterCriticalSection( &heap_profile_section );
+        for (i = 0; i < HEAP_PROFILE_HASH_SIZE; i++)
+            for (sample = heap_sample_hash[i]; sample; sample = sample->next) sorted[count++] = sample;
+        qsort( sorted, count, sizeof(*sorted), heap_sample_compare );
+
+        fprintf( file, "\n%u live samples, 1 out of %u allocations\n", count, heap_profile_rate );
+        for (i = 0; i < count; i = j)
+        {
+            SIZE_T bytes = 0;
+
+            for (j = i; j < count && !heap_sample_compare( &sorted[i], &sorted[j] ); j++)
+                bytes += sorted[j]->size;
+            fprintf( file, "%u blocks, %lu bytes:", j - i, bytes );
+            for (size = 0; size < sorted[i]->frames; size++) fprintf( file, " %p", sorted[i]->backtrace[size] );
+            fprintf( file, "\n" );
+        }
+        RtlLeaveCriticalSection( &heap_profile_section );
+
+        size = 0;
+        NtFreeVirtualMemory( NtCurrentProcess(), &ptr, &size, MEM_RELEASE );
+    }
+    fclose( file );
+    MESSAGE( "wine: heap profile written to %s\n", name );
+    RtlFreeHeap( GetProcessHeap(), 0, name );
+}
+
+
+/***********************************************************************
+ *           heap_profile_alloc
+ *
+ * Account for a block allocation; only called when profiling is enabled.
+ */
+static void heap_profile_alloc( HEAP *heap, const void *ptr, SIZE_T size, BOOL sample )
+{
+    SIZE_T live = __atomic_add_fetch( &heap->profile.live_bytes, size, __ATOMIC_RELAXED );
+    SIZE_T peak = __atomic_load_n( &heap->profile.peak_bytes, __ATOMIC_RELAXED );
+
+    while (live > peak && !__atomic_compare_exchange_n( &heap->profile.peak_bytes, &peak, live, FALSE,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED ))
+        ;
+    __atomic_add_fetch( &heap->profile.alloc_count, 1, __ATOMIC_RELAXED );
+
+    if (!sample || InterlockedIncrement( &heap_profile_counter ) % heap_profile_rate) return;
+    heap_profile_add_sample( heap, ptr, size );
+
+    /* periodic dumps are only checked on sampled allocations, to keep the common path cheap */
+    if (heap_profile_interval)
+    {
+        LONG next = heap_profile_next_dump, now = NtGetTickCount();
+
+        if (now - next >= 0 && InterlockedCompareExchange( &heap_profile_next_dump,
+                                                           now + heap_profile_interval, next ) == next)
+            heap_profile_dump();
+    }
+}
+
+
+/***********************************************************************
+ *           heap_profile_shutdown
+ *
+ * Write a final dump on process exit.
+ */
+void heap_profile_shutdown(void)
+{
+    if (heap_profile_rate) heap_profile_dump();
+}
+
+
+/***********************************************************************
+ *           heap_profile_free
+ *
+ * Account for a block release; only called when profiling is enabled.
+ */
+static void heap_profile_free( HEAP *heap, const void *ptr, SIZE_T size )
+{
+    __atomic_sub_fetch( &heap->profile.live_bytes, size, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &heap->profile.free_count, 1, __ATOMIC_RELAXED );
+    if (heap_profile_live) heap_profile_remove_samples( heap, ptr );
+}
+
+
+/***********************************************************************
+ *           lfh_get_slot
+ *
+ * Get the LFH affinity slot of the current thread.
+ */
+static inline unsigned int lfh_get_slot(void)
+{
+    return ((ULONG_PTR)NtCurrentTeb()->ClientId.UniqueThread >> 2) & (LFH_NB_SLOTS - 1);
+}
+
+
+/***********************************************************************
+ *           lfh_get_block_size
+ *
+ * Get the size class of an LFH block.
+ */
+static inline SIZE_T lfh_get_block_size( SIZE_T size )
+{
+    if (!size) return ALIGNMENT;
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+
+/***********************************************************************
+ *           lfh_group_hash
+ */
+static inline unsigned int lfh_group_hash( ULONG_PTR page )
+{
+    return (page * 0x9e3779b1) & (LFH_GROUP_HASH_SIZE - 1);
+}
+
+
+/***********************************************************************
+ *           lfh_add_group
+ *
+ * Register a group under the 64k pages it spans. Entries are never removed,
+ * groups live as long as the heap, so lookups don't need any lock.
+ */
+static BOOL lfh_add_group( struct lfh *lfh, char *base )
+{
+    ULONG_PTR page, first = (ULONG_PTR)base >> 16, last = ((ULONG_PTR)base + LFH_GROUP_SIZE - 1) >> 16;
+    unsigned int i;
+
+    /* keep the table at most 3/4 full */
+    if (InterlockedExchangeAdd( &lfh->group_count, last - first + 1 ) + last - first + 1 >
+        LFH_GROUP_HASH_SIZE / 4 * 3)
+    {
+        InterlockedExchangeAdd( &lfh->group_count, -(LONG)(last - first + 1) );
+        return FALSE;
+    }
+
+    for (page = first; page <= last; page++)
+    {
+        i = lfh_group_hash( page );
+        while (InterlockedCompareExchangePointer( (void **)&lfh->groups[i], base, NULL ))
+            i = (i + 1) & (LFH_GROUP_HASH_SIZE - 1);
+    }
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           is_lfh_block
+ *
+ * Check if a pointer has been allocated from the low fragmentation heap.
+ * The arena is only looked at once the pointer is known to be inside a group.
+ */
+static inline BOOL is_lfh_block( const HEAP *heap, const void *ptr )
+{
+    const ARENA_INUSE *arena = (const ARENA_INUSE *)ptr - 1;
+    const struct lfh *lfh = heap->lfh;
+    const char *base;
+    unsigned int i;
+
+    if (!lfh || (ULONG_PTR)ptr % ALIGNMENT) return FALSE;
+
+    i = lfh_group_hash( (ULONG_PTR)ptr >> 16 );
+    while ((base = lfh->groups[i]))
+    {
+        /* the first block starts ALIGNMENT bytes into the group */
+        if ((const char *)ptr >= base + ALIGNMENT && (const char *)ptr < base + LFH_GROUP_SIZE)
+            return arena->magic == ARENA_LFH_MAGIC || arena->magic == ARENA_LFH_FREE_MAGIC;
+        i = (i + 1) & (LFH_GROUP_HASH_SIZE - 1);
+    }
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *           validate_lfh_block
+ *
+ * Minimum validation of an LFH block, once is_lfh_block() succeeded.
+ */
+static BOOL validate_lfh_block( const HEAP *heap, const ARENA_INUSE *arena )
+{
+    SIZE_T size = arena->size & ARENA_SIZE_MASK;
+
+    if (arena->magic == ARENA_LFH_FREE_MAGIC)
+        WARN( "Heap %p: LFH block %p used after free\n", heap, arena + 1 );
+    else if (!size || size > LFH_MAX_SIZE || size % ALIGNMENT || arena->unused_bytes > size)
+        ERR( "Heap %p: bad size %08x for LFH arena %p\n", heap, arena->size, arena );
+    else
+        return TRUE;
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *           lfh_create_group
+ *
+ * Split a new heap block into LFH blocks of the specified size.
+ * The first block is returned, the others are added to the free list.
+ */
+static SLIST_ENTRY *lfh_create_group( HEAP *heap, SLIST_HEADER *list, SIZE_T block_size )
+{
+    SIZE_T i, count, stride = block_size + ALIGNMENT;
+    SLIST_ENTRY *entry, *first = NULL, *last = NULL;
+    ARENA_INUSE *arena;
+    char *base;
+
+    if (!(base = RtlAllocateHeap( heap, 0, LFH_GROUP_SIZE ))) return NULL;
+    if (!lfh_add_group( heap->lfh, base ))
+    {
+        WARN( "heap %p: too many LFH groups\n", heap );
+        RtlFreeHeap( heap, 0, base );
+        return NULL;
+    }
+    /* groups are accounted for through the blocks they contain */
+    if (heap_profile_rate) heap_profile_free( heap, base, LFH_GROUP_SIZE );
+
+    count = LFH_GROUP_SIZE / stride;
+    for (i = 0; i < count; i++)
+    {
+        entry = (SLIST_ENTRY *)(base + i * stride + ALIGNMENT);
+        arena = (ARENA_INUSE *)entry - 1;
+        arena->size         = block_size;
+        arena->magic        = ARENA_LFH_FREE_MAGIC;
+        arena->unused_bytes = 0;
+        entry->Next = NULL;
+        if (!i) continue;
+        if (last) last->Next = entry;
+        else first = entry;
+        last = entry;
+    }
+    if (first) RtlInterlockedPushListSListEx( list, first, last, count - 1 );
+    TRACE( "heap %p: new group %p for size %lu\n", heap, base, block_size );
+    return (SLIST_ENTRY *)(base + ALIGNMENT);
+}
+
+
+/***********************************************************************
+ *           lfh_allocate
+ *
+ * Lock-free allocation of a small block.
+ */
+static void *lfh_allocate( HEAP *heap, DWORD flags, SIZE_T size )
+{
+    SIZE_T block_size = lfh_get_block_size( size );
+    unsigned int i, bin = block_size / ALIGNMENT - 1, slot = lfh_get_slot();
+    ARENA_INUSE *arena;
+    SLIST_ENTRY *entry = NULL;
+
+    /* try our own slot first, then steal blocks freed by other threads */
+    for (i = 0; i < LFH_NB_SLOTS && !entry; i++)
+        entry = RtlInterlockedPopEntrySList( &heap->lfh->bins[(slot + i) & (LFH_NB_SLOTS - 1)][bin] );
+
+    if (!entry && !(entry = lfh_create_group( heap, &heap->lfh->bins[slot][bin], block_size )))
+        return NULL;
+
+    arena = (ARENA_INUSE *)entry - 1;
+    arena->magic        = ARENA_LFH_MAGIC;
+    arena->unused_bytes = block_size - size;
+    if (flags & HEAP_ZERO_MEMORY) memset( entry, 0, size );
+    return entry;
+}
+
+
+/***********************************************************************
+ *           lfh_free
+ *
+ * Lock-free release of a small block.
+ */
+static void lfh_free( HEAP *heap, ARENA_INUSE *arena )
+{
+    unsigned int bin = (arena->size & ARENA_SIZE_MASK) / ALIGNMENT - 1;
+
+    arena->magic = ARENA_LFH_FREE_MAGIC;
+    RtlInterlockedPushEntrySList( &heap->lfh->bins[lfh_get_slot()][bin], (SLIST_ENTRY *)(arena + 1) );
+}
+
+
+/***********************************************************************
+ *           lfh_reallocate
+ *
+ * Resize a block allocated from the low fragmentation heap.
+ */
+static void *lfh_reallocate( HEAP *heap, DWORD flags, ARENA_INUSE *arena, SIZE_T size )
+{
+    SIZE_T block_size = arena->size & ARENA_SIZE_MASK;
+    SIZE_T old_size = block_size - arena->unused_bytes;
+    void *ret;
+
+    if (size <= block_size && block_size - size <= 0xff)
+    {
+        if (size > old_size && (flags & HEAP_ZERO_MEMORY))
+            memset( (char *)(arena + 1) + old_size, 0, size - old_size );
+        arena->unused_bytes = block_size - size;
+        return arena + 1;
+    }
+    if (flags & HEAP_REALLOC_IN_PLACE_ONLY) return NULL;
+
+    if (!(ret = RtlAllocateHeap( heap, flags & ~HEAP_GENERATE_EXCEPTIONS, size ))) return NULL;
+    memcpy( ret, arena + 1, min( old_size, size ));
+    lfh_free( heap, arena );
+    return ret;
+}
+
+
 /***********************************************************************
  *           heap_set_debug_flags
  */
@@ -1689,6 +2261,8 @@ HANDLE WINAPI RtlCreateHeap( ULONG flags, PVOID addr, SIZE_T totalSize, SIZE_T c
         flags |= HEAP_GROWABLE;
     }
 
+    if (!processHeap && !addr) heap_profile_init();
+
     if (!(subheap = HEAP_CreateSubHeap( NULL, addr, flags, commitSize, totalSize ))) return 0;
 
     heap_set_debug_flags( subheap->heap );
@@ -1744,6 +2318,8 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
     heapPtr->critSection.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &heapPtr->critSection );
 
+    if (heap_profile_rate) heap_profile_remove_samples( heapPtr, NULL );
+
     LIST_FOR_EACH_ENTRY_SAFE( arena, arena_next, &heapPtr->large_list, ARENA_LARGE, entry )
     {
         list_remove( &arena->entry );
@@ -1812,6 +2388,17 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    if (heapPtr->lfh && size <= LFH_MAX_SIZE)
+    {
+        void *ret = lfh_allocate( heapPtr, flags, size );
+        if (ret)
+        {
+            if (heap_profile_rate) heap_profile_alloc( heapPtr, ret, size, TRUE );
+            TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
+            return ret;
+        }
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) enter_critical_section( &heapPtr->critSection );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
@@ -1819,6 +2406,7 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
         void *ret = allocate_large_block( heap, flags, size );
         if (!(flags & HEAP_NO_SERIALIZE)) leave_critical_section( &heapPtr->critSection );
         if (!ret && (flags & HEAP_GENERATE_EXCEPTIONS)) RtlRaiseStatus( STATUS_NO_MEMORY );
+        if (ret && heap_profile_rate) heap_profile_alloc( heapPtr, ret, size, TRUE );
         TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
         return ret;
     }
@@ -1857,6 +2445,7 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
 
     if (!(flags & HEAP_NO_SERIALIZE)) leave_critical_section( &heapPtr->critSection );
 
+    if (heap_profile_rate) heap_profile_alloc( heapPtr, pInUse + 1, size, TRUE );
     TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, pInUse + 1 );
     return pInUse + 1;
 }
@@ -1881,6 +2470,7 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *pt
     ARENA_INUSE *pInUse;
     SUBHEAP *subheap;
     HEAP *heapPtr;
+    SIZE_T size;
 
     /* Validate the parameters */
 
@@ -1895,6 +2485,25 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *pt
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+
+    /* account for the block before releasing it, it could get reused right away */
+    if (heap_profile_rate && (size = RtlSizeHeap( heap, flags, ptr )) != ~(SIZE_T)0)
+        heap_profile_free( heapPtr, ptr, size );
+
+    if (is_lfh_block( heapPtr, ptr ))
+    {
+        pInUse = (ARENA_INUSE *)ptr - 1;
+        if (!validate_lfh_block( heapPtr, pInUse ))
+        {
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+            TRACE("(%p,%08x,%p): returning FALSE\n", heap, flags, ptr );
+            return FALSE;
+        }
+        lfh_free( heapPtr, pInUse );
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) enter_critical_section( &heapPtr->critSection );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
@@ -1941,7 +2550,7 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     ARENA_INUSE *pArena;
     HEAP *heapPtr;
     SUBHEAP *subheap;
-    SIZE_T oldBlockSize, oldActualSize, rounded_size;
+    SIZE_T oldBlockSize, oldActualSize, rounded_size, profile_size = ~(SIZE_T)0;
     void *ret;
 
     if (!ptr) return NULL;
@@ -1956,6 +2565,30 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     flags &= HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY |
              HEAP_REALLOC_IN_PLACE_ONLY;
     flags |= heapPtr->flags;
+
+    if (heap_profile_rate && (profile_size = RtlSizeHeap( heap, flags, ptr )) != ~(SIZE_T)0)
+        heap_profile_free( heapPtr, ptr, profile_size );
+
+    if (is_lfh_block( heapPtr, ptr ))
+    {
+        pArena = (ARENA_INUSE *)ptr - 1;
+        if (!validate_lfh_block( heapPtr, pArena ))
+        {
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+            ret = NULL;
+        }
+        else if (!(ret = lfh_reallocate( heapPtr, flags, pArena, size )))
+        {
+            if (profile_size != ~(SIZE_T)0) heap_profile_alloc( heapPtr, ptr, profile_size, FALSE );
+            if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
+        }
+        /* a moved block has been accounted for by RtlAllocateHeap */
+        else if (profile_size != ~(SIZE_T)0 && ret == ptr) heap_profile_alloc( heapPtr, ret, size, TRUE );
+        TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
+        return ret;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) enter_critical_section( &heapPtr->critSection );
 
     rounded_size = ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE;
@@ -2051,11 +2684,13 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     ret = pArena + 1;
 done:
     if (!(flags & HEAP_NO_SERIALIZE)) leave_critical_section( &heapPtr->critSection );
+    if (profile_size != ~(SIZE_T)0) heap_profile_alloc( heapPtr, ret, size, TRUE );
     TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
     return ret;
 
 oom:
     if (!(flags & HEAP_NO_SERIALIZE)) leave_critical_section( &heapPtr->critSection );
+    if (profile_size != ~(SIZE_T)0) heap_profile_alloc( heapPtr, ptr, profile_size, FALSE );
     if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
     RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
     TRACE("(%p,%08x,%p,%08lx): returning NULL\n", heap, flags, ptr, size );
@@ -2165,9 +2800,22 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
     }
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
-    if (!(flags & HEAP_NO_SERIALIZE)) enter_critical_section( &heapPtr->critSection );
 
     pArena = (const ARENA_INUSE *)ptr - 1;
+    if (is_lfh_block( heapPtr, ptr ))
+    {
+        if (!validate_lfh_block( heapPtr, pArena ))
+        {
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
+            ret = ~0UL;
+        }
+        else ret = (pArena->size & ARENA_SIZE_MASK) - pArena->unused_bytes;
+        TRACE("(%p,%08x,%p): returning %08lx\n", heap, flags, ptr, ret );
+        return ret;
+    }
+
+    if (!(flags & HEAP_NO_SERIALIZE)) enter_critical_section( &heapPtr->critSection );
+
     if (!validate_block_pointer( heapPtr, &subheap, pArena ))
     {
         RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
@@ -2207,6 +2855,8 @@ BOOLEAN WINAPI RtlValidateHeap( HANDLE heap, ULONG flags, LPCVOID ptr )
 {
     HEAP *heapPtr = HEAP_GetPtr( heap );
     if (!heapPtr) return FALSE;
+    if (ptr && is_lfh_block( heapPtr, ptr ))
+        return ((const ARENA_INUSE *)ptr - 1)->magic == ARENA_LFH_MAGIC;
     return HEAP_IsRealArena( heapPtr, flags, ptr, QUIET );
 }
 
@@ -2375,7 +3025,9 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
-    switch (info_class)
+    HEAP *heapPtr;
+
+    switch ((ULONG)info_class)
     {
     case HeapCompatibilityInformation:
         if (size_out) *size_out = sizeof(ULONG);
@@ -2383,9 +3035,33 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
 
-        *(ULONG *)info = 0; /* standard heap */
+        heapPtr = HEAP_GetPtr( heap );
+        *(ULONG *)info = (heapPtr && heapPtr->lfh) ? 2 : 0; /* low fragmentation or standard heap */
         return STATUS_SUCCESS;
 
+    case HeapWineProfileInformation:
+    {
+        HEAP_WINE_PROFILE_INFORMATION *profile = info;
+        SIZE_T committed, free, largest;
+
+        if (size_out) *size_out = sizeof(*profile);
+        if (size_in < sizeof(*profile)) return STATUS_BUFFER_TOO_SMALL;
+        if (!heap_profile_rate) return STATUS_NOT_SUPPORTED;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        heap_get_usage( heapPtr, &committed, &free, &largest );
+        profile->LiveBytes        = heapPtr->profile.live_bytes;
+        profile->PeakBytes        = heapPtr->profile.peak_bytes;
+        profile->AllocCount       = heapPtr->profile.alloc_count;
+        profile->FreeCount        = heapPtr->profile.free_count;
+        profile->CommittedBytes   = committed;
+        profile->FreeBytes        = free;
+        profile->LargestFreeBlock = largest;
+        profile->SampleRate       = heap_profile_rate;
+        profile->LiveSamples      = heap_profile_live;
+        return STATUS_SUCCESS;
+    }
+
     default:
         FIXME("Unknown heap information class %u\n", info_class);
         return STATUS_INVALID_INFO_CLASS;
@@ -2397,6 +3073,40 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
  */
 NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class, PVOID info, SIZE_T size)
 {
-    FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
-    return STATUS_SUCCESS;
+    HEAP *heapPtr;
+    struct lfh *lfh;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        TRACE( "%p compatibility mode %u\n", heap, *(ULONG *)info );
+        switch (*(ULONG *)info)
+        {
+        case 0:
+            return heapPtr->lfh ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+        case 1:
+            FIXME( "%p look-aside lists not supported\n", heap );
+            return STATUS_SUCCESS;
+        case 2:
+            if (heapPtr->lfh) return STATUS_SUCCESS;
+            /* debugging features need to see every block, and the LFH needs a growable heap */
+            if (!(heapPtr->flags & HEAP_GROWABLE) || RUNNING_ON_VALGRIND ||
+                (heapPtr->flags & (HEAP_NO_SERIALIZE | HEAP_VALIDATE | HEAP_PAGE_ALLOCS |
+                                   HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED)))
+                return STATUS_UNSUCCESSFUL;
+            if (!(lfh = RtlAllocateHeap( heap, HEAP_ZERO_MEMORY, sizeof(*lfh) ))) return STATUS_NO_MEMORY;
+            if (InterlockedCompareExchangePointer( (void **)&heapPtr->lfh, lfh, NULL ))
+                RtlFreeHeap( heap, 0, lfh );
+            return STATUS_SUCCESS;
+        default:
+            return STATUS_INVALID_PARAMETER;
+        }
+
+    default:
+        FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
+        return STATUS_SUCCESS;
+    }
 }
@@ -59,6 +59,7 @@ WINE_DECLARE_DEBUG_CHANNEL(relay);
 WINE_DECLARE_DEBUG_CHANNEL(snoop);
 WINE_DECLARE_DEBUG_CHANNEL(loaddll);
 WINE_DECLARE_DEBUG_CHANNEL(imports);
+WINE_DECLARE_DEBUG_CHANNEL(exports);
 
 #ifdef _WIN64
 #define DEFAULT_SECURITY_COOKIE_64  (((ULONGLONG)0x00002b99 << 32) | 0x2ddfa232)
@@ -133,13 +134,31 @@ static const WCHAR dllW[] = {'.','d','l','l',0};
 #define HASH_MAP_SIZE 32
 static LIST_ENTRY hash_table[HASH_MAP_SIZE];
 
+/* lazily built lookup cache for the exports of a module */
+struct export_cache
+{
+    ULONG     generation;     /* unload generation the forwards were resolved in */
+    FARPROC  *forwards;       /* resolved forwards, indexed by ordinal */
+    DWORD    *buckets;        /* name hash table, index in the names array + 1 */
+    DWORD     mask;           /* number of buckets - 1 */
+    ULONG     name_lookups;   /* statistics */
+    ULONG     name_probes;
+    ULONG     forward_lookups;
+    ULONG     forward_hits;
+};
+
+static ULONG unload_generation;  /* incremented every time a module is unloaded */
+
 /* internal representation of 32bit modules. per process. */
 typedef struct _wine_modref
 {
     LDR_DATA_TABLE_ENTRY  ldr;
     dev_t                 dev;
     ino_t                 ino;
+    ULONGLONG             mtime;      /* modification time in nanoseconds */
+    off_t                 file_size;
     void                 *so_handle;
+    struct export_cache  *export_cache;
     int                   alloc_deps;
     int                   nDeps;
     struct _wine_modref **deps;
@@ -708,6 +727,107 @@ static WINE_MODREF **grow_module_deps( WINE_MODREF *wm, int count )
     return deps;
 }
 
+/*************************************************************************
+ *		get_export_cache
+ *
+ * Get the export cache of a module, allocating it if needed.
+ * The loader_section must be locked while calling this function.
+ */
+static struct export_cache *get_export_cache( HMODULE module )
+{
+    WINE_MODREF *wm = get_modref( module );
+
+    if (!wm) return NULL;
+    if (!wm->export_cache)
+        wm->export_cache = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*wm->export_cache) );
+    return wm->export_cache;
+}
+
+static inline DWORD hash_export_name( const char *name )
+{
+    DWORD hash = 0;
+    while (*name) hash = hash * 65599 + (unsigned char)*name++;
+    return hash;
+}
+
+/*************************************************************************
+ *		build_export_hash
+ *
+ * Build the hash table of the export names of a module.
+ */
+static BOOL build_export_hash( struct export_cache *cache, HMODULE module,
+                               const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    DWORD i, pos, size = 16;
+
+    while (size < 2 * exports->NumberOfNames) size *= 2;
+    if (!(cache->buckets = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(DWORD) )))
+        return FALSE;
+    cache->mask = size - 1;
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        pos = hash_export_name( get_rva( module, names[i] )) & cache->mask;
+        while (cache->buckets[pos]) pos = (pos + 1) & cache->mask;
+        cache->buckets[pos] = i + 1;
+    }
+    TRACE_(exports)( "hashed %u names for %p\n", exports->NumberOfNames, module );
+    return TRUE;
+}
+
+/*************************************************************************
+ *		find_export_hash
+ *
+ * Find a name in the export hash table; return its index in the names array, or -1.
+ */
+static int find_export_hash( struct export_cache *cache, HMODULE module,
+                             const IMAGE_EXPORT_DIRECTORY *exports, const char *name )
+{
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    DWORD pos = hash_export_name( name ) & cache->mask;
+
+    cache->name_lookups++;
+    for ( ; cache->buckets[pos]; pos = (pos + 1) & cache->mask)
+    {
+        DWORD index = cache->buckets[pos] - 1;
+
+        cache->name_probes++;
+        if (!strcmp( get_rva( module, names[index] ), name )) return index;
+    }
+    return -1;
+}
+
+/*************************************************************************
+ *		trace_export_stats
+ *
+ * Report the export lookup statistics of a module.
+ */
+static void trace_export_stats( const WINE_MODREF *wm )
+{
+    const struct export_cache *cache = wm->export_cache;
+
+    if (!cache) return;
+    TRACE_(exports)( "%s: %u hashed lookups with %u probes, %u of %u forwards from cache\n",
+                     debugstr_w(wm->ldr.BaseDllName.Buffer), cache->name_lookups, cache->name_probes,
+                     cache->forward_hits, cache->forward_lookups );
+}
+
+/*************************************************************************
+ *		free_export_cache
+ */
+static void free_export_cache( WINE_MODREF *wm )
+{
+    struct export_cache *cache = wm->export_cache;
+
+    if (!cache) return;
+    trace_export_stats( wm );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->buckets );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->forwards );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+    wm->export_cache = NULL;
+}
+
+
 /*************************************************************************
  *		find_forwarded_export
  *
@@ -779,6 +899,49 @@ static FARPROC find_forwarded_export( HMODULE module, const char *forward, LPCWS
 }
 
 
+/*************************************************************************
+ *		find_cached_forward
+ *
+ * Find the final function pointer for a forwarded function, going through
+ * the export cache of the forwarding module.
+ * The loader_section must be locked while calling this function.
+ */
+static FARPROC find_cached_forward( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
+                                    DWORD ordinal, const char *forward, LPCWSTR load_path )
+{
+    struct export_cache *cache;
+    ULONG generation = unload_generation;
+    FARPROC proc;
+
+    /* relay and snoop thunks depend on the caller, they can't be cached */
+    if (TRACE_ON(relay) || TRACE_ON(snoop) || !(cache = get_export_cache( module )))
+        return find_forwarded_export( module, forward, load_path );
+
+    cache->forward_lookups++;
+    if (cache->generation != generation)
+    {
+        /* modules have been unloaded since, the targets may be gone */
+        if (cache->forwards) memset( cache->forwards, 0, exports->NumberOfFunctions * sizeof(FARPROC) );
+        cache->generation = generation;
+    }
+    else if (cache->forwards && cache->forwards[ordinal])
+    {
+        cache->forward_hits++;
+        return cache->forwards[ordinal];
+    }
+
+    proc = find_forwarded_export( module, forward, load_path );
+    /* loading the target may have unloaded modules, including this one */
+    if (!proc || unload_generation != generation) return proc;
+
+    if (!cache->forwards)
+        cache->forwards = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                           exports->NumberOfFunctions * sizeof(FARPROC) );
+    if (cache->forwards) cache->forwards[ordinal] = proc;
+    return proc;
+}
+
+
 /*************************************************************************
  *		find_ordinal_export
  *
@@ -804,7 +967,7 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
     /* if the address falls into the export dir, it's a forward */
     if (((const char *)proc >= (const char *)exports) && 
         ((const char *)proc < (const char *)exports + exp_size))
-        return find_forwarded_export( module, (const char *)proc, load_path );
+        return find_cached_forward( module, exports, ordinal, (const char *)proc, load_path );
 
     if (TRACE_ON(snoop))
     {
@@ -832,6 +995,7 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
     int min = 0, max = exports->NumberOfNames - 1;
+    struct export_cache *cache;
 
     /* first check the hint */
     if (hint >= 0 && hint <= max)
@@ -841,7 +1005,16 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
-    /* then do a binary search */
+    /* then the name hash, for tables large enough to be worth it */
+    if (exports->NumberOfNames >= 32 && (cache = get_export_cache( module )) &&
+        (cache->buckets || build_export_hash( cache, module, exports )))
+    {
+        int pos = find_export_hash( cache, module, exports, name );
+        if (pos == -1) return NULL;
+        return find_ordinal_export( module, exports, exp_size, ordinals[pos], load_path );
+    }
+
+    /* otherwise do a binary search */
     while (min <= max)
     {
         int res, pos = (min + max) / 2;
@@ -856,6 +1029,286 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 }
 
 
+/* on-disk snapshot of the import address tables resolved against builtin dlls */
+
+#define IMPORT_SNAPSHOT_MAGIC     0x504d4957  /* "WIMP" */
+#define IMPORT_SNAPSHOT_VERSION   2
+#define IMPORT_SNAPSHOT_MAX_SIZE  (4 << 20)
+#define IMPORT_SNAPSHOT_HASH_SIZE 256
+
+struct import_snapshot_header
+{
+    DWORD magic;
+    DWORD version;
+    DWORD ptr_size;
+    DWORD count;
+};
+
+struct import_snapshot_id
+{
+    ULONG64 dev;
+    ULONG64 ino;
+    ULONG64 mtime;
+    ULONG64 size;
+};
+
+struct import_snapshot_entry
+{
+    struct import_snapshot_id importer;   /* file id of the importing module */
+    struct import_snapshot_id exporter;   /* file id of the exporting builtin */
+    DWORD                     thunk_rva;  /* rva of the import address table in the importer */
+    DWORD                     count;      /* number of entries in the import address table */
+    /* followed by count export rvas, relative to the exporter base */
+};
+
+struct import_snapshot_bind
+{
+    struct list                  entry;   /* entry in the snapshot hash table */
+    struct import_snapshot_entry data;
+    DWORD                        rvas[1];
+};
+
+static struct list import_snapshot_hash[IMPORT_SNAPSHOT_HASH_SIZE];
+static int import_snapshot_state;       /* 0: not loaded yet, 1: loaded, -1: disabled */
+static unsigned int import_snapshot_count;
+static BOOL import_snapshot_dirty;      /* entries have been added since the snapshot was loaded */
+
+static unsigned int import_snapshot_hash_entry( const struct import_snapshot_entry *data )
+{
+    return (unsigned int)(data->importer.dev ^ data->importer.ino ^ data->exporter.dev ^ data->exporter.ino ^
+                          data->thunk_rva) % IMPORT_SNAPSHOT_HASH_SIZE;
+}
+
+static char *get_import_snapshot_name( const char *suffix )
+{
+    const char *config_dir = wine_get_config_dir();
+    char *name;
+
+    if (!config_dir) return NULL;
+    if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, strlen(config_dir) + 64 ))) return NULL;
+    sprintf( name, "%s/.import-snapshot-%u%s", config_dir, (unsigned int)sizeof(void *) * 8, suffix );
+    return name;
+}
+
+/* get the modification time of a module file in nanoseconds */
+static ULONGLONG get_file_mtime( const struct stat *st )
+{
+    ULONGLONG ret = (ULONGLONG)st->st_mtime * 1000000000;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    ret += st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    ret += st->st_mtimespec.tv_nsec;
+#endif
+    return ret;
+}
+
+static void get_import_snapshot_id( const WINE_MODREF *wm, struct import_snapshot_id *id )
+{
+    id->dev   = wm->dev;
+    id->ino   = wm->ino;
+    id->mtime = wm->mtime;
+    id->size  = wm->file_size;
+}
+
+static BOOL add_import_snapshot_entry( const struct import_snapshot_entry *data, const DWORD *rvas )
+{
+    struct import_snapshot_bind *bind;
+
+    if (!(bind = RtlAllocateHeap( GetProcessHeap(), 0,
+                                  offsetof( struct import_snapshot_bind, rvas[data->count] ))))
+        return FALSE;
+    bind->data = *data;
+    memcpy( bind->rvas, rvas, data->count * sizeof(*rvas) );
+    list_add_head( &import_snapshot_hash[import_snapshot_hash_entry( data )], &bind->entry );
+    import_snapshot_count++;
+    return TRUE;
+}
+
+/***********************************************************************
+ *		load_import_snapshot
+ *
+ * Load the import snapshot of the prefix the first time it is needed.
+ * The loader_section must be locked while calling this function.
+ */
+static void load_import_snapshot(void)
+{
+    const struct import_snapshot_header *header;
+    const struct import_snapshot_entry *data;
+    struct stat st;
+    char *name, *buffer = NULL, *ptr, *end;
+    unsigned int i;
+    int fd;
+
+    import_snapshot_state = -1;
+    if (TRACE_ON(relay) || TRACE_ON(snoop)) return;  /* relay thunks must not be bypassed */
+    for (i = 0; i < IMPORT_SNAPSHOT_HASH_SIZE; i++) list_init( &import_snapshot_hash[i] );
+    import_snapshot_state = 1;
+
+    if (!(name = get_import_snapshot_name( "" ))) return;
+    fd = open( name, O_RDONLY );
+    RtlFreeHeap( GetProcessHeap(), 0, name );
+    if (fd == -1) return;
+
+    if (fstat( fd, &st ) == -1 || st.st_size < (off_t)sizeof(*header) || st.st_size > IMPORT_SNAPSHOT_MAX_SIZE)
+        goto done;
+    if (!(buffer = RtlAllocateHeap( GetProcessHeap(), 0, st.st_size ))) goto done;
+    if (pread( fd, buffer, st.st_size, 0 ) != st.st_size) goto done;
+
+    header = (const struct import_snapshot_header *)buffer;
+    if (header->magic != IMPORT_SNAPSHOT_MAGIC || header->version != IMPORT_SNAPSHOT_VERSION ||
+        header->ptr_size != sizeof(void *))
+        goto done;
+
+    ptr = buffer + sizeof(*header);
+    end = buffer + st.st_size;
+    for (i = 0; i < header->count; i++)
+    {
+        data = (const struct import_snapshot_entry *)ptr;
+        if (end - ptr < sizeof(*data)) break;
+        if ((end - ptr - sizeof(*data)) / sizeof(DWORD) < data->count) break;
+        if (!add_import_snapshot_entry( data, (const DWORD *)(data + 1) )) break;
+        ptr += sizeof(*data) + data->count * sizeof(DWORD);
+    }
+    TRACE_(imports)( "loaded %u entries from import snapshot\n", import_snapshot_count );
+
+done:
+    RtlFreeHeap( GetProcessHeap(), 0, buffer );
+    close( fd );
+}
+
+/***********************************************************************
+ *		save_import_snapshot
+ *
+ * Write the import snapshot back to disk if new entries have been added.
+ * The loader_section must be locked while calling this function.
+ */
+static void save_import_snapshot(void)
+{
+    struct import_snapshot_header *header;
+    struct import_snapshot_bind *bind;
+    char *name = NULL, *tmp_name = NULL, *buffer = NULL, *ptr;
+    SIZE_T size = sizeof(*header);
+    unsigned int i;
+    BOOL ret;
+    int fd;
+
+    if (import_snapshot_state != 1 || !import_snapshot_dirty) return;
+    import_snapshot_dirty = FALSE;
+
+    for (i = 0; i < IMPORT_SNAPSHOT_HASH_SIZE; i++)
+        LIST_FOR_EACH_ENTRY( bind, &import_snapshot_hash[i], struct import_snapshot_bind, entry )
+            size += sizeof(bind->data) + bind->data.count * sizeof(DWORD);
+
+    if (!(name = get_import_snapshot_name( "" ))) goto done;
+    if (size > IMPORT_SNAPSHOT_MAX_SIZE)
+    {
+        /* too many stale entries, let the next process start from scratch */
+        unlink( name );
+        goto done;
+    }
+    if (!(tmp_name = get_import_snapshot_name( ".XXXXXX" ))) goto done;
+    if (!(buffer = RtlAllocateHeap( GetProcessHeap(), 0, size ))) goto done;
+
+    header = (struct import_snapshot_header *)buffer;
+    header->magic    = IMPORT_SNAPSHOT_MAGIC;
+    header->version  = IMPORT_SNAPSHOT_VERSION;
+    header->ptr_size = sizeof(void *);
+    header->count    = import_snapshot_count;
+    ptr = buffer + sizeof(*header);
+    for (i = 0; i < IMPORT_SNAPSHOT_HASH_SIZE; i++)
+    {
+        LIST_FOR_EACH_ENTRY( bind, &import_snapshot_hash[i], struct import_snapshot_bind, entry )
+        {
+            memcpy( ptr, &bind->data, sizeof(bind->data) );
+            ptr += sizeof(bind->data);
+            memcpy( ptr, bind->rvas, bind->data.count * sizeof(DWORD) );
+            ptr += bind->data.count * sizeof(DWORD);
+        }
+    }
+
+    /* write a new file and rename it over the old one, so that other processes never see a partial snapshot */
+    if ((fd = mkstemp( tmp_name )) == -1) goto done;
+    ret = write( fd, buffer, size ) == size;
+    if (close( fd )) ret = FALSE;
+    if (!ret || rename( tmp_name, name ) == -1) unlink( tmp_name );
+    else TRACE_(imports)( "saved %u entries to import snapshot\n", import_snapshot_count );
+
+done:
+    RtlFreeHeap( GetProcessHeap(), 0, buffer );
+    RtlFreeHeap( GetProcessHeap(), 0, tmp_name );
+    RtlFreeHeap( GetProcessHeap(), 0, name );
+}
+
+/***********************************************************************
+ *		use_import_snapshot
+ *
+ * Check whether the imports from a given module can be bound through the snapshot.
+ */
+static BOOL use_import_snapshot( const WINE_MODREF *importer, const WINE_MODREF *exporter )
+{
+    if (!importer || !importer->ino || !exporter->ino) return FALSE;
+    if (!(exporter->ldr.Flags & LDR_WINE_INTERNAL)) return FALSE;
+    if (!import_snapshot_state) load_import_snapshot();
+    return import_snapshot_state == 1;
+}
+
+/***********************************************************************
+ *		bind_snapshot_imports
+ *
+ * Fill an import address table from the snapshot; return FALSE if it is not there.
+ */
+static BOOL bind_snapshot_imports( const WINE_MODREF *importer, const WINE_MODREF *exporter,
+                                   DWORD thunk_rva, IMAGE_THUNK_DATA *thunk_list, DWORD count )
+{
+    struct import_snapshot_entry key;
+    struct import_snapshot_bind *bind;
+    ULONG_PTR base = (ULONG_PTR)exporter->ldr.DllBase;
+    DWORD i;
+
+    get_import_snapshot_id( importer, &key.importer );
+    get_import_snapshot_id( exporter, &key.exporter );
+    key.thunk_rva = thunk_rva;
+    key.count = count;
+
+    LIST_FOR_EACH_ENTRY( bind, &import_snapshot_hash[import_snapshot_hash_entry( &key )],
+                         struct import_snapshot_bind, entry )
+    {
+        if (memcmp( &bind->data, &key, sizeof(key) )) continue;
+        for (i = 0; i < count; i++) if (bind->rvas[i] >= exporter->ldr.SizeOfImage) return FALSE;
+        for (i = 0; i < count; i++) thunk_list[i].u1.Function = base + bind->rvas[i];
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/***********************************************************************
+ *		record_snapshot_imports
+ *
+ * Add a resolved import address table to the snapshot. Tables that contain
+ * forwarded exports or stubs are not recorded, they are outside of the exporter.
+ */
+static void record_snapshot_imports( const WINE_MODREF *importer, const WINE_MODREF *exporter,
+                                     DWORD thunk_rva, const IMAGE_THUNK_DATA *thunk_list, DWORD count )
+{
+    struct import_snapshot_entry data;
+    ULONG_PTR base = (ULONG_PTR)exporter->ldr.DllBase;
+    DWORD i, *rvas;
+
+    for (i = 0; i < count; i++)
+        if (thunk_list[i].u1.Function - base >= exporter->ldr.SizeOfImage) return;
+
+    if (!(rvas = RtlAllocateHeap( GetProcessHeap(), 0, count * sizeof(*rvas) ))) return;
+    for (i = 0; i < count; i++) rvas[i] = thunk_list[i].u1.Function - base;
+
+    get_import_snapshot_id( importer, &data.importer );
+    get_import_snapshot_id( exporter, &data.exporter );
+    data.thunk_rva = thunk_rva;
+    data.count = count;
+    if (add_import_snapshot_entry( &data, rvas )) import_snapshot_dirty = TRUE;
+    RtlFreeHeap( GetProcessHeap(), 0, rvas );
+}
+
+
 /*************************************************************************
  *		import_dll
  *
@@ -876,7 +1329,8 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
     DWORD len = strlen(name);
     PVOID protect_base;
     SIZE_T protect_size = 0;
-    DWORD protect_old;
+    DWORD protect_old, count;
+    BOOL snapshot;
 
     thunk_list = get_rva( module, (DWORD)descr->FirstThunk );
     if (descr->u.OriginalFirstThunk)
@@ -923,6 +1377,7 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
     /* unprotect the import address table since it can be located in
      * readonly section */
     while (import_list[protect_size].u1.Ordinal) protect_size++;
+    count = protect_size;
     protect_base = thunk_list;
     protect_size *= sizeof(*thunk_list);
     NtProtectVirtualMemory( NtCurrentProcess(), &protect_base,
@@ -957,6 +1412,17 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
         goto done;
     }
 
+    /* the module is the current one being fixed up, unless we are called for a delayed import */
+    if ((snapshot = current_modref && current_modref->ldr.DllBase == module &&
+                    use_import_snapshot( current_modref, wmImp )))
+    {
+        if (bind_snapshot_imports( current_modref, wmImp, descr->FirstThunk, thunk_list, count ))
+        {
+            TRACE_(imports)( "bound %u imports from %s through the snapshot\n", count, name );
+            goto done;
+        }
+    }
+
     while (import_list->u1.Ordinal)
     {
         if (IMAGE_SNAP_BY_ORDINAL(import_list->u1.Ordinal))
@@ -995,6 +1461,8 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
         thunk_list++;
     }
 
+    if (snapshot) record_snapshot_imports( current_modref, wmImp, descr->FirstThunk, thunk_list - count, count );
+
 done:
     /* restore old protection of the import address table */
     NtProtectVirtualMemory( NtCurrentProcess(), &protect_base, &protect_size, protect_old, &protect_old );
@@ -2227,6 +2695,22 @@ static NTSTATUS build_so_dll_module( const WCHAR *load_path, const UNICODE_STRIN
 
     if (!(wm = alloc_module( module, nt_name, TRUE ))) return STATUS_NO_MEMORY;
 
+#ifdef HAVE_DLADDR
+    {
+        Dl_info info;
+        struct stat st;
+
+        /* identify the .so file, the import snapshot is validated against it */
+        if (dladdr( module, &info ) && !stat( info.dli_fname, &st ))
+        {
+            wm->dev = st.st_dev;
+            wm->ino = st.st_ino;
+            wm->mtime = get_file_mtime( &st );
+            wm->file_size = st.st_size;
+        }
+    }
+#endif
+
     virtual_create_builtin_view( module );
 
     if (!(flags & DONT_RESOLVE_DLL_REFERENCES) &&
@@ -2890,6 +3374,8 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, const UNICODE_STRING *nt_nam
 
     wm->dev = st->st_dev;
     wm->ino = st->st_ino;
+    wm->mtime = get_file_mtime( st );
+    wm->file_size = st->st_size;
     if (image_info->loader_flags) wm->ldr.Flags |= LDR_COR_IMAGE;
     if (image_info->image_flags & IMAGE_FLAGS_ComPlusILOnly) wm->ldr.Flags |= LDR_COR_ILONLY;
 
@@ -3684,6 +4170,7 @@ NTSTATUS WINAPI DECLSPEC_HOTPATCH LdrLoadDll(LPCWSTR path_name, DWORD flags,
         }
     }
     *hModule = (wm) ? wm->ldr.DllBase : NULL;
+    save_import_snapshot();
 
     RtlLeaveCriticalSection( &loader_section );
     return nts;
@@ -4082,6 +4569,15 @@ void WINAPI LdrShutdownProcess(void)
 
     process_detaching = TRUE;
     process_detach();
+    heap_profile_shutdown();
+
+    if (TRACE_ON(exports))
+    {
+        LIST_ENTRY *mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList, *entry;
+
+        for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+            trace_export_stats( CONTAINING_RECORD( entry, WINE_MODREF, ldr.InLoadOrderLinks ));
+    }
 }
 
 
@@ -4187,6 +4683,8 @@ static void free_modref( WINE_MODREF *wm )
     if (wm->so_handle) dlclose( wm->so_handle );
     NtUnmapViewOfSection( NtCurrentProcess(), wm->ldr.DllBase );
     if (cached_modref == wm) cached_modref = NULL;
+    unload_generation++;
+    free_export_cache( wm );
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
@@ -4399,6 +4897,7 @@ void WINAPI LdrInitializeThunk( CONTEXT *context, void **entry, ULONG_PTR unknow
             NtTerminateProcess( GetCurrentProcess(), status );
         }
         imports_fixup_done = TRUE;
+        save_import_snapshot();
     }
 
     RtlAcquirePebLock();
@@ -871,7 +871,7 @@
 @ stub RtlQueryProcessBackTraceInformation
 @ stdcall RtlQueryProcessDebugInformation(long long ptr)
 @ stub RtlQueryProcessHeapInformation
-@ stub RtlQueryProcessLockInformation
+@ stdcall RtlQueryProcessLockInformation(ptr)
 @ stub RtlQueryProperties
 @ stub RtlQueryPropertyNames
 @ stub RtlQueryPropertySet
@@ -95,6 +95,31 @@ extern void virtual_init(void) DECLSPEC_HIDDEN;
 extern void virtual_init_threading(void) DECLSPEC_HIDDEN;
 extern void fill_cpu_info(void) DECLSPEC_HIDDEN;
 extern void heap_set_debug_flags( HANDLE handle ) DECLSPEC_HIDDEN;
+extern void heap_profile_shutdown(void) DECLSPEC_HIDDEN;
+
+/* exported, but not declared in the public headers */
+extern PSLIST_ENTRY WINAPI RtlInterlockedPushListSListEx( PSLIST_HEADER list, PSLIST_ENTRY first,
+                                                          PSLIST_ENTRY last, ULONG count );
+extern USHORT WINAPI RtlCaptureStackBackTrace( ULONG skip, ULONG count, PVOID *buffer, ULONG *hash );
+
+/* Wine-specific heap information class, available when heap profiling
+ * is enabled with the WINEHEAPPROFILE environment variable */
+
+#define HeapWineProfileInformation ((HEAP_INFORMATION_CLASS)0x1000)
+
+typedef struct _HEAP_WINE_PROFILE_INFORMATION
+{
+    ULONGLONG LiveBytes;        /* bytes currently allocated */
+    ULONGLONG PeakBytes;        /* max. value of LiveBytes */
+    ULONGLONG AllocCount;       /* number of allocations */
+    ULONGLONG FreeCount;        /* number of frees */
+    ULONGLONG CommittedBytes;   /* committed size of the heap */
+    ULONGLONG FreeBytes;        /* free space in the committed size */
+    ULONGLONG LargestFreeBlock; /* size of the largest free block */
+    ULONG     SampleRate;       /* one allocation out of SampleRate is sampled */
+    ULONG     LiveSamples;      /* number of sampled allocations still in use */
+} HEAP_WINE_PROFILE_INFORMATION;
+
 extern void init_unix_codepage(void) DECLSPEC_HIDDEN;
 extern void init_locale( HMODULE module ) DECLSPEC_HIDDEN;
 extern void init_user_process_params( SIZE_T data_size ) DECLSPEC_HIDDEN;
@@ -129,12 +154,16 @@ extern unsigned int server_queue_process_apc( HANDLE process, const apc_call_t *
 extern int server_remove_fd_from_cache( HANDLE handle ) DECLSPEC_HIDDEN;
 extern int server_get_unix_fd( HANDLE handle, unsigned int access, int *unix_fd,
                                int *needs_close, enum server_fd_type *type, unsigned int *options ) DECLSPEC_HIDDEN;
+extern NTSTATUS server_get_fd_info( HANDLE handle, enum server_fd_type *type,
+                                    unsigned int *access, unsigned int *options ) DECLSPEC_HIDDEN;
 extern int receive_fd( obj_handle_t *handle ) DECLSPEC_HIDDEN;
 extern int server_pipe( int fd[2] ) DECLSPEC_HIDDEN;
 extern NTSTATUS alloc_object_attributes( const OBJECT_ATTRIBUTES *attr, struct object_attributes **ret,
                                          data_size_t *ret_len ) DECLSPEC_HIDDEN;
 extern NTSTATUS validate_open_object_attributes( const OBJECT_ATTRIBUTES *attr ) DECLSPEC_HIDDEN;
 extern void *server_get_shared_memory( HANDLE thread ) DECLSPEC_HIDDEN;
+extern NTSTATUS server_get_shared_handle( HANDLE handle, unsigned int *flags, unsigned int *access,
+                                          unsigned int *type, ULONGLONG *object ) DECLSPEC_HIDDEN;
 
 /* module handling */
 extern LIST_ENTRY tls_links DECLSPEC_HIDDEN;
@@ -198,6 +227,7 @@ extern NTSTATUS virtual_map_section( HANDLE handle, PVOID *addr_ptr, unsigned sh
                                      const LARGE_INTEGER *offset_ptr, SIZE_T *size_ptr, ULONG alloc_type,
                                      ULONG protect, pe_image_info_t *image_info ) DECLSPEC_HIDDEN;
 extern void virtual_get_system_info( SYSTEM_BASIC_INFORMATION *info ) DECLSPEC_HIDDEN;
+extern SIZE_T virtual_get_large_page_size(void) DECLSPEC_HIDDEN;
 extern NTSTATUS virtual_create_builtin_view( void *base ) DECLSPEC_HIDDEN;
 extern NTSTATUS virtual_alloc_thread_stack( INITIAL_TEB *stack, SIZE_T reserve_size,
                                             SIZE_T commit_size, SIZE_T *pthread_size ) DECLSPEC_HIDDEN;
@@ -235,6 +265,23 @@ extern int ntdll_wcstoumbs( const WCHAR* src, DWORD srclen, char* dst, DWORD dst
 extern int CDECL NTDLL__vsnprintf( char *str, SIZE_T len, const char *format, __ms_va_list args ) DECLSPEC_HIDDEN;
 extern int CDECL NTDLL__vsnwprintf( WCHAR *str, SIZE_T len, const WCHAR *format, __ms_va_list args ) DECLSPEC_HIDDEN;
 
+/* layout of DEBUG_BUFFER.LockInformation */
+typedef struct
+{
+    ULONG NumberOfLocks;
+    DEBUG_LOCK_INFORMATION Locks[1];
+} DEBUG_LOCKS;
+
+/* pause instruction for spin-wait loops */
+static inline void small_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__( "rep;nop" : : : "memory" );
+#else
+    __asm__ __volatile__( "" : : : "memory" );
+#endif
+}
+
 #ifdef __WINE_WINE_PORT_H
 
 /* inline version of RtlEnterCriticalSection */
@@ -247,9 +247,21 @@ NTSTATUS WINAPI NtQueryObject(IN HANDLE handle,
     case ObjectDataInformation:
         {
             OBJECT_DATA_INFORMATION* p = ptr;
+            unsigned int flags;
 
             if (len < sizeof(*p)) return STATUS_INVALID_BUFFER_SIZE;
 
+            if ((status = server_get_shared_handle( handle, &flags, NULL, NULL, NULL )) != STATUS_NOT_SUPPORTED)
+            {
+                if (status == STATUS_SUCCESS)
+                {
+                    p->InheritHandle = (flags & HANDLE_FLAG_INHERIT) != 0;
+                    p->ProtectFromClose = (flags & HANDLE_FLAG_PROTECT_FROM_CLOSE) != 0;
+                    if (used_len) *used_len = sizeof(*p);
+                }
+                break;
+            }
+
             SERVER_START_REQ( set_handle_info )
             {
                 req->handle = wine_server_obj_handle( handle );
@@ -40,10 +40,123 @@
 #include "wine/debug.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(reg);
+WINE_DECLARE_DEBUG_CHANNEL(regcache);
 
 /* maximum length of a value name in bytes (without terminating null) */
 #define MAX_VALUE_LENGTH (16383 * sizeof(WCHAR))
 
+/* value cache, keyed by server key object and value name, and valid as long
+ * as the server registry sequence number doesn't change */
+
+#define REG_CACHE_ENTRIES   256   /* number of cache entries, must be a power of 2 */
+#define REG_CACHE_NAME_LEN  64    /* max. length of a cached value name in chars */
+#define REG_CACHE_DATA_LEN  128   /* max. size of cached value data */
+
+struct reg_cache_entry
+{
+    ULONGLONG    object;                    /* id of the key object, 0 if unused */
+    unsigned int seq;                       /* registry sequence number of the query */
+    NTSTATUS     status;                    /* STATUS_SUCCESS or STATUS_OBJECT_NAME_NOT_FOUND */
+    ULONG        type;                      /* value type */
+    DWORD        data_len;                  /* length of the value data */
+    USHORT       name_len;                  /* length of the value name in bytes */
+    WCHAR        name[REG_CACHE_NAME_LEN];  /* value name */
+    BYTE         data[REG_CACHE_DATA_LEN];  /* value data */
+};
+
+static struct reg_cache_entry *reg_cache;
+static unsigned int reg_cache_hits, reg_cache_misses;
+
+static RTL_CRITICAL_SECTION reg_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG reg_cache_section_debug =
+{
+    0, 0, &reg_cache_section,
+    { &reg_cache_section_debug.ProcessLocksList, &reg_cache_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": reg_cache_section") }
+};
+static RTL_CRITICAL_SECTION reg_cache_section = { &reg_cache_section_debug, -1, 0, 0, 0, 0 };
+
+/* return the cache slot of a value */
+static struct reg_cache_entry *get_reg_cache_entry( ULONGLONG object, const UNICODE_STRING *name )
+{
+    unsigned int i, hash = (unsigned int)object;
+
+    for (i = 0; i < name->Length / sizeof(WCHAR); i++)
+        hash = hash * 65599 + RtlUpcaseUnicodeChar( name->Buffer[i] );
+    return &reg_cache[hash & (REG_CACHE_ENTRIES - 1)];
+}
+
+/* retrieve a value from the cache */
+/* on a miss, object is set to the key id if the value can be added to the cache afterwards */
+static BOOL reg_cache_lookup( HANDLE handle, const UNICODE_STRING *name, ULONGLONG *object,
+                              unsigned int *seq, NTSTATUS *status, ULONG *type,
+                              void *data, DWORD size, DWORD *total )
+{
+    const shmglobal_t *shm = server_get_shared_memory( 0 );
+    struct reg_cache_entry *entry;
+    unsigned int access;
+    BOOL ret = FALSE;
+
+    *object = 0;
+    *seq = 0;
+    if (!shm || name->Length > sizeof(entry->name)) return FALSE;
+    if (server_get_shared_handle( handle, NULL, &access, NULL, object ) || !(access & KEY_QUERY_VALUE))
+    {
+        *object = 0;
+        return FALSE;
+    }
+    *seq = __atomic_load_n( &shm->registry_seq, __ATOMIC_ACQUIRE );
+
+    RtlEnterCriticalSection( &reg_cache_section );
+    if (reg_cache)
+    {
+        entry = get_reg_cache_entry( *object, name );
+        if (entry->object == *object && entry->seq == *seq &&
+            !RtlCompareUnicodeStrings( entry->name, entry->name_len / sizeof(WCHAR),
+                                       name->Buffer, name->Length / sizeof(WCHAR), TRUE ))
+        {
+            *status = entry->status;
+            *type   = entry->type;
+            *total  = entry->data_len;
+            if (size) memcpy( data, entry->data, min( size, entry->data_len ));
+            ret = TRUE;
+        }
+    }
+    if (ret) reg_cache_hits++;
+    else reg_cache_misses++;
+    if (!((reg_cache_hits + reg_cache_misses) % 1024))
+        TRACE_(regcache)( "%u hits, %u misses\n", reg_cache_hits, reg_cache_misses );
+    RtlLeaveCriticalSection( &reg_cache_section );
+    return ret;
+}
+
+/* add the result of a value query to the cache */
+static void reg_cache_insert( ULONGLONG object, unsigned int seq, const UNICODE_STRING *name,
+                              NTSTATUS status, ULONG type, const void *data, DWORD len )
+{
+    struct reg_cache_entry *entry;
+
+    if (len > REG_CACHE_DATA_LEN) return;
+
+    RtlEnterCriticalSection( &reg_cache_section );
+    if (!reg_cache)
+        reg_cache = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                     REG_CACHE_ENTRIES * sizeof(*reg_cache) );
+    if (reg_cache)
+    {
+        entry = get_reg_cache_entry( object, name );
+        entry->object   = object;
+        entry->seq      = seq;
+        entry->status   = status;
+        entry->type     = type;
+        entry->data_len = len;
+        entry->name_len = name->Length;
+        memcpy( entry->name, name->Buffer, name->Length );
+        memcpy( entry->data, data, len );
+    }
+    RtlLeaveCriticalSection( &reg_cache_section );
+}
+
 /******************************************************************************
  * NtCreateKey [NTDLL.@]
  * ZwCreateKey [NTDLL.@]
@@ -535,7 +648,10 @@ NTSTATUS WINAPI DECLSPEC_HOTPATCH NtQueryValueKey( HANDLE handle, const UNICODE_
 {
     NTSTATUS ret;
     UCHAR *data_ptr;
-    unsigned int fixed_size, min_size;
+    unsigned int fixed_size, min_size, seq;
+    ULONGLONG object;
+    DWORD size, total;
+    ULONG type;
 
     TRACE( "(%p,%s,%d,%p,%d)\n", handle, debugstr_us(name), info_class, info, length );
 
@@ -573,21 +689,33 @@ NTSTATUS WINAPI DECLSPEC_HOTPATCH NtQueryValueKey( HANDLE handle, const UNICODE_
         return STATUS_INVALID_PARAMETER;
     }
 
-    SERVER_START_REQ( get_key_value )
+    size = (length > fixed_size && data_ptr) ? length - fixed_size : 0;
+
+    if (!reg_cache_lookup( handle, name, &object, &seq, &ret, &type, data_ptr, size, &total ))
     {
-        req->hkey = wine_server_obj_handle( handle );
-        wine_server_add_data( req, name->Buffer, name->Length );
-        if (length > fixed_size && data_ptr) wine_server_set_reply( req, data_ptr, length - fixed_size );
-        if (!(ret = wine_server_call( req )))
+        SERVER_START_REQ( get_key_value )
         {
-            copy_key_value_info( info_class, info, length, reply->type,
-                                 name->Length, reply->total );
-            *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : reply->total);
-            if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
-            else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
+            req->hkey = wine_server_obj_handle( handle );
+            wine_server_add_data( req, name->Buffer, name->Length );
+            if (size) wine_server_set_reply( req, data_ptr, size );
+            ret   = wine_server_call( req );
+            type  = reply->type;
+            total = reply->total;
+            /* we can only cache the value if we got all of its data */
+            if (object && (!ret || ret == STATUS_OBJECT_NAME_NOT_FOUND) &&
+                wine_server_reply_size( reply ) == total)
+                reg_cache_insert( object, seq, name, ret, type, data_ptr, total );
         }
+        SERVER_END_REQ;
+    }
+
+    if (!ret)
+    {
+        copy_key_value_info( info_class, info, length, type, name->Length, total );
+        *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : total);
+        if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
+        else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
     }
-    SERVER_END_REQ;
     return ret;
 }
 
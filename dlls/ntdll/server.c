@@ -142,6 +142,7 @@ timeout_t server_start_time = 0;  /* time of server startup */
 sigset_t server_block_set;  /* signals to block during server calls */
 static int fd_socket = -1;  /* socket to exchange file descriptors with the server */
 static pid_t server_pid;
+static const shared_handle_t *shared_handles;  /* shared memory mirror of the handle table */
 
 RTL_CRITICAL_SECTION fd_cache_section;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -935,11 +936,19 @@ union fd_cache_entry
 
 C_ASSERT( sizeof(union fd_cache_entry) == sizeof(LONG64) );
 
+/* handle metadata which doesn't fit in the fd cache entry, written before the entry is set */
+struct fd_cache_info
+{
+    unsigned int access;    /* full access rights of the handle */
+};
+
 #define FD_CACHE_BLOCK_SIZE  (65536 / sizeof(union fd_cache_entry))
 #define FD_CACHE_ENTRIES     128
 
 static union fd_cache_entry *fd_cache[FD_CACHE_ENTRIES];
 static union fd_cache_entry fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
+static struct fd_cache_info *fd_cache_info[FD_CACHE_ENTRIES];
+static struct fd_cache_info fd_cache_initial_info[FD_CACHE_BLOCK_SIZE];
 
 static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
 {
@@ -968,16 +977,23 @@ static BOOL add_fd_to_cache( HANDLE handle, int fd, enum server_fd_type type,
 
     if (!fd_cache[entry])  /* do we need to allocate a new block of entries? */
     {
-        if (!entry) fd_cache[0] = fd_cache_initial_block;
+        if (!entry)
+        {
+            fd_cache_info[0] = fd_cache_initial_info;
+            fd_cache[0] = fd_cache_initial_block;
+        }
         else
         {
-            void *ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * sizeof(union fd_cache_entry),
-                                        PROT_READ | PROT_WRITE, 0 );
+            void *ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * (sizeof(union fd_cache_entry) +
+                                        sizeof(struct fd_cache_info)), PROT_READ | PROT_WRITE, 0 );
             if (ptr == MAP_FAILED) return FALSE;
+            fd_cache_info[entry] = (struct fd_cache_info *)((union fd_cache_entry *)ptr + FD_CACHE_BLOCK_SIZE);
             fd_cache[entry] = ptr;
         }
     }
 
+    fd_cache_info[entry][idx].access = access;
+
     /* store fd+1 so that 0 can be used as the unset value */
     cache.s.fd = fd + 1;
     cache.s.type = type;
@@ -1014,6 +1030,29 @@ static inline NTSTATUS get_cached_fd( HANDLE handle, int *fd, enum server_fd_typ
 }
 
 
+/***********************************************************************
+ *           get_cached_fd_info
+ *
+ * Retrieve the type, full access rights and options of a cached handle.
+ */
+static NTSTATUS get_cached_fd_info( HANDLE handle, enum server_fd_type *type,
+                                    unsigned int *access, unsigned int *options )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+    union fd_cache_entry cache;
+
+    if (entry >= FD_CACHE_ENTRIES || !fd_cache[entry]) return STATUS_INVALID_HANDLE;
+
+    cache.data = interlocked_cmpxchg64( &fd_cache[entry][idx].data, 0, 0 );
+    if (!cache.data || cache.s.type == FD_TYPE_INVALID) return STATUS_INVALID_HANDLE;
+
+    *type    = cache.s.type;
+    *access  = fd_cache_info[entry][idx].access;
+    *options = cache.s.options;
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           server_remove_fd_from_cache
  */
@@ -1118,6 +1157,30 @@ done:
 }
 
 
+/***********************************************************************
+ *           server_get_fd_info
+ *
+ * Retrieve the type, access rights and options of a handle from the fd
+ * cache, adding the fd to the cache first if necessary. Returns
+ * STATUS_NOT_SUPPORTED if the fd can't be cached and the server has to be
+ * asked instead.
+ */
+NTSTATUS server_get_fd_info( HANDLE handle, enum server_fd_type *type,
+                             unsigned int *access, unsigned int *options )
+{
+    NTSTATUS status;
+    int fd, needs_close;
+
+    if (!get_cached_fd_info( handle, type, access, options )) return STATUS_SUCCESS;
+
+    if ((status = server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, NULL ))) return status;
+    if (needs_close) close( fd );
+
+    if (get_cached_fd_info( handle, type, access, options )) return STATUS_NOT_SUPPORTED;
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           server_get_shared_memory_fd
  *
@@ -1162,6 +1225,74 @@ static inline BOOL experimental_SHARED_MEMORY( void )
 }
 
 
+/***********************************************************************
+ *           server_map_shared_handles
+ *
+ * Map the shared memory mirror of the process handle table.
+ */
+static void server_map_shared_handles(void)
+{
+    SIZE_T size = SHARED_HANDLE_ENTRIES * sizeof(shared_handle_t);
+    obj_handle_t dummy;
+    sigset_t sigset;
+    void *mem = NULL;
+    int fd = -1;
+
+    if (!experimental_SHARED_MEMORY()) return;
+
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+    SERVER_START_REQ( get_shared_handles )
+    {
+        if (!wine_server_call( req )) fd = receive_fd( &dummy );
+    }
+    SERVER_END_REQ;
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+
+    if (fd == -1) return;
+    virtual_map_shared_memory( fd, &mem, 0, &size, PAGE_READONLY );
+    close( fd );
+    shared_handles = mem;
+}
+
+
+/***********************************************************************
+ *           server_get_shared_handle
+ *
+ * Retrieve the flags, access, type and object id of a handle without a server call.
+ * Returns STATUS_NOT_SUPPORTED if the server has to be asked instead.
+ */
+NTSTATUS server_get_shared_handle( HANDLE handle, unsigned int *flags, unsigned int *access,
+                                   unsigned int *type, ULONGLONG *object )
+{
+    const shared_handle_t *entry;
+    unsigned int seq, index, entry_flags, entry_access, entry_type;
+    ULONGLONG entry_object;
+
+    if (!shared_handles || (ULONG_PTR)handle > 0xffffffff || ((ULONG_PTR)handle & 3))
+        return STATUS_NOT_SUPPORTED;
+    index = (HandleToULong( handle ) >> 2) - 1;
+    if (index >= SHARED_HANDLE_ENTRIES) return STATUS_NOT_SUPPORTED;  /* also catches handle 0 */
+    entry = &shared_handles[index];
+
+    do
+    {
+        while ((seq = __atomic_load_n( &entry->seq, __ATOMIC_ACQUIRE )) & 1) ;
+        entry_flags  = entry->flags;
+        entry_access = entry->access;
+        entry_type   = entry->type;
+        entry_object = entry->object;
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    } while (__atomic_load_n( &entry->seq, __ATOMIC_RELAXED ) != seq);
+
+    if (!(entry_flags & SHARED_HANDLE_IN_USE)) return STATUS_INVALID_HANDLE;
+    if (flags) *flags = entry_flags & ~SHARED_HANDLE_IN_USE;
+    if (access) *access = entry_access;
+    if (type) *type = entry_type;
+    if (object) *object = entry_object;
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           server_get_shared_memory
  *
@@ -1693,6 +1824,8 @@ void server_init_process_done(void)
      * something is very wrong... */
     signal_init_process();
 
+    server_map_shared_handles();
+
     /* Signal the parent process to continue */
     SERVER_START_REQ( init_process_done )
     {
@@ -1537,31 +1537,36 @@ NTSTATUS WINAPI NtRemoveIoCompletion( HANDLE CompletionPort, PULONG_PTR Completi
 NTSTATUS WINAPI NtRemoveIoCompletionEx( HANDLE port, FILE_IO_COMPLETION_INFORMATION *info, ULONG count,
                                         ULONG *written, LARGE_INTEGER *timeout, BOOLEAN alertable )
 {
+    struct completion_msg msgs[64];
     NTSTATUS ret;
-    ULONG i = 0;
+    ULONG i = 0, j, size;
 
     TRACE("%p %p %u %p %p %u\n", port, info, count, written, timeout, alertable);
 
     for (;;)
     {
+        /* retrieve as many queued completions as possible with each request */
         while (i < count)
         {
-            SERVER_START_REQ( remove_completion )
+            SERVER_START_REQ( remove_completions )
             {
                 req->handle = wine_server_obj_handle( port );
-                if (!(ret = wine_server_call( req )))
-                {
-                    info[i].CompletionKey             = reply->ckey;
-                    info[i].CompletionValue           = reply->cvalue;
-                    info[i].IoStatusBlock.Information = reply->information;
-                    info[i].IoStatusBlock.u.Status    = reply->status;
-                }
+                wine_server_set_reply( req, msgs, min( count - i, ARRAY_SIZE(msgs) ) * sizeof(*msgs) );
+                ret = wine_server_call( req );
+                size = wine_server_reply_size( reply ) / sizeof(*msgs);
             }
             SERVER_END_REQ;
 
             if (ret != STATUS_SUCCESS) break;
 
-            ++i;
+            for (j = 0; j < size; j++, i++)
+            {
+                info[i].CompletionKey             = msgs[j].ckey;
+                info[i].CompletionValue           = msgs[j].cvalue;
+                info[i].IoStatusBlock.Information = msgs[j].information;
+                info[i].IoStatusBlock.u.Status    = msgs[j].status;
+            }
+            if (size < ARRAY_SIZE(msgs)) break;  /* queue is empty */
         }
 
         if (i || ret != STATUS_PENDING)
@@ -1858,6 +1863,77 @@ static NTSTATUS fast_try_acquire_srw_exclusive( RTL_SRWLOCK *lock )
     return ret;
 }
 
+static NTSTATUS fast_try_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    int new, old, *futex;
+    NTSTATUS ret;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    if (!(futex = get_futex( &lock->Ptr )))
+        return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *futex;
+
+        if (!(old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT)
+                && !(old & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+        {
+            /* Not locked exclusive, and no exclusive waiters. We can try to
+             * grab it. */
+            new = old + SRWLOCK_FUTEX_SHARED_OWNERS_INC;
+            assert(new & SRWLOCK_FUTEX_SHARED_OWNERS_MASK);
+            ret = STATUS_SUCCESS;
+        }
+        else
+        {
+            new = old;
+            ret = STATUS_TIMEOUT;
+        }
+    } while (interlocked_cmpxchg( futex, new, old ) != old);
+
+    return ret;
+}
+
+/* Maximum number of spins before blocking on a contended lock, and recent number
+ * of spins needed to acquire the locks, indexed by a hash of their address. */
+#define SRWLOCK_MAX_SPIN 4000
+static int srwlock_spin_estimates[64];
+
+/* Spin while the lock is owned by others, hoping that it is released soon.
+ * Returns TRUE if it could be acquired. */
+static BOOL spin_acquire_srw( RTL_SRWLOCK *lock, int *futex, BOOL exclusive )
+{
+    int *estimate = &srwlock_spin_estimates[((ULONG_PTR)lock >> 4) % ARRAY_SIZE(srwlock_spin_estimates)];
+    int count, limit, busy_mask;
+    BOOL ret = FALSE;
+
+    if (NtCurrentTeb()->Peb->NumberOfProcessors <= 1) return FALSE;
+
+    if (exclusive) busy_mask = SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT | SRWLOCK_FUTEX_SHARED_OWNERS_MASK;
+    else busy_mask = SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT | SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK;
+
+    /* spin for up to twice as long as recently needed */
+    limit = min( SRWLOCK_MAX_SPIN, *estimate * 2 + 16 );
+    for (count = 0; count < limit; count++)
+    {
+        int val = *futex;
+
+        /* don't spin in front of threads that are already blocked */
+        if (val & (SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK | SRWLOCK_FUTEX_SHARED_WAITERS_BIT)) break;
+        if (!(val & busy_mask) &&
+            (exclusive ? fast_try_acquire_srw_exclusive( lock ) : fast_try_acquire_srw_shared( lock )) == STATUS_SUCCESS)
+        {
+            ret = TRUE;
+            break;
+        }
+        small_pause();
+    }
+    *estimate += (count - *estimate) / 8;
+    return ret;
+}
+
 static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
 {
     int old, new, *futex;
@@ -1868,6 +1944,10 @@ static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
     if (!(futex = get_futex( &lock->Ptr )))
         return STATUS_NOT_IMPLEMENTED;
 
+    if (fast_try_acquire_srw_exclusive( lock ) == STATUS_SUCCESS ||
+        spin_acquire_srw( lock, futex, TRUE ))
+        return STATUS_SUCCESS;
+
     /* Atomically increment the exclusive waiter count. */
     do
     {
@@ -1907,39 +1987,6 @@ static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
     return STATUS_SUCCESS;
 }
 
-static NTSTATUS fast_try_acquire_srw_shared( RTL_SRWLOCK *lock )
-{
-    int new, old, *futex;
-    NTSTATUS ret;
-
-    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
-
-    if (!(futex = get_futex( &lock->Ptr )))
-        return STATUS_NOT_IMPLEMENTED;
-
-    do
-    {
-        old = *futex;
-
-        if (!(old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT)
-                && !(old & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
-        {
-            /* Not locked exclusive, and no exclusive waiters. We can try to
-             * grab it. */
-            new = old + SRWLOCK_FUTEX_SHARED_OWNERS_INC;
-            assert(new & SRWLOCK_FUTEX_SHARED_OWNERS_MASK);
-            ret = STATUS_SUCCESS;
-        }
-        else
-        {
-            new = old;
-            ret = STATUS_TIMEOUT;
-        }
-    } while (interlocked_cmpxchg( futex, new, old ) != old);
-
-    return ret;
-}
-
 static NTSTATUS fast_acquire_srw_shared( RTL_SRWLOCK *lock )
 {
     int old, new, *futex;
@@ -1950,6 +1997,10 @@ static NTSTATUS fast_acquire_srw_shared( RTL_SRWLOCK *lock )
     if (!(futex = get_futex( &lock->Ptr )))
         return STATUS_NOT_IMPLEMENTED;
 
+    if (fast_try_acquire_srw_shared( lock ) == STATUS_SUCCESS ||
+        spin_acquire_srw( lock, futex, FALSE ))
+        return STATUS_SUCCESS;
+
     for (;;)
     {
         do
@@ -603,6 +603,109 @@ static void test_tp_simple(void)
     CloseHandle(semaphore);
 }
 
+struct simple_throughput_info
+{
+    TP_POOL *pool;
+    TP_WORK *work;
+    LONG count;
+    LONG total;
+    HANDLE done;
+};
+
+static void CALLBACK simple_throughput_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    struct simple_throughput_info *info = userdata;
+    if (InterlockedIncrement(&info->count) == info->total)
+        SetEvent(info->done);
+}
+
+static void CALLBACK work_throughput_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    simple_throughput_cb(instance, userdata);
+}
+
+static DWORD WINAPI simple_throughput_thread(void *arg)
+{
+    struct simple_throughput_info *info = arg;
+    TP_CALLBACK_ENVIRON environment;
+    NTSTATUS status;
+    int i;
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = info->pool;
+    for (i = 0; i < 5000; i++)
+    {
+        if (info->work)
+        {
+            pTpPostWork(info->work);
+            continue;
+        }
+        status = pTpSimpleTryPost(simple_throughput_cb, info, &environment);
+        ok(!status, "TpSimpleTryPost failed with status %x\n", status);
+    }
+    return 0;
+}
+
+static void run_tp_throughput(struct simple_throughput_info *info, const char *name)
+{
+    HANDLE threads[4];
+    DWORD result, start;
+    int i;
+
+    info->count = 0;
+    info->total = ARRAY_SIZE(threads) * 5000;
+    ResetEvent(info->done);
+
+    /* post callbacks from several threads at once */
+    start = GetTickCount();
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+    {
+        threads[i] = CreateThread(NULL, 0, simple_throughput_thread, info, 0, NULL);
+        ok(threads[i] != NULL, "CreateThread failed %u\n", GetLastError());
+    }
+    result = WaitForMultipleObjects(ARRAY_SIZE(threads), threads, TRUE, 10000);
+    ok(result == WAIT_OBJECT_0, "WaitForMultipleObjects returned %u\n", result);
+    result = WaitForSingleObject(info->done, 10000);
+    ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+    ok(info->count == info->total, "expected %u %s callbacks, got %u\n", info->total, name, info->count);
+    trace("%u %s callbacks took %u ms\n", info->total, name, GetTickCount() - start);
+
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+        CloseHandle(threads[i]);
+}
+
+static void test_tp_simple_throughput(void)
+{
+    struct simple_throughput_info info;
+    TP_CALLBACK_ENVIRON environment;
+    NTSTATUS status;
+
+    status = pTpAllocPool(&info.pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+    pTpSetPoolMaxThreads(info.pool, 8);
+
+    info.done = CreateEventA(NULL, TRUE, FALSE, NULL);
+    ok(info.done != NULL, "CreateEventA failed %u\n", GetLastError());
+
+    /* simple callbacks are queued on the per-thread shards */
+    info.work = NULL;
+    run_tp_throughput(&info, "simple");
+
+    /* work objects still go through the pool lock, for comparison */
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = info.pool;
+    status = pTpAllocWork(&info.work, work_throughput_cb, &info, &environment);
+    ok(!status, "TpAllocWork failed with status %x\n", status);
+    run_tp_throughput(&info, "work");
+    pTpWaitForWork(info.work, FALSE);
+    pTpReleaseWork(info.work);
+
+    CloseHandle(info.done);
+    pTpReleasePool(info.pool);
+}
+
 static void CALLBACK work_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
 {
     trace("Running work callback\n");
@@ -2242,6 +2345,7 @@ START_TEST(threadpool)
         return;
 
     test_tp_simple();
+    test_tp_simple_throughput();
     test_tp_work();
     test_tp_work_scheduler();
     test_tp_group_wait();
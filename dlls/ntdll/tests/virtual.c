@@ -530,6 +530,204 @@ static void test_user_shared_data(void)
 #endif
 }
 
+static void test_many_views(void)
+{
+    static const unsigned int count = 512, pages = 16;
+    MEMORY_BASIC_INFORMATION info;
+    void **views, *addr;
+    unsigned int i, j;
+    DWORD start, query_time, protect_time;
+    NTSTATUS status;
+    SIZE_T size;
+    ULONG old_prot;
+
+    views = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*views));
+    for (i = 0; i < count; i++)
+    {
+        views[i] = NULL;
+        size = pages * page_size;
+        status = NtAllocateVirtualMemory(NtCurrentProcess(), &views[i], 0, &size, MEM_RESERVE, PAGE_READWRITE);
+        ok(status == STATUS_SUCCESS, "NtAllocateVirtualMemory returned %08x\n", status);
+        size = pages / 2 * page_size;
+        status = NtAllocateVirtualMemory(NtCurrentProcess(), &views[i], 0, &size, MEM_COMMIT, PAGE_READWRITE);
+        ok(status == STATUS_SUCCESS, "NtAllocateVirtualMemory returned %08x\n", status);
+        addr = (char *)views[i] + 2 * page_size;
+        size = 2 * page_size;
+        status = NtProtectVirtualMemory(NtCurrentProcess(), &addr, &size, PAGE_READONLY, &old_prot);
+        ok(status == STATUS_SUCCESS, "NtProtectVirtualMemory returned %08x\n", status);
+        ok(old_prot == PAGE_READWRITE, "got old protection %#x\n", old_prot);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        status = NtQueryVirtualMemory(NtCurrentProcess(), views[i], MemoryBasicInformation, &info, sizeof(info), NULL);
+        ok(status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status);
+        ok(info.AllocationBase == views[i], "got allocation base %p, expected %p\n", info.AllocationBase, views[i]);
+        ok(info.RegionSize == 2 * page_size, "got region size %#lx\n", info.RegionSize);
+        ok(info.Protect == PAGE_READWRITE, "got protection %#x\n", info.Protect);
+
+        addr = (char *)views[i] + 3 * page_size;
+        status = NtQueryVirtualMemory(NtCurrentProcess(), addr, MemoryBasicInformation, &info, sizeof(info), NULL);
+        ok(status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status);
+        ok(info.BaseAddress == addr, "got base %p, expected %p\n", info.BaseAddress, addr);
+        ok(info.RegionSize == page_size, "got region size %#lx\n", info.RegionSize);
+        ok(info.Protect == PAGE_READONLY, "got protection %#x\n", info.Protect);
+
+        addr = (char *)views[i] + 4 * page_size;
+        status = NtQueryVirtualMemory(NtCurrentProcess(), addr, MemoryBasicInformation, &info, sizeof(info), NULL);
+        ok(status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status);
+        ok(info.RegionSize == 4 * page_size, "got region size %#lx\n", info.RegionSize);
+        ok(info.State == MEM_COMMIT, "got state %#x\n", info.State);
+
+        addr = (char *)views[i] + pages / 2 * page_size;
+        status = NtQueryVirtualMemory(NtCurrentProcess(), addr, MemoryBasicInformation, &info, sizeof(info), NULL);
+        ok(status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status);
+        ok(info.RegionSize == pages / 2 * page_size, "got region size %#lx\n", info.RegionSize);
+        ok(info.State == MEM_RESERVE, "got state %#x\n", info.State);
+    }
+
+    start = GetTickCount();
+    for (j = 0; j < 100; j++)
+        for (i = 0; i < count; i++)
+            NtQueryVirtualMemory(NtCurrentProcess(), (char *)views[i] + page_size, MemoryBasicInformation,
+                                 &info, sizeof(info), NULL);
+    query_time = GetTickCount() - start;
+
+    start = GetTickCount();
+    for (j = 0; j < 100; j++)
+    {
+        for (i = 0; i < count; i++)
+        {
+            addr = views[i];
+            size = pages / 2 * page_size;
+            NtProtectVirtualMemory(NtCurrentProcess(), &addr, &size, (j & 1) ? PAGE_READWRITE : PAGE_READONLY, &old_prot);
+        }
+    }
+    protect_time = GetTickCount() - start;
+    trace("%u views: %u ms for queries, %u ms for protection changes\n", count, query_time, protect_time);
+
+    for (i = 0; i < count; i++)
+    {
+        size = 0;
+        status = NtFreeVirtualMemory(NtCurrentProcess(), &views[i], &size, MEM_RELEASE);
+        ok(status == STATUS_SUCCESS, "NtFreeVirtualMemory returned %08x\n", status);
+    }
+    HeapFree(GetProcessHeap(), 0, views);
+}
+
+static void test_write_watch_protection(void)
+{
+    static const unsigned int pages = 16;
+    char *base, *neighbor;
+    void *results[16], *addr;
+    MEMORY_BASIC_INFORMATION info;
+    ULONG_PTR count;
+    ULONG granularity, old_prot;
+    NTSTATUS status;
+    SIZE_T size;
+
+    /* place a second view right after the write watch view, so that an update running
+     * past the end of the range would touch it */
+    addr = NULL;
+    size = 2 * pages * page_size;
+    status = NtAllocateVirtualMemory(NtCurrentProcess(), &addr, 0, &size, MEM_RESERVE, PAGE_NOACCESS);
+    ok(status == STATUS_SUCCESS, "NtAllocateVirtualMemory returned %08x\n", status);
+    size = 0;
+    status = NtFreeVirtualMemory(NtCurrentProcess(), &addr, &size, MEM_RELEASE);
+    ok(status == STATUS_SUCCESS, "NtFreeVirtualMemory returned %08x\n", status);
+
+    base = addr;
+    size = pages * page_size;
+    status = NtAllocateVirtualMemory(NtCurrentProcess(), &addr, 0, &size,
+                                     MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE);
+    if (status == STATUS_NOT_SUPPORTED || status == STATUS_INVALID_PARAMETER_5)
+    {
+        win_skip("MEM_WRITE_WATCH is not supported\n");
+        return;
+    }
+    ok(status == STATUS_SUCCESS, "NtAllocateVirtualMemory returned %08x\n", status);
+    ok(addr == base, "got base %p, expected %p\n", addr, base);
+    addr = neighbor = base + pages * page_size;
+    size = pages * page_size;
+    status = NtAllocateVirtualMemory(NtCurrentProcess(), &addr, 0, &size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(status == STATUS_SUCCESS, "NtAllocateVirtualMemory returned %08x\n", status);
+    ok(addr == neighbor, "got base %p, expected %p\n", addr, neighbor);
+
+    /* mix protections inside the write watch view */
+    addr = base + 4 * page_size;
+    size = 2 * page_size;
+    status = NtProtectVirtualMemory(NtCurrentProcess(), &addr, &size, PAGE_READONLY, &old_prot);
+    ok(status == STATUS_SUCCESS, "NtProtectVirtualMemory returned %08x\n", status);
+    ok(old_prot == PAGE_READWRITE, "got old protection %#x\n", old_prot);
+    addr = base + 8 * page_size;
+    size = 2 * page_size;
+    status = NtProtectVirtualMemory(NtCurrentProcess(), &addr, &size, PAGE_EXECUTE_READWRITE, &old_prot);
+    ok(status == STATUS_SUCCESS, "NtProtectVirtualMemory returned %08x\n", status);
+    ok(old_prot == PAGE_READWRITE, "got old protection %#x\n", old_prot);
+
+    base[0] = 1;
+    base[8 * page_size] = 2;
+    base[(pages - 1) * page_size] = 3;
+    neighbor[0] = 4;
+
+    count = ARRAY_SIZE(results);
+    status = NtGetWriteWatch(NtCurrentProcess(), WRITE_WATCH_FLAG_RESET, base, pages * page_size,
+                             results, &count, &granularity);
+    ok(status == STATUS_SUCCESS, "NtGetWriteWatch returned %08x\n", status);
+    ok(count == 3, "got count %lu\n", count);
+    ok(results[0] == base, "got %p, expected %p\n", results[0], base);
+    ok(results[1] == base + 8 * page_size, "got %p, expected %p\n", results[1], base + 8 * page_size);
+    ok(results[2] == base + (pages - 1) * page_size, "got %p, expected %p\n",
+       results[2], base + (pages - 1) * page_size);
+
+    /* the reset has to write-protect the whole range across the protection changes */
+    base[page_size] = 5;
+    base[9 * page_size] = 6;
+    count = ARRAY_SIZE(results);
+    status = NtGetWriteWatch(NtCurrentProcess(), 0, base, pages * page_size, results, &count, &granularity);
+    ok(status == STATUS_SUCCESS, "NtGetWriteWatch returned %08x\n", status);
+    ok(count == 2, "got count %lu\n", count);
+    ok(results[0] == base + page_size, "got %p, expected %p\n", results[0], base + page_size);
+    ok(results[1] == base + 9 * page_size, "got %p, expected %p\n", results[1], base + 9 * page_size);
+
+    status = NtResetWriteWatch(NtCurrentProcess(), base, pages * page_size);
+    ok(status == STATUS_SUCCESS, "NtResetWriteWatch returned %08x\n", status);
+
+    /* change the protection of a range with mixed protections and watch states */
+    addr = base + 2 * page_size;
+    size = 8 * page_size;
+    status = NtProtectVirtualMemory(NtCurrentProcess(), &addr, &size, PAGE_READWRITE, &old_prot);
+    ok(status == STATUS_SUCCESS, "NtProtectVirtualMemory returned %08x\n", status);
+    ok(old_prot == PAGE_READWRITE, "got old protection %#x\n", old_prot);
+    base[4 * page_size] = 7;
+
+    count = ARRAY_SIZE(results);
+    status = NtGetWriteWatch(NtCurrentProcess(), 0, base, pages * page_size, results, &count, &granularity);
+    ok(status == STATUS_SUCCESS, "NtGetWriteWatch returned %08x\n", status);
+    ok(count == 1, "got count %lu\n", count);
+    ok(results[0] == base + 4 * page_size, "got %p, expected %p\n", results[0], base + 4 * page_size);
+
+    /* the neighboring view is left alone */
+    status = NtQueryVirtualMemory(NtCurrentProcess(), neighbor, MemoryBasicInformation, &info, sizeof(info), NULL);
+    ok(status == STATUS_SUCCESS, "NtQueryVirtualMemory returned %08x\n", status);
+    ok(info.AllocationBase == neighbor, "got allocation base %p, expected %p\n", info.AllocationBase, neighbor);
+    ok(info.RegionSize == pages * page_size, "got region size %#lx\n", info.RegionSize);
+    ok(info.Protect == PAGE_READWRITE, "got protection %#x\n", info.Protect);
+    neighbor[page_size] = 8;
+    neighbor[(pages - 1) * page_size] = 9;
+    ok(neighbor[0] == 4, "got %d\n", neighbor[0]);
+
+    ok(base[0] == 1, "got %d\n", base[0]);
+    ok(base[8 * page_size] == 2, "got %d\n", base[8 * page_size]);
+
+    size = 0;
+    status = NtFreeVirtualMemory(NtCurrentProcess(), (void **)&neighbor, &size, MEM_RELEASE);
+    ok(status == STATUS_SUCCESS, "NtFreeVirtualMemory returned %08x\n", status);
+    size = 0;
+    status = NtFreeVirtualMemory(NtCurrentProcess(), (void **)&base, &size, MEM_RELEASE);
+    ok(status == STATUS_SUCCESS, "NtFreeVirtualMemory returned %08x\n", status);
+}
+
 START_TEST(virtual)
 {
     HMODULE mod;
@@ -563,4 +761,6 @@ START_TEST(virtual)
     test_RtlCreateUserStack();
     test_NtMapViewOfSection();
     test_user_shared_data();
+    test_many_views();
+    test_write_watch_protection();
 }
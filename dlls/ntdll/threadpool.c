@@ -115,8 +115,17 @@ struct timer_queue
  */
 
 #define THREADPOOL_WORKER_TIMEOUT 5000
+#define THREADPOOL_NUM_SHARDS 8
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
+/* queue of simple callbacks which don't belong to a cleanup group */
+struct threadpool_shard
+{
+    RTL_SRWLOCK             lock;
+    /* order matches TP_CALLBACK_PRIORITY - high, normal, low */
+    struct list             pools[3];
+};
+
 /* internal threadpool representation */
 struct threadpool
 {
@@ -126,12 +135,18 @@ struct threadpool
     CRITICAL_SECTION        cs;
     /* Pools of work items, locked via .cs, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
     struct list             pools[3];
-    RTL_CONDITION_VARIABLE  update_event;
+    /* Simple callbacks without group bypass .cs, each submitting thread uses
+     * its own shard, idle workers steal from the other shards. */
+    struct threadpool_shard shards[THREADPOOL_NUM_SHARDS];
+    LONG                    num_shard_items[3];
+    /* incremented whenever work is queued, idle workers wait on it */
+    LONG                    wake_seq;
+    LONG                    num_sleeping;
     /* information about worker threads, locked via .cs */
     int                     max_workers;
     int                     min_workers;
-    int                     num_workers;
-    int                     num_busy_workers;
+    int                     num_workers;      /* also read without .cs, see threadpool_worker_proc */
+    LONG                    num_busy_workers; /* modified with interlocked functions */
     HANDLE                  compl_port;
     TP_POOL_STACK_INFORMATION stack_info;
 };
@@ -1390,7 +1405,7 @@ static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
     {
         interlocked_inc( &pool->refcount );
         pool->num_workers++;
-        pool->num_busy_workers++;
+        interlocked_inc( &pool->num_busy_workers );
         NtClose( thread );
     }
     return status;
@@ -1849,7 +1864,7 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
 {
     IMAGE_NT_HEADERS *nt = RtlImageNtHeader( NtCurrentTeb()->Peb->ImageBaseAddress );
     struct threadpool *pool;
-    unsigned int i;
+    unsigned int i, j;
 
     pool = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*pool) );
     if (!pool)
@@ -1864,7 +1879,16 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
 
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
         list_init( &pool->pools[i] );
-    RtlInitializeConditionVariable( &pool->update_event );
+    for (i = 0; i < ARRAY_SIZE(pool->shards); ++i)
+    {
+        RtlInitializeSRWLock( &pool->shards[i].lock );
+        for (j = 0; j < ARRAY_SIZE(pool->shards[i].pools); ++j)
+            list_init( &pool->shards[i].pools[j] );
+    }
+    for (i = 0; i < ARRAY_SIZE(pool->num_shard_items); ++i)
+        pool->num_shard_items[i] = 0;
+    pool->wake_seq                = 0;
+    pool->num_sleeping            = 0;
 
     pool->max_workers             = 500;
     pool->min_workers             = 0;
@@ -1891,7 +1915,8 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
     assert( pool != default_threadpool );
 
     pool->shutdown = TRUE;
-    RtlWakeAllConditionVariable( &pool->update_event );
+    interlocked_inc( &pool->wake_seq );
+    RtlWakeAddressAll( &pool->wake_seq );
 }
 
 /***********************************************************************
@@ -1901,7 +1926,7 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
  */
 static BOOL tp_threadpool_release( struct threadpool *pool )
 {
-    unsigned int i;
+    unsigned int i, j;
 
     if (interlocked_dec( &pool->refcount ))
         return FALSE;
@@ -1912,6 +1937,9 @@ static BOOL tp_threadpool_release( struct threadpool *pool )
     assert( !pool->objcount );
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
         assert( list_empty( &pool->pools[i] ) );
+    for (i = 0; i < ARRAY_SIZE(pool->shards); ++i)
+        for (j = 0; j < ARRAY_SIZE(pool->shards[i].pools); ++j)
+            assert( list_empty( &pool->shards[i].pools[j] ) );
 
     pool->cs.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &pool->cs );
@@ -1971,24 +1999,29 @@ static NTSTATUS tp_threadpool_lock( struct threadpool **out, TP_CALLBACK_ENVIRON
         pool = default_threadpool;
     }
 
-    enter_critical_section( &pool->cs );
+    /* Increment objcount to ensure that the last thread doesn't terminate.
+     * An exiting worker decrements num_workers before checking objcount a
+     * last time, so the common case where threads are already running
+     * doesn't need the lock. */
+    interlocked_inc( &pool->objcount );
 
     /* Make sure that the threadpool has at least one thread. */
-    if (!pool->num_workers)
-        status = tp_new_worker_thread( pool );
-
-    /* Keep a reference, and increment objcount to ensure that the
-     * last thread doesn't terminate. */
-    if (status == STATUS_SUCCESS)
+    if (!*(volatile int *)&pool->num_workers)
     {
-        interlocked_inc( &pool->refcount );
-        pool->objcount++;
+        enter_critical_section( &pool->cs );
+        if (!pool->num_workers)
+            status = tp_new_worker_thread( pool );
+        leave_critical_section( &pool->cs );
     }
 
-    leave_critical_section( &pool->cs );
-
     if (status != STATUS_SUCCESS)
+    {
+        interlocked_dec( &pool->objcount );
         return status;
+    }
+
+    /* Keep a reference. */
+    interlocked_inc( &pool->refcount );
 
     *out = pool;
     return STATUS_SUCCESS;
@@ -2001,9 +2034,7 @@ static NTSTATUS tp_threadpool_lock( struct threadpool **out, TP_CALLBACK_ENVIRON
  */
 static void tp_threadpool_unlock( struct threadpool *pool )
 {
-    enter_critical_section( &pool->cs );
-    pool->objcount--;
-    leave_critical_section( &pool->cs );
+    interlocked_dec( &pool->objcount );
     tp_threadpool_release( pool );
 }
 
@@ -2155,6 +2186,61 @@ static void tp_object_prio_queue( struct threadpool_object *object )
     list_add_tail( &object->pool->pools[object->priority], &object->pool_entry );
 }
 
+static inline unsigned int threadpool_get_home_shard( void )
+{
+    return (HandleToULong( NtCurrentTeb()->ClientId.UniqueThread ) >> 2) % THREADPOOL_NUM_SHARDS;
+}
+
+/***********************************************************************
+ *           threadpool_wake_worker    (internal)
+ *
+ * Notifies an idle worker thread that new work is available. The caller
+ * has to queue the work item before.
+ */
+static void threadpool_wake_worker( struct threadpool *pool )
+{
+    interlocked_inc( &pool->wake_seq );
+    if (*(volatile LONG *)&pool->num_sleeping)
+        RtlWakeAddressSingle( &pool->wake_seq );
+}
+
+/***********************************************************************
+ *           tp_object_submit_simple    (internal)
+ *
+ * Submits a simple callback which doesn't belong to a cleanup group.
+ * Nobody else can reference such an object, so it is queued on the
+ * shard of the current thread without taking the pool lock.
+ */
+static void tp_object_submit_simple( struct threadpool_object *object )
+{
+    struct threadpool *pool = object->pool;
+    struct threadpool_shard *shard = &pool->shards[threadpool_get_home_shard()];
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    interlocked_inc( &object->refcount );
+
+    RtlAcquireSRWLockExclusive( &shard->lock );
+    list_add_tail( &shard->pools[object->priority], &object->pool_entry );
+    interlocked_inc( &pool->num_shard_items[object->priority] );
+    RtlReleaseSRWLockExclusive( &shard->lock );
+
+    /* Start new worker threads if required. The item is queued before the
+     * worker counts are read, an exiting worker either sees it or has
+     * already decremented num_workers, see threadpool_worker_proc. */
+    if (*(volatile LONG *)&pool->num_busy_workers >= *(volatile int *)&pool->num_workers)
+    {
+        enter_critical_section( &pool->cs );
+        if (pool->num_busy_workers >= pool->num_workers &&
+            pool->num_workers < pool->max_workers)
+            status = tp_new_worker_thread( pool );
+        leave_critical_section( &pool->cs );
+    }
+
+    /* No new thread started - wake up one existing thread. */
+    if (status != STATUS_SUCCESS)
+        threadpool_wake_worker( pool );
+}
+
 /***********************************************************************
  *           tp_object_submit    (internal)
  *
@@ -2169,6 +2255,12 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     assert( !object->shutdown );
     assert( !pool->shutdown );
 
+    if (object->type == TP_OBJECT_TYPE_SIMPLE && !object->group)
+    {
+        tp_object_submit_simple( object );
+        return;
+    }
+
     enter_critical_section( &pool->cs );
 
     /* Start new worker threads if required. */
@@ -2189,7 +2281,7 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
     if (status != STATUS_SUCCESS)
     {
         assert( pool->num_workers > 0 );
-        RtlWakeConditionVariable( &pool->update_event );
+        threadpool_wake_worker( pool );
     }
 
     leave_critical_section( &pool->cs );
@@ -2328,29 +2420,269 @@ static struct list *threadpool_get_next_item( const struct threadpool *pool )
     return ptr;
 }
 
+/***********************************************************************
+ *           threadpool_get_next_shard_item    (internal)
+ *
+ * Dequeues a simple callback with the given priority, starting with the
+ * home shard of the worker and stealing from the other shards otherwise.
+ */
+static struct threadpool_object *threadpool_get_next_shard_item( struct threadpool *pool,
+                                                                 unsigned int prio, unsigned int home )
+{
+    struct threadpool_shard *shard;
+    struct list *ptr;
+    unsigned int i;
+
+    if (*(volatile LONG *)&pool->num_shard_items[prio] <= 0)
+        return NULL;
+
+    for (i = 0; i < ARRAY_SIZE(pool->shards); ++i)
+    {
+        shard = &pool->shards[(home + i) % ARRAY_SIZE(pool->shards)];
+        if (list_empty( &shard->pools[prio] ))
+            continue;
+
+        RtlAcquireSRWLockExclusive( &shard->lock );
+        if ((ptr = list_head( &shard->pools[prio] )))
+        {
+            list_remove( ptr );
+            interlocked_dec( &pool->num_shard_items[prio] );
+        }
+        RtlReleaseSRWLockExclusive( &shard->lock );
+
+        if (ptr)
+            return LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+    }
+
+    return NULL;
+}
+
+/***********************************************************************
+ *           threadpool_has_pending    (internal)
+ *
+ * Checks whether any work is queued. Must be called with .cs held.
+ */
+static BOOL threadpool_has_pending( const struct threadpool *pool )
+{
+    unsigned int i;
+
+    if (threadpool_get_next_item( pool ))
+        return TRUE;
+
+    for (i = 0; i < ARRAY_SIZE(pool->num_shard_items); ++i)
+        if (*(volatile LONG *)&pool->num_shard_items[i] > 0)
+            return TRUE;
+
+    return FALSE;
+}
+
+/***********************************************************************
+ *           threadpool_run_callback    (internal)
+ *
+ * Executes the callback of a dequeued threadpool object, followed by the
+ * finalization callback and the cleanup tasks set up by the callback.
+ */
+static void threadpool_run_callback( struct threadpool_object *object, struct threadpool_instance *instance,
+                                     TP_WAIT_RESULT wait_result, struct io_completion *completion )
+{
+    TP_CALLBACK_INSTANCE *callback_instance;
+    NTSTATUS status;
+
+    /* Initialize threadpool instance struct. */
+    callback_instance = (TP_CALLBACK_INSTANCE *)instance;
+    instance->object                    = object;
+    instance->threadid                  = GetCurrentThreadId();
+    instance->associated                = TRUE;
+    instance->may_run_long              = object->may_run_long;
+    instance->cleanup.critical_section  = NULL;
+    instance->cleanup.mutex             = NULL;
+    instance->cleanup.semaphore         = NULL;
+    instance->cleanup.semaphore_count   = 0;
+    instance->cleanup.event             = NULL;
+    instance->cleanup.library           = NULL;
+
+    switch (object->type)
+    {
+        case TP_OBJECT_TYPE_SIMPLE:
+        {
+            TRACE( "executing simple callback %p(%p, %p)\n",
+                   object->u.simple.callback, callback_instance, object->userdata );
+            object->u.simple.callback( callback_instance, object->userdata );
+            TRACE( "callback %p returned\n", object->u.simple.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_WORK:
+        {
+            TRACE( "executing work callback %p(%p, %p, %p)\n",
+                   object->u.work.callback, callback_instance, object->userdata, object );
+            object->u.work.callback( callback_instance, object->userdata, (TP_WORK *)object );
+            TRACE( "callback %p returned\n", object->u.work.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_TIMER:
+        {
+            TRACE( "executing timer callback %p(%p, %p, %p)\n",
+                   object->u.timer.callback, callback_instance, object->userdata, object );
+            object->u.timer.callback( callback_instance, object->userdata, (TP_TIMER *)object );
+            TRACE( "callback %p returned\n", object->u.timer.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_WAIT:
+        {
+            TRACE( "executing wait callback %p(%p, %p, %p, %u)\n",
+                   object->u.wait.callback, callback_instance, object->userdata, object, wait_result );
+            object->u.wait.callback( callback_instance, object->userdata, (TP_WAIT *)object, wait_result );
+            TRACE( "callback %p returned\n", object->u.wait.callback );
+            break;
+        }
+
+        case TP_OBJECT_TYPE_IO:
+        {
+            TRACE( "executing I/O callback %p(%p, %p, %#lx, %p, %p)\n",
+                    object->u.io.callback, callback_instance, object->userdata,
+                    completion->cvalue, &completion->iosb, (TP_IO *)object );
+            object->u.io.callback( callback_instance, object->userdata,
+                    (void *)completion->cvalue, &completion->iosb, (TP_IO *)object );
+            TRACE( "callback %p returned\n", object->u.io.callback );
+            break;
+        }
+
+        default:
+            assert(0);
+            break;
+    }
+
+    /* Execute finalization callback. */
+    if (object->finalization_callback)
+    {
+        TRACE( "executing finalization callback %p(%p, %p)\n",
+               object->finalization_callback, callback_instance, object->userdata );
+        object->finalization_callback( callback_instance, object->userdata );
+        TRACE( "callback %p returned\n", object->finalization_callback );
+    }
+
+    /* Execute cleanup tasks. */
+    if (instance->cleanup.critical_section)
+    {
+        RtlLeaveCriticalSection( instance->cleanup.critical_section );
+    }
+    if (instance->cleanup.mutex)
+    {
+        status = NtReleaseMutant( instance->cleanup.mutex, NULL );
+        if (status != STATUS_SUCCESS) return;
+    }
+    if (instance->cleanup.semaphore)
+    {
+        status = NtReleaseSemaphore( instance->cleanup.semaphore, instance->cleanup.semaphore_count, NULL );
+        if (status != STATUS_SUCCESS) return;
+    }
+    if (instance->cleanup.event)
+    {
+        status = NtSetEvent( instance->cleanup.event, NULL );
+        if (status != STATUS_SUCCESS) return;
+    }
+    if (instance->cleanup.library)
+    {
+        LdrUnloadDll( instance->cleanup.library );
+    }
+}
+
+/***********************************************************************
+ *           threadpool_run_shard_item    (internal)
+ *
+ * Executes a simple callback dequeued from a shard. The object is private
+ * to the worker thread, so its state is updated without the pool lock.
+ */
+static void threadpool_run_shard_item( struct threadpool *pool, struct threadpool_object *object )
+{
+    struct threadpool_instance instance;
+
+    object->num_associated_callbacks++;
+    object->num_running_callbacks++;
+
+    threadpool_run_callback( object, &instance, 0, NULL );
+
+    interlocked_dec( &pool->num_busy_workers );
+
+    /* Simple callbacks are automatically shutdown after execution. */
+    object->shutdown = TRUE;
+    object->num_running_callbacks--;
+    if (instance.associated)
+        object->num_associated_callbacks--;
+
+    tp_object_release( object );
+}
+
 /***********************************************************************
  *           threadpool_worker_proc    (internal)
  */
 static void CALLBACK threadpool_worker_proc( void *param )
 {
-    TP_CALLBACK_INSTANCE *callback_instance;
     struct threadpool_instance instance;
     struct io_completion completion;
     struct threadpool *pool = param;
+    struct threadpool_object *object;
     TP_WAIT_RESULT wait_result = 0;
+    unsigned int home = threadpool_get_home_shard();
     LARGE_INTEGER timeout;
     struct list *ptr;
     NTSTATUS status;
+    unsigned int i;
+    LONG seq;
 
     TRACE( "starting worker thread for pool %p\n", pool );
 
     enter_critical_section( &pool->cs );
-    pool->num_busy_workers--;
+    interlocked_dec( &pool->num_busy_workers );
     for (;;)
     {
-        while ((ptr = threadpool_get_next_item( pool )))
+        for (;;)
         {
-            struct threadpool_object *object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+            /* Callbacks with a higher priority are always processed first, no
+             * matter if they were queued in the pool or in one of the shards. */
+            object = NULL;
+            for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+            {
+                if ((ptr = list_head( &pool->pools[i] )))
+                    break;
+                if ((object = threadpool_get_next_shard_item( pool, i, home )))
+                    break;
+            }
+
+            if (object)
+            {
+                interlocked_inc( &pool->num_busy_workers );
+                leave_critical_section( &pool->cs );
+                threadpool_run_shard_item( pool, object );
+
+                /* Keep draining the shards without the pool lock as long as there
+                 * is no other work with a higher priority. */
+                for (;;)
+                {
+                    object = NULL;
+                    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+                    {
+                        if (!list_empty( &pool->pools[i] ))
+                            break;
+                        if ((object = threadpool_get_next_shard_item( pool, i, home )))
+                            break;
+                    }
+                    if (!object) break;
+
+                    interlocked_inc( &pool->num_busy_workers );
+                    threadpool_run_shard_item( pool, object );
+                }
+
+                enter_critical_section( &pool->cs );
+                continue;
+            }
+
+            if (!ptr) break;
+
+            object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
             assert( object->num_pending_callbacks > 0 );
 
             /* If further pending callbacks are queued, move the work item to
@@ -2375,113 +2707,13 @@ static void CALLBACK threadpool_worker_proc( void *param )
             /* Leave critical section and do the actual callback. */
             object->num_associated_callbacks++;
             object->num_running_callbacks++;
-            pool->num_busy_workers++;
+            interlocked_inc( &pool->num_busy_workers );
             leave_critical_section( &pool->cs );
 
-            /* Initialize threadpool instance struct. */
-            callback_instance = (TP_CALLBACK_INSTANCE *)&instance;
-            instance.object                     = object;
-            instance.threadid                   = GetCurrentThreadId();
-            instance.associated                 = TRUE;
-            instance.may_run_long               = object->may_run_long;
-            instance.cleanup.critical_section   = NULL;
-            instance.cleanup.mutex              = NULL;
-            instance.cleanup.semaphore          = NULL;
-            instance.cleanup.semaphore_count    = 0;
-            instance.cleanup.event              = NULL;
-            instance.cleanup.library            = NULL;
-
-            switch (object->type)
-            {
-                case TP_OBJECT_TYPE_SIMPLE:
-                {
-                    TRACE( "executing simple callback %p(%p, %p)\n",
-                           object->u.simple.callback, callback_instance, object->userdata );
-                    object->u.simple.callback( callback_instance, object->userdata );
-                    TRACE( "callback %p returned\n", object->u.simple.callback );
-                    break;
-                }
-
-                case TP_OBJECT_TYPE_WORK:
-                {
-                    TRACE( "executing work callback %p(%p, %p, %p)\n",
-                           object->u.work.callback, callback_instance, object->userdata, object );
-                    object->u.work.callback( callback_instance, object->userdata, (TP_WORK *)object );
-                    TRACE( "callback %p returned\n", object->u.work.callback );
-                    break;
-                }
-
-                case TP_OBJECT_TYPE_TIMER:
-                {
-                    TRACE( "executing timer callback %p(%p, %p, %p)\n",
-                           object->u.timer.callback, callback_instance, object->userdata, object );
-                    object->u.timer.callback( callback_instance, object->userdata, (TP_TIMER *)object );
-                    TRACE( "callback %p returned\n", object->u.timer.callback );
-                    break;
-                }
-
-                case TP_OBJECT_TYPE_WAIT:
-                {
-                    TRACE( "executing wait callback %p(%p, %p, %p, %u)\n",
-                           object->u.wait.callback, callback_instance, object->userdata, object, wait_result );
-                    object->u.wait.callback( callback_instance, object->userdata, (TP_WAIT *)object, wait_result );
-                    TRACE( "callback %p returned\n", object->u.wait.callback );
-                    break;
-                }
+            threadpool_run_callback( object, &instance, wait_result, &completion );
 
-                case TP_OBJECT_TYPE_IO:
-                {
-                    TRACE( "executing I/O callback %p(%p, %p, %#lx, %p, %p)\n",
-                            object->u.io.callback, callback_instance, object->userdata,
-                            completion.cvalue, &completion.iosb, (TP_IO *)object );
-                    object->u.io.callback( callback_instance, object->userdata,
-                            (void *)completion.cvalue, &completion.iosb, (TP_IO *)object );
-                    TRACE( "callback %p returned\n", object->u.io.callback );
-                    break;
-                }
-
-                default:
-                    assert(0);
-                    break;
-            }
-
-            /* Execute finalization callback. */
-            if (object->finalization_callback)
-            {
-                TRACE( "executing finalization callback %p(%p, %p)\n",
-                       object->finalization_callback, callback_instance, object->userdata );
-                object->finalization_callback( callback_instance, object->userdata );
-                TRACE( "callback %p returned\n", object->finalization_callback );
-            }
-
-            /* Execute cleanup tasks. */
-            if (instance.cleanup.critical_section)
-            {
-                RtlLeaveCriticalSection( instance.cleanup.critical_section );
-            }
-            if (instance.cleanup.mutex)
-            {
-                status = NtReleaseMutant( instance.cleanup.mutex, NULL );
-                if (status != STATUS_SUCCESS) goto skip_cleanup;
-            }
-            if (instance.cleanup.semaphore)
-            {
-                status = NtReleaseSemaphore( instance.cleanup.semaphore, instance.cleanup.semaphore_count, NULL );
-                if (status != STATUS_SUCCESS) goto skip_cleanup;
-            }
-            if (instance.cleanup.event)
-            {
-                status = NtSetEvent( instance.cleanup.event, NULL );
-                if (status != STATUS_SUCCESS) goto skip_cleanup;
-            }
-            if (instance.cleanup.library)
-            {
-                LdrUnloadDll( instance.cleanup.library );
-            }
-
-        skip_cleanup:
             enter_critical_section( &pool->cs );
-            pool->num_busy_workers--;
+            interlocked_dec( &pool->num_busy_workers );
 
             /* Simple callbacks are automatically shutdown after execution. */
             if (object->type == TP_OBJECT_TYPE_SIMPLE)
@@ -2506,22 +2738,48 @@ static void CALLBACK threadpool_worker_proc( void *param )
 
         /* Shutdown worker thread if requested. */
         if (pool->shutdown)
+        {
+            pool->num_workers--;
             break;
+        }
+
+        /* Announce that we are going to sleep before checking for work a last
+         * time, producers only wake up workers when someone is sleeping. */
+        seq = *(volatile LONG *)&pool->wake_seq;
+        interlocked_inc( &pool->num_sleeping );
+        if (threadpool_has_pending( pool ))
+        {
+            interlocked_dec( &pool->num_sleeping );
+            continue;
+        }
 
         /* Wait for new tasks or until the timeout expires. A thread only terminates
          * when no new tasks are available, and the number of threads can be
          * decreased without violating the min_workers limit. An exception is when
          * min_workers == 0, then objcount is used to detect if the last thread
          * can be terminated. */
+        leave_critical_section( &pool->cs );
         timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
-        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
-            !threadpool_get_next_item( pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
+        status = RtlWaitOnAddress( &pool->wake_seq, &seq, sizeof(seq), &timeout );
+        enter_critical_section( &pool->cs );
+        interlocked_dec( &pool->num_sleeping );
+
+        if (status == STATUS_TIMEOUT && !threadpool_has_pending( pool ) &&
+            (pool->num_workers > max( pool->min_workers, 1 ) ||
             (!pool->min_workers && !pool->objcount)))
         {
-            break;
+            /* tp_threadpool_lock and tp_object_submit_simple check num_workers
+             * without .cs, after incrementing objcount or queueing work. Announce
+             * the exit first and check again, so that either they see it and
+             * start a new thread, or we see the new work and keep running. */
+            interlocked_dec( &pool->num_workers );
+            if (!threadpool_has_pending( pool ) &&
+                (pool->num_workers >= max( pool->min_workers, 1 ) ||
+                (!pool->min_workers && !*(volatile LONG *)&pool->objcount)))
+                break;
+            interlocked_inc( &pool->num_workers );
         }
     }
-    pool->num_workers--;
     leave_critical_section( &pool->cs );
 
     TRACE( "terminating worker thread for pool %p\n", pool );
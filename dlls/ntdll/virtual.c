@@ -182,6 +182,18 @@ static BYTE **pages_vprot;
 static BYTE *pages_vprot;
 #endif
 
+/* index of the views by 64K allocation granule, to avoid walking the tree on lookups */
+#define VIEWS_INDEX_SHIFT    16
+#define VIEWS_INDEX_MAX_SIZE (16 << 20)  /* larger views are only found through the tree */
+#ifdef _WIN64  /* on 64-bit the index uses a 2-level table, like the page protection bytes */
+static const size_t views_index_shift = 16;
+static const size_t views_index_mask = (1 << 16) - 1;
+static size_t views_index_size;
+static struct file_view ***views_index;
+#else  /* on 32-bit we use a simple array with one entry per granule */
+static struct file_view **views_index;
+#endif
+
 #define MAX_DIR_ENTRY_LEN 255  /* max length of a directory entry in chars */
 
 static struct file_view *view_block_start, *view_block_end, *next_free_view;
@@ -190,6 +202,7 @@ static void *preload_reserve_start;
 static void *preload_reserve_end;
 static BOOL use_locks;
 static BOOL force_exec_prot;  /* whether to force PROT_EXEC on all PROT_READ mmaps */
+static SIZE_T large_page_size;  /* size of the host huge pages, 0 if not supported */
 
 #if defined(__i386__)
 NTSTATUS WINAPI NtProtectVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T *size_ptr,
@@ -269,6 +282,49 @@ static void set_page_vprot_bits( const void *addr, size_t size, BYTE set, BYTE c
 }
 
 
+/***********************************************************************
+ *           get_vprot_range_size
+ *
+ * Return the size of the range starting at base where the protection bits
+ * selected by mask don't change, and the protection byte of the first page.
+ * The range must be part of a view.
+ */
+static SIZE_T get_vprot_range_size( char *base, SIZE_T size, BYTE mask, BYTE *vprot )
+{
+    static const UINT_PTR byte_mult = ~(UINT_PTR)0 / 0xff;  /* 0x0101...01 */
+    size_t start = (size_t)base >> page_shift;
+    size_t end = start + (size >> page_shift);
+    size_t idx = start;
+    UINT_PTR word, mask_word;
+    const BYTE *ptr;
+
+#ifdef _WIN64
+    ptr = pages_vprot[idx >> pages_vprot_shift] + (idx & pages_vprot_mask);
+#else
+    ptr = pages_vprot + idx;
+#endif
+    *vprot = *ptr;
+
+    /* compare a byte at a time until the index is aligned */
+    for ( ; idx < end && (idx & (sizeof(UINT_PTR) - 1)); idx++, ptr++)
+        if ((*vprot ^ *ptr) & mask) return (idx - start) << page_shift;
+
+    /* then a word at a time; the tables are word-aligned so this never reads outside a chunk */
+    word = byte_mult * *vprot;
+    mask_word = byte_mult * mask;
+    for ( ; idx < end; idx += sizeof(UINT_PTR), ptr += sizeof(UINT_PTR))
+    {
+#ifdef _WIN64
+        if (!(idx & pages_vprot_mask)) ptr = pages_vprot[idx >> pages_vprot_shift];
+#endif
+        if (!((word ^ *(const UINT_PTR *)ptr) & mask_word)) continue;
+        for ( ; idx < end; idx++, ptr++) if ((*vprot ^ *ptr) & mask) break;
+        return (idx - start) << page_shift;
+    }
+    return size;
+}
+
+
 /***********************************************************************
  *           alloc_pages_vprot
  *
@@ -295,6 +351,45 @@ static BOOL alloc_pages_vprot( const void *addr, size_t size )
 }
 
 
+/***********************************************************************
+ *           get_views_index_entry
+ *
+ * Return a pointer to the index entry for a given granule, or NULL if not allocated.
+ */
+static struct file_view **get_views_index_entry( size_t idx, BOOL alloc )
+{
+#ifdef _WIN64
+    void *ptr;
+
+    if ((idx >> views_index_shift) >= views_index_size) return NULL;
+    if (!views_index[idx >> views_index_shift])
+    {
+        if (!alloc) return NULL;
+        if ((ptr = wine_anon_mmap( NULL, (views_index_mask + 1) * sizeof(**views_index),
+                                   PROT_READ | PROT_WRITE, 0 )) == (void *)-1)
+            return NULL;
+        views_index[idx >> views_index_shift] = ptr;
+    }
+    return &views_index[idx >> views_index_shift][idx & views_index_mask];
+#else
+    return &views_index[idx];
+#endif
+}
+
+
+/***********************************************************************
+ *           get_indexed_view
+ *
+ * Return the view recorded in the index for the granule containing addr.
+ * The result may not contain addr, the caller has to check.
+ */
+static inline struct file_view *get_indexed_view( const void *addr )
+{
+    struct file_view **entry = get_views_index_entry( (size_t)addr >> VIEWS_INDEX_SHIFT, FALSE );
+    return entry ? *entry : NULL;
+}
+
+
 /***********************************************************************
  *           compare_view
  *
@@ -446,12 +541,21 @@ static void VIRTUAL_Dump(void)
 static struct file_view *VIRTUAL_FindView( const void *addr, size_t size )
 {
     struct wine_rb_entry *ptr = views_tree.root;
+    struct file_view *view;
 
     if ((const char *)addr + size < (const char *)addr) return NULL; /* overflow */
 
+    if ((view = get_indexed_view( addr )) &&
+        (const char *)addr >= (const char *)view->base &&
+        (const char *)addr < (const char *)view->base + view->size)
+    {
+        if ((const char *)view->base + view->size < (const char *)addr + size) return NULL;  /* size too large */
+        return view;
+    }
+
     while (ptr)
     {
-        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+        view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
 
         if (view->base > addr) ptr = ptr->left;
         else if ((const char *)view->base + view->size <= (const char *)addr) ptr = ptr->right;
@@ -462,6 +566,20 @@ static struct file_view *VIRTUAL_FindView( const void *addr, size_t size )
 }
 
 
+/***********************************************************************
+ *           get_large_page_alignment
+ *
+ * Return the alignment to use for large page views, as a shift.
+ */
+static inline ULONG get_large_page_alignment(void)
+{
+    ULONG alignment = page_shift;
+
+    while (alignment < 21 && ((SIZE_T)1 << alignment) < large_page_size) alignment++;
+    return alignment;
+}
+
+
 /***********************************************************************
  *           get_mask
  */
@@ -844,6 +962,51 @@ static struct file_view *alloc_view(void)
 }
 
 
+/***********************************************************************
+ *           index_view
+ *
+ * Record a view in the granule index. The csVirtual section must be held by caller.
+ */
+static void index_view( struct file_view *view )
+{
+    size_t idx = (size_t)view->base >> VIEWS_INDEX_SHIFT;
+    size_t end = ((size_t)view->base + view->size - 1) >> VIEWS_INDEX_SHIFT;
+    struct file_view **entry;
+
+    if (view->size > VIEWS_INDEX_MAX_SIZE) return;
+    for ( ; idx <= end; idx++)
+        if ((entry = get_views_index_entry( idx, TRUE ))) *entry = view;
+}
+
+
+/***********************************************************************
+ *           unindex_view
+ *
+ * Remove a view from the granule index. Granules shared with a
+ * neighbouring view are given to that view.
+ * The csVirtual section must be held by caller.
+ */
+static void unindex_view( struct file_view *view )
+{
+    size_t idx = (size_t)view->base >> VIEWS_INDEX_SHIFT;
+    size_t end = ((size_t)view->base + view->size - 1) >> VIEWS_INDEX_SHIFT;
+    struct file_view **entry;
+
+    if (view->size > VIEWS_INDEX_MAX_SIZE) return;  /* never indexed */
+    for ( ; idx <= end; idx++)
+    {
+        if (!(entry = get_views_index_entry( idx, FALSE )) || *entry != view) continue;
+        *entry = NULL;
+        if (idx == end || idx == (size_t)view->base >> VIEWS_INDEX_SHIFT)
+        {
+            struct file_view *other = find_view_range( (void *)(idx << VIEWS_INDEX_SHIFT),
+                                                       1 << VIEWS_INDEX_SHIFT );
+            if (other && other != view && other->size <= VIEWS_INDEX_MAX_SIZE) *entry = other;
+        }
+    }
+}
+
+
 /***********************************************************************
  *           delete_view
  *
@@ -855,6 +1018,7 @@ static void delete_view( struct file_view *view ) /* [in] View */
     if (!(view->protect & VPROT_SYSTEM)) unmap_area( view->base, view->size );
     set_page_vprot( view->base, view->size, 0 );
     wine_rb_remove( &views_tree, &view->entry );
+    unindex_view( view );
     *(struct file_view **)view = next_free_view;
     next_free_view = view;
 }
@@ -901,6 +1065,7 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
     set_page_vprot( base, size, vprot );
 
     wine_rb_put( &views_tree, view->base, &view->entry );
+    index_view( view );
 
     *view_ret = view;
 
@@ -1011,22 +1176,28 @@ static inline int mprotect_exec( void *base, size_t size, int unix_prot )
  */
 static void mprotect_range( void *base, size_t size, BYTE set, BYTE clear )
 {
-    size_t i, count;
+    size_t count = 0, range_size;
     char *addr = ROUND_ADDR( base, page_mask );
-    int prot, next;
+    char *end = addr + ROUND_SIZE( base, size );
+    char *ptr;
+    int prot = 0, next;
+    BYTE vprot;
 
-    size = ROUND_SIZE( base, size );
-    prot = VIRTUAL_GetUnixProt( (get_page_vprot( addr ) & ~clear ) | set );
-    for (count = i = 1; i < size >> page_shift; i++, count++)
+    /* scan the protection bytes a run at a time, merging runs that map to the same unix protection */
+    for (ptr = addr; ptr < end; ptr += range_size)
     {
-        next = VIRTUAL_GetUnixProt( (get_page_vprot( addr + (count << page_shift) ) & ~clear) | set );
-        if (next == prot) continue;
-        mprotect_exec( addr, count << page_shift, prot );
-        addr += count << page_shift;
+        range_size = get_vprot_range_size( ptr, end - ptr, ~0, &vprot );
+        next = VIRTUAL_GetUnixProt( (vprot & ~clear) | set );
+        if (count && next != prot)
+        {
+            mprotect_exec( addr, count, prot );
+            addr += count;
+            count = 0;
+        }
         prot = next;
-        count = 0;
+        count += range_size;
     }
-    if (count) mprotect_exec( addr, count << page_shift, prot );
+    if (count) mprotect_exec( addr, count, prot );
 }
 
 
@@ -1287,6 +1458,20 @@ static NTSTATUS map_fixed_area( void *base, size_t size, unsigned int vprot )
     return STATUS_SUCCESS;
 }
 
+/***********************************************************************
+ *           advise_large_pages
+ *
+ * Ask the kernel to back a large page view with huge pages.
+ */
+static void advise_large_pages( struct file_view *view )
+{
+#ifdef MADV_HUGEPAGE
+    if (madvise( view->base, view->size, MADV_HUGEPAGE ) == -1)
+        WARN( "madvise %p-%p failed: %s\n", view->base, (char *)view->base + view->size, strerror(errno) );
+#endif
+}
+
+
 /***********************************************************************
  *           map_view
  *
@@ -1453,7 +1638,7 @@ done:
  */
 static SIZE_T get_committed_size( struct file_view *view, void *base, BYTE *vprot )
 {
-    SIZE_T i, start;
+    SIZE_T start;
 
     start = ((char *)base - (char *)view->base) >> page_shift;
     *vprot = get_page_vprot( base );
@@ -1478,9 +1663,7 @@ static SIZE_T get_committed_size( struct file_view *view, void *base, BYTE *vpro
         SERVER_END_REQ;
         return ret;
     }
-    for (i = start + 1; i < view->size >> page_shift; i++)
-        if ((*vprot ^ get_page_vprot( (char *)view->base + (i << page_shift) )) & VPROT_COMMITTED) break;
-    return (i - start) << page_shift;
+    return get_vprot_range_size( base, view->size - (start << page_shift), VPROT_COMMITTED, vprot );
 }
 
 
@@ -1594,6 +1777,154 @@ static NTSTATUS map_pe_header( void *ptr, size_t size, int fd, BOOL *removable )
 }
 
 
+/***********************************************************************
+ *           is_page_zero
+ */
+static inline BOOL is_page_zero( const void *page )
+{
+    const UINT_PTR *ptr = page, *end = (const UINT_PTR *)((const char *)page + page_size);
+
+    for ( ; ptr < end; ptr++) if (*ptr) return FALSE;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           map_cached_image
+ *
+ * Map the cached pages of an image prepared for the address of the view, if any.
+ */
+static BOOL map_cached_image( HANDLE hmapping, struct file_view *view )
+{
+    HANDLE pages = 0;
+    int fd, needs_close, prot = VIRTUAL_GetUnixProt( view->protect );
+    void *ptr = (void *)-1;
+
+    SERVER_START_REQ( get_image_cache )
+    {
+        req->mapping = wine_server_obj_handle( hmapping );
+        req->base    = wine_server_client_ptr( view->base );
+        if (!wine_server_call( req )) pages = wine_server_ptr_handle( reply->pages );
+    }
+    SERVER_END_REQ;
+    if (!pages) return FALSE;
+
+    if (!server_get_unix_fd( pages, 0, &fd, &needs_close, NULL, NULL ))
+    {
+        ptr = mmap( view->base, view->size, prot, MAP_FIXED | MAP_PRIVATE, fd, 0 );
+        if (needs_close) close( fd );
+    }
+    close_handle( pages );
+    if (ptr == (void *)-1) return FALSE;
+    TRACE_(module)( "using cached pages for %p-%p\n", view->base, (char *)view->base + view->size );
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           add_cached_image
+ *
+ * Store the prepared pages of an image in the server image cache, and map
+ * the view from there so that the pages are shared with other processes.
+ */
+static void add_cached_image( HANDLE hmapping, struct file_view *view )
+{
+    HANDLE pages;
+    LARGE_INTEGER size;
+    NTSTATUS status;
+    size_t start, end;
+    int fd, needs_close, prot = VIRTUAL_GetUnixProt( view->protect );
+
+    size.QuadPart = view->size;
+    if (NtCreateSection( &pages, SECTION_ALL_ACCESS, NULL, &size, PAGE_READWRITE, SEC_COMMIT, 0 )) return;
+    if (server_get_unix_fd( pages, 0, &fd, &needs_close, NULL, NULL ))
+    {
+        close_handle( pages );
+        return;
+    }
+
+    /* only write the pages that contain data, to keep the file sparse */
+    status = STATUS_SUCCESS;
+    for (start = 0; start < view->size && !status; start = end)
+    {
+        for ( ; start < view->size; start += page_size)
+            if (!is_page_zero( (char *)view->base + start )) break;
+        for (end = start; end < view->size; end += page_size)
+            if (is_page_zero( (char *)view->base + end )) break;
+        if (end > start && pwrite( fd, (char *)view->base + start, end - start, start ) != end - start)
+            status = FILE_GetNtStatus();
+    }
+
+    if (!status)
+    {
+        SERVER_START_REQ( add_image_cache )
+        {
+            req->mapping = wine_server_obj_handle( hmapping );
+            req->pages   = wine_server_obj_handle( pages );
+            req->base    = wine_server_client_ptr( view->base );
+            status = wine_server_call( req );
+        }
+        SERVER_END_REQ;
+    }
+    if (!status && mmap( view->base, view->size, prot, MAP_FIXED | MAP_PRIVATE, fd, 0 ) != (void *)-1)
+        TRACE_(module)( "added cached pages for %p-%p\n", view->base, (char *)view->base + view->size );
+
+    if (needs_close) close( fd );
+    close_handle( pages );
+}
+
+
+/***********************************************************************
+ *           relocate_image
+ *
+ * Apply the base relocations of a dll that was not mapped at its preferred
+ * address, so that the relocated pages can be shared through the image cache.
+ * Images that the loader wouldn't relocate are left alone.
+ */
+static NTSTATUS relocate_image( char *ptr, IMAGE_NT_HEADERS *nt, SIZE_T total_size )
+{
+    const IMAGE_DATA_DIRECTORY *relocs = &nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+    IMAGE_BASE_RELOCATION *rel, *end;
+    INT_PTR delta = ptr - (char *)nt->OptionalHeader.ImageBase;
+
+#if defined(__i386__)
+    if (experimental_WRITECOPY()) return STATUS_NOT_SUPPORTED;  /* write-copy pages are not writable yet */
+#endif
+    if (nt->OptionalHeader.Magic != IMAGE_NT_OPTIONAL_HDR_MAGIC) return STATUS_NOT_SUPPORTED;
+    if (nt->OptionalHeader.SectionAlignment < page_size) return STATUS_NOT_SUPPORTED;
+    if (!(nt->FileHeader.Characteristics & IMAGE_FILE_DLL)) return STATUS_NOT_SUPPORTED;
+    if (nt->FileHeader.Characteristics & IMAGE_FILE_RELOCS_STRIPPED) return STATUS_NOT_SUPPORTED;
+    if (!relocs->Size || !relocs->VirtualAddress) return STATUS_NOT_SUPPORTED;
+    if (relocs->VirtualAddress > total_size || relocs->Size > total_size - relocs->VirtualAddress)
+        return STATUS_NOT_SUPPORTED;
+
+    /* validate all the blocks first, the loader handles broken images on its own */
+    rel = (IMAGE_BASE_RELOCATION *)(ptr + relocs->VirtualAddress);
+    end = (IMAGE_BASE_RELOCATION *)(ptr + relocs->VirtualAddress + relocs->Size);
+    while (rel < end - 1 && rel->SizeOfBlock)
+    {
+        if (rel->VirtualAddress >= total_size || total_size - rel->VirtualAddress < page_size)
+            return STATUS_NOT_SUPPORTED;
+        if (rel->SizeOfBlock < sizeof(*rel) || rel->SizeOfBlock > (char *)end - (char *)rel)
+            return STATUS_NOT_SUPPORTED;
+        rel = (IMAGE_BASE_RELOCATION *)((char *)rel + rel->SizeOfBlock);
+    }
+
+    TRACE_(module)( "relocating from %p to %p\n", (void *)nt->OptionalHeader.ImageBase, ptr );
+    rel = (IMAGE_BASE_RELOCATION *)(ptr + relocs->VirtualAddress);
+    while (rel < end - 1 && rel->SizeOfBlock)
+    {
+        rel = LdrProcessRelocationBlock( ptr + rel->VirtualAddress,
+                                         (rel->SizeOfBlock - sizeof(*rel)) / sizeof(USHORT),
+                                         (USHORT *)(rel + 1), delta );
+        if (!rel) return STATUS_INVALID_IMAGE_FORMAT;
+    }
+    /* the loader uses the header base to find out whether relocations are still needed */
+    nt->OptionalHeader.ImageBase = (ULONG_PTR)ptr;
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           map_image
  *
@@ -1609,6 +1940,7 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
     IMAGE_DATA_DIRECTORY *imports;
     NTSTATUS status = STATUS_CONFLICTING_ADDRESSES;
     SIZE_T header_size, total_size = image_info->map_size;
+    BOOL cached = FALSE, private_pages = removable, shared_sections = FALSE;
     int i;
     off_t pos;
     sigset_t sigset;
@@ -1649,13 +1981,16 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
         goto error;
     }
     header_size = min( image_info->header_size, st.st_size );
-    if ((status = map_pe_header( view->base, header_size, fd, &removable )) != STATUS_SUCCESS) goto error;
+    if (!(image_info->image_flags & IMAGE_FLAGS_ImageMappedFlat))
+        cached = map_cached_image( hmapping, view );
+    if (!cached &&
+        (status = map_pe_header( view->base, header_size, fd, &removable )) != STATUS_SUCCESS) goto error;
 
     status = STATUS_INVALID_IMAGE_FORMAT;  /* generic error */
     dos = (IMAGE_DOS_HEADER *)ptr;
     nt = (IMAGE_NT_HEADERS *)(ptr + dos->e_lfanew);
     header_end = ptr + ROUND_SIZE( 0, header_size );
-    memset( ptr + header_size, 0, header_end - (ptr + header_size) );
+    if (!cached) memset( ptr + header_size, 0, header_end - (ptr + header_size) );
     if ((char *)(nt + 1) > header_end) goto error;
     header_start = (char*)&nt->OptionalHeader+nt->FileHeader.SizeOfOptionalHeader;
     if (nt->FileHeader.NumberOfSections > ARRAY_SIZE( sections )) goto error;
@@ -1668,6 +2003,9 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
     imports = nt->OptionalHeader.DataDirectory + IMAGE_DIRECTORY_ENTRY_IMPORT;
     if (!imports->Size || !imports->VirtualAddress) imports = NULL;
 
+    /* the sections have already been loaded and relocated by whoever built the cached pages */
+    if (cached) goto set_protections;
+
     /* check for non page-aligned binary */
 
     if (image_info->image_flags & IMAGE_FLAGS_ImageMappedFlat)
@@ -1728,6 +2066,7 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
         if ((sec->Characteristics & IMAGE_SCN_MEM_SHARED) &&
             (sec->Characteristics & IMAGE_SCN_MEM_WRITE))
         {
+            shared_sections = TRUE;
             TRACE_(module)( "mapping shared section %.8s at %p off %x (%x) size %lx (%lx) flags %x\n",
                             sec->Name, ptr + sec->VirtualAddress,
                             sec->PointerToRawData, (int)pos, file_size, map_size,
@@ -1765,6 +2104,7 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
         /* Note: if the section is not aligned properly map_file_into_view will magically
          *       fall back to read(), so we don't need to check anything here.
          */
+        if (file_start & page_mask) private_pages = TRUE;
         end = file_start + file_size;
         if (sec->PointerToRawData >= st.st_size ||
             end > ((st.st_size + sector_align) & ~sector_align) ||
@@ -1788,8 +2128,22 @@ static NTSTATUS map_image( HANDLE hmapping, ACCESS_MASK access, int fd, int top_
         }
     }
 
+    /* images with writable shared sections can't be cached, their contents are not private */
+
+    if (!shared_sections)
+    {
+        if (ptr != base)
+        {
+            NTSTATUS reloc_status = relocate_image( ptr, nt, total_size );
+            if (reloc_status == STATUS_INVALID_IMAGE_FORMAT) goto error;
+            if (!reloc_status) private_pages = TRUE;
+        }
+        if (private_pages) add_cached_image( hmapping, view );
+    }
+
     /* set the image protections */
 
+ set_protections:
     VIRTUAL_SetProt( view, ptr, ROUND_SIZE( 0, header_size ), VPROT_COMMITTED | VPROT_READ );
 
     sec = sections;
@@ -1960,7 +2314,11 @@ NTSTATUS virtual_map_section( HANDLE handle, PVOID *addr_ptr, unsigned short zer
     get_vprot_flags( protect, &vprot, sec_flags & SEC_IMAGE );
     vprot |= sec_flags;
     if (!(sec_flags & SEC_RESERVE)) vprot |= VPROT_COMMITTED;
-    res = map_view( &view, *addr_ptr, size, 0, alloc_type & MEM_TOP_DOWN, vprot, zero_bits_64 );
+    if ((sec_flags & SEC_LARGE_PAGES) && large_page_size)
+        res = map_view( &view, *addr_ptr, size, get_large_page_alignment(), alloc_type & MEM_TOP_DOWN,
+                        vprot, zero_bits_64 );
+    else
+        res = map_view( &view, *addr_ptr, size, 0, alloc_type & MEM_TOP_DOWN, vprot, zero_bits_64 );
     if (res)
     {
         server_leave_uninterrupted_section( &csVirtual, &sigset );
@@ -1988,6 +2346,7 @@ NTSTATUS virtual_map_section( HANDLE handle, PVOID *addr_ptr, unsigned short zer
 
     if (res == STATUS_SUCCESS)
     {
+        if ((sec_flags & SEC_LARGE_PAGES) && large_page_size) advise_large_pages( view );
         *addr_ptr = view->base;
         *size_ptr = size;
         VIRTUAL_DEBUG_DUMP_VIEW( view );
@@ -2031,6 +2390,40 @@ static int remove_reserved_area_from_free( void *base, size_t size, void *arg )
     return 0;
 }
 
+/***********************************************************************
+ *           init_large_page_size
+ *
+ * Find the size of the huge pages supported by the host.
+ */
+static SIZE_T init_large_page_size(void)
+{
+    unsigned long size = 0;
+#ifdef __linux__
+    char buffer[128];
+    FILE *f;
+
+    if ((f = fopen( "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r" )))
+    {
+        if (fscanf( f, "%lu", &size ) != 1) size = 0;
+        fclose( f );
+    }
+    if (!size && (f = fopen( "/proc/meminfo", "r" )))
+    {
+        while (fgets( buffer, sizeof(buffer), f ))
+            if (sscanf( buffer, "Hugepagesize: %lu kB", &size ) == 1)
+            {
+                size *= 1024;
+                break;
+            }
+        fclose( f );
+    }
+#endif
+    if (size <= page_size || (size & (size - 1))) size = 0;
+    TRACE( "large page size %#lx\n", size );
+    return size;
+}
+
+
 /***********************************************************************
  *           virtual_init
  */
@@ -2038,7 +2431,7 @@ void virtual_init(void)
 {
     const char *preload;
     struct alloc_virtual_heap alloc_views;
-    size_t size;
+    size_t size, index_offset;
 
 #if !defined(__i386__) && !defined(__x86_64__) && !defined(__arm__) && !defined(__aarch64__)
     page_size = sysconf( _SC_PAGESIZE );
@@ -2070,9 +2463,14 @@ void virtual_init(void)
     /* try to find space in a reserved area for the views and pages protection table */
 #ifdef _WIN64
     pages_vprot_size = ((size_t)address_space_limit >> page_shift >> pages_vprot_shift) + 1;
+    views_index_size = ((size_t)address_space_limit >> VIEWS_INDEX_SHIFT >> views_index_shift) + 1;
     alloc_views.size = view_block_size + pages_vprot_size * sizeof(*pages_vprot);
+    index_offset = alloc_views.size;
+    alloc_views.size += views_index_size * sizeof(*views_index);
 #else
     alloc_views.size = view_block_size + (1U << (32 - page_shift));
+    index_offset = alloc_views.size;
+    alloc_views.size += (1U << (32 - VIEWS_INDEX_SHIFT)) * sizeof(*views_index);
 #endif
     if (wine_mmap_enum_reserved_areas( alloc_virtual_heap, &alloc_views, 1 ))
         wine_mmap_remove_reserved_area( alloc_views.base, alloc_views.size, 0 );
@@ -2083,6 +2481,7 @@ void virtual_init(void)
     view_block_start = alloc_views.base;
     view_block_end = view_block_start + view_block_size / sizeof(*view_block_start);
     pages_vprot = (void *)((char *)alloc_views.base + view_block_size);
+    views_index = (void *)((char *)alloc_views.base + index_offset);
     wine_rb_init( &views_tree, compare_view );
 
     /* make the DOS area accessible (except the low 64K) to hide bugs in broken apps like Excel 2003 */
@@ -2092,6 +2491,8 @@ void virtual_init(void)
 
     wine_mmap_add_free_area(address_space_start, (char *)user_space_limit - (char *)address_space_start);
     wine_mmap_enum_reserved_areas( remove_reserved_area_from_free, NULL, 0);
+
+    large_page_size = init_large_page_size();
 }
 
 
@@ -2134,6 +2535,15 @@ void virtual_get_system_info( SYSTEM_BASIC_INFORMATION *info )
 }
 
 
+/***********************************************************************
+ *           virtual_get_large_page_size
+ */
+SIZE_T virtual_get_large_page_size(void)
+{
+    return large_page_size;
+}
+
+
 /***********************************************************************
  *           virtual_create_builtin_view
  */
@@ -2222,7 +2632,9 @@ NTSTATUS virtual_alloc_thread_stack( INITIAL_TEB *stack, SIZE_T reserve_size, SI
 
         /* shrink the first view and create a second one for the extra size */
         /* this allows the app to free the stack without freeing the thread start portion */
+        unindex_view( view );
         view->size -= extra_size;
+        index_view( view );
         status = create_view( &extra_view, (char *)view->base + view->size, extra_size,
                               VPROT_READ | VPROT_WRITE | VPROT_COMMITTED );
         if (status != STATUS_SUCCESS)
@@ -2866,6 +3278,18 @@ NTSTATUS virtual_alloc_aligned( PVOID *ret, unsigned short zero_bits_64, SIZE_T
 
     if (is_beyond_limit( 0, size, working_set_limit )) return STATUS_WORKING_SET_LIMIT_RANGE;
 
+    if (type & MEM_LARGE_PAGES)
+    {
+        /* large pages must be reserved and committed at once, in multiples of the large page size */
+        if (!large_page_size || (type & (MEM_RESERVE | MEM_COMMIT)) != (MEM_RESERVE | MEM_COMMIT) ||
+            (size & (large_page_size - 1)) || (type & MEM_WRITE_WATCH))
+        {
+            WARN( "invalid large page allocation type %08x size %lx\n", type, size );
+            return STATUS_INVALID_PARAMETER;
+        }
+        alignment = max( alignment, get_large_page_alignment() );
+    }
+
     if (*ret)
     {
         if (type & MEM_RESERVE) /* Round down to 64k boundary */
@@ -2893,7 +3317,7 @@ NTSTATUS virtual_alloc_aligned( PVOID *ret, unsigned short zero_bits_64, SIZE_T
     /* Compute the alloc type flags */
 
     if (!(type & (MEM_COMMIT | MEM_RESERVE | MEM_RESET)) ||
-        (type & ~(MEM_COMMIT | MEM_RESERVE | MEM_TOP_DOWN | MEM_WRITE_WATCH | MEM_RESET)))
+        (type & ~(MEM_COMMIT | MEM_RESERVE | MEM_TOP_DOWN | MEM_WRITE_WATCH | MEM_RESET | MEM_LARGE_PAGES)))
     {
         WARN("called with wrong alloc type flags (%08x) !\n", type);
         return STATUS_INVALID_PARAMETER;
@@ -2909,13 +3333,18 @@ NTSTATUS virtual_alloc_aligned( PVOID *ret, unsigned short zero_bits_64, SIZE_T
         {
             if (type & MEM_COMMIT) vprot |= VPROT_COMMITTED;
             if (type & MEM_WRITE_WATCH) vprot |= VPROT_WRITEWATCH;
+            if (type & MEM_LARGE_PAGES) vprot |= SEC_LARGE_PAGES;
             if (protect & PAGE_NOCACHE) vprot |= SEC_NOCACHE;
 
             if (vprot & VPROT_WRITECOPY) status = STATUS_INVALID_PAGE_PROTECTION;
             else if (is_dos_memory) status = allocate_dos_memory( &view, vprot );
             else status = map_view( &view, base, size, alignment, type & MEM_TOP_DOWN, vprot, zero_bits_64 );
 
-            if (status == STATUS_SUCCESS) base = view->base;
+            if (status == STATUS_SUCCESS)
+            {
+                if (type & MEM_LARGE_PAGES) advise_large_pages( view );
+                base = view->base;
+            }
         }
     }
     else if (type & MEM_RESET)
@@ -3226,25 +3655,35 @@ static NTSTATUS get_basic_memory_info( HANDLE process, LPCVOID addr,
     /* Find the view containing the address */
 
     server_enter_uninterrupted_section( &csVirtual, &sigset );
-    ptr = views_tree.root;
-    while (ptr)
+    if ((view = get_indexed_view( base )) &&
+        base >= (char *)view->base && base < (char *)view->base + view->size)
     {
-        view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
-        if ((char *)view->base > base)
-        {
-            alloc_end = view->base;
-            ptr = ptr->left;
-        }
-        else if ((char *)view->base + view->size <= base)
-        {
-            alloc_base = (char *)view->base + view->size;
-            ptr = ptr->right;
-        }
-        else
+        alloc_base = view->base;
+        alloc_end = (char *)view->base + view->size;
+        ptr = &view->entry;
+    }
+    else
+    {
+        ptr = views_tree.root;
+        while (ptr)
         {
-            alloc_base = view->base;
-            alloc_end = (char *)view->base + view->size;
-            break;
+            view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+            if ((char *)view->base > base)
+            {
+                alloc_end = view->base;
+                ptr = ptr->left;
+            }
+            else if ((char *)view->base + view->size <= base)
+            {
+                alloc_base = (char *)view->base + view->size;
+                ptr = ptr->right;
+            }
+            else
+            {
+                alloc_base = view->base;
+                alloc_end = (char *)view->base + view->size;
+                break;
+            }
         }
     }
 
@@ -3281,7 +3720,6 @@ static NTSTATUS get_basic_memory_info( HANDLE process, LPCVOID addr,
     else
     {
         BYTE vprot;
-        char *ptr;
         SIZE_T range_size = get_committed_size( view, base, &vprot );
 
         info->State = (vprot & VPROT_COMMITTED) ? MEM_COMMIT : MEM_RESERVE;
@@ -3290,9 +3728,7 @@ static NTSTATUS get_basic_memory_info( HANDLE process, LPCVOID addr,
         if (view->protect & SEC_IMAGE) info->Type = MEM_IMAGE;
         else if (view->protect & (SEC_FILE | SEC_RESERVE | SEC_COMMIT)) info->Type = MEM_MAPPED;
         else info->Type = MEM_PRIVATE;
-        for (ptr = base; ptr < base + range_size; ptr += page_size)
-            if ((get_page_vprot( ptr ) ^ vprot) & ~VPROT_WRITEWATCH) break;
-        info->RegionSize = ptr - base;
+        info->RegionSize = get_vprot_range_size( base, range_size, ~VPROT_WRITEWATCH, &vprot );
     }
     server_leave_uninterrupted_section( &csVirtual, &sigset );
 
@@ -3347,6 +3783,7 @@ static NTSTATUS get_working_set_ex( HANDLE process, LPCVOID addr,
                 p->VirtualAttributes.ShareCount = 1; /* FIXME */
             if (p->VirtualAttributes.Valid)
                 p->VirtualAttributes.Win32Protection = VIRTUAL_GetWin32Prot( vprot, view->protect );
+            p->VirtualAttributes.LargePage = p->VirtualAttributes.Valid && (view->protect & SEC_LARGE_PAGES);
         }
     }
     server_leave_uninterrupted_section( &csVirtual, &sigset );
@@ -633,7 +633,7 @@ static void shader_arb_vs_local_constants(const struct arb_vs_compiled_shader *g
     checkGLcall("Load vs int consts");
 }
 
-static void shader_arb_select(void *shader_priv, struct wined3d_context *context,
+static BOOL shader_arb_select(void *shader_priv, struct wined3d_context *context,
         const struct wined3d_state *state);
 
 /**
@@ -4557,7 +4557,7 @@ static void find_arb_vs_compile_args(const struct wined3d_state *state,
 }
 
 /* Context activation is done by the caller. */
-static void shader_arb_select(void *shader_priv, struct wined3d_context *context,
+static BOOL shader_arb_select(void *shader_priv, struct wined3d_context *context,
         const struct wined3d_state *state)
 {
     struct wined3d_context_gl *context_gl = wined3d_context_gl(context);
@@ -4693,6 +4693,8 @@ static void shader_arb_select(void *shader_priv, struct wined3d_context *context
         }
         priv->vertex_pipe->vp_enable(context, TRUE);
     }
+
+    return TRUE;
 }
 
 static void shader_arb_select_compute(void *shader_priv, struct wined3d_context *context,
@@ -28,12 +28,17 @@
 #include "wined3d_private.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(d3d);
+WINE_DECLARE_DEBUG_CHANNEL(d3d_perf);
 
 #define WINED3D_BUFFER_HASDESC      0x01    /* A vertex description has been found. */
 #define WINED3D_BUFFER_USE_BO       0x02    /* Use a buffer object for this buffer. */
 #define WINED3D_BUFFER_PIN_SYSMEM   0x04    /* Keep a system memory copy for this buffer. */
 #define WINED3D_BUFFER_DISCARD      0x08    /* A DISCARD lock has occurred since the last preload. */
 #define WINED3D_BUFFER_APPLESYNC    0x10    /* Using sync as in GL_APPLE_flush_buffer_range. */
+#define WINED3D_BUFFER_UPLOADED     0x20    /* The buffer object was uploaded to before. */
+#define WINED3D_BUFFER_RING         0x40    /* DISCARD/NOOVERWRITE maps may be served from the upload ring. */
+#define WINED3D_BUFFER_RING_MAPPED  0x80    /* The buffer is currently mapped through the upload ring. */
+#define WINED3D_BUFFER_RING_BACKED  0x100   /* The upload ring range holds the buffer contents. */
 
 #define VB_MAXDECLCHANGES     100     /* After that number of decl changes we stop converting */
 #define VB_RESETDECLCHANGE    1000    /* Reset the decl changecount after that number of draws */
@@ -185,9 +190,21 @@ static void wined3d_buffer_gl_destroy_buffer_object(struct wined3d_buffer_gl *bu
         }
     }
 
+    if (buffer_gl->b.flags & WINED3D_BUFFER_RING_MAPPED)
+    {
+        struct wined3d_upload_ring_gl *ring = &wined3d_device_gl(resource->device)->upload_ring;
+
+        /* There's nothing left to copy the mapped range into. */
+        WARN("Deleting buffer object for buffer %p mapped through the upload ring.\n", buffer_gl);
+        --ring->pin_counts[buffer_gl->ring_offset / (WINED3D_UPLOAD_RING_SIZE / WINED3D_UPLOAD_RING_SEGMENT_COUNT)];
+        buffer_gl->b.flags &= ~WINED3D_BUFFER_RING_MAPPED;
+        buffer_gl->b.map_ptr = NULL;
+    }
+
     GL_EXTCALL(glDeleteBuffers(1, &buffer_gl->bo.id));
     checkGLcall("glDeleteBuffers");
     buffer_gl->b.buffer_object = 0;
+    buffer_gl->b.flags &= ~(WINED3D_BUFFER_UPLOADED | WINED3D_BUFFER_RING_BACKED);
     buffer_gl->bo.id = 0;
 
     if (buffer_gl->b.fence)
@@ -983,6 +1000,12 @@ struct wined3d_resource * CDECL wined3d_buffer_get_resource(struct wined3d_buffe
     return &buffer->resource;
 }
 
+static BOOL wined3d_buffer_gl_ring_copy_pending(const struct wined3d_buffer_gl *buffer_gl,
+        const struct wined3d_upload_ring_gl *ring);
+static void *wined3d_buffer_gl_map_ring(struct wined3d_buffer_gl *buffer_gl,
+        struct wined3d_context_gl *context_gl, uint32_t flags);
+static void wined3d_buffer_gl_unmap_ring(struct wined3d_buffer_gl *buffer_gl, struct wined3d_context_gl *context_gl);
+
 static HRESULT buffer_resource_sub_resource_map(struct wined3d_resource *resource, unsigned int sub_resource_idx,
         struct wined3d_map_desc *map_desc, const struct wined3d_box *box, uint32_t flags)
 {
@@ -1063,8 +1086,25 @@ static HRESULT buffer_resource_sub_resource_map(struct wined3d_resource *resourc
             if ((flags & WINED3D_MAP_DISCARD) && resource->heap_memory)
                 wined3d_buffer_evict_sysmem(buffer);
 
-            if (count == 1)
+            if (count == 1 && (buffer->flags & WINED3D_BUFFER_RING)
+                    && (buffer->map_ptr = wined3d_buffer_gl_map_ring(wined3d_buffer_gl(buffer),
+                    wined3d_context_gl(context), flags)))
             {
+                TRACE("Mapped buffer %p through the upload ring.\n", buffer);
+            }
+            else if (count == 1)
+            {
+                if (buffer->flags & WINED3D_BUFFER_RING)
+                {
+                    /* Don't let unsynchronized maps race with a pending copy
+                     * out of the upload ring. */
+                    if (wined3d_buffer_gl_ring_copy_pending(wined3d_buffer_gl(buffer),
+                            &wined3d_device_gl(device)->upload_ring))
+                        flags &= ~WINED3D_MAP_NOOVERWRITE;
+                    if (flags & WINED3D_MAP_WRITE)
+                        buffer->flags &= ~WINED3D_BUFFER_RING_BACKED;
+                }
+
                 /* Filter redundant WINED3D_MAP_DISCARD maps. The 3DMark2001
                  * multitexture fill rate test seems to depend on this. When
                  * we map a buffer with GL_MAP_INVALIDATE_BUFFER_BIT, the
@@ -1174,6 +1214,17 @@ static HRESULT buffer_resource_sub_resource_unmap(struct wined3d_resource *resou
 
     context = context_acquire(device, NULL, 0);
 
+    if (buffer->flags & WINED3D_BUFFER_RING_MAPPED)
+    {
+        wined3d_buffer_gl_unmap_ring(wined3d_buffer_gl(buffer), wined3d_context_gl(context));
+        context_release(context);
+
+        buffer_clear_dirty_areas(buffer);
+        buffer->map_ptr = NULL;
+
+        return WINED3D_OK;
+    }
+
     if (buffer->flags & WINED3D_BUFFER_APPLESYNC)
     {
         struct wined3d_context_gl *context_gl;
@@ -1219,6 +1270,7 @@ void wined3d_buffer_copy(struct wined3d_buffer *dst_buffer, unsigned int dst_off
 
     buffer_mark_used(dst_buffer);
     buffer_mark_used(src_buffer);
+    dst_buffer->flags &= ~WINED3D_BUFFER_RING_BACKED;
 
     dst_location = wined3d_buffer_get_memory(dst_buffer, &dst, dst_buffer->locations);
     dst.addr += dst_offset;
@@ -1502,25 +1554,322 @@ static void wined3d_buffer_gl_unload_location(struct wined3d_buffer *buffer,
     }
 }
 
+/* Context activation is done by the caller. */
+void wined3d_upload_ring_gl_init(struct wined3d_upload_ring_gl *ring, struct wined3d_context_gl *context_gl)
+{
+    const GLbitfield map_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    const struct wined3d_gl_info *gl_info = context_gl->gl_info;
+
+    memset(ring, 0, sizeof(*ring));
+    /* Generation 0 means that a buffer was never mapped through the ring. */
+    ring->generations[0] = 1;
+
+    if (!gl_info->supported[ARB_BUFFER_STORAGE] || !gl_info->supported[ARB_COPY_BUFFER]
+            || !gl_info->supported[ARB_SYNC])
+        return;
+
+    ring->bo.binding = GL_COPY_READ_BUFFER;
+    GL_EXTCALL(glGenBuffers(1, &ring->bo.id));
+    GL_EXTCALL(glBindBuffer(GL_COPY_READ_BUFFER, ring->bo.id));
+    GL_EXTCALL(glBufferStorage(GL_COPY_READ_BUFFER, WINED3D_UPLOAD_RING_SIZE, NULL, map_flags));
+    ring->map_ptr = GL_EXTCALL(glMapBufferRange(GL_COPY_READ_BUFFER, 0, WINED3D_UPLOAD_RING_SIZE, map_flags));
+    checkGLcall("upload ring creation");
+
+    if (!ring->map_ptr)
+    {
+        ERR("Failed to map the upload ring.\n");
+        wined3d_upload_ring_gl_cleanup(ring, context_gl);
+        return;
+    }
+
+    TRACE("Created a %u byte upload ring.\n", WINED3D_UPLOAD_RING_SIZE);
+}
+
+/* Context activation is done by the caller. */
+void wined3d_upload_ring_gl_cleanup(struct wined3d_upload_ring_gl *ring, struct wined3d_context_gl *context_gl)
+{
+    const struct wined3d_gl_info *gl_info = context_gl->gl_info;
+    unsigned int i;
+
+    if (ring->bo.id)
+    {
+        TRACE_(d3d_perf)("Upload ring statistics: %u uploads, %u maps, %u wraps, %u stalls.\n",
+                ring->upload_count, ring->map_count, ring->wrap_count, ring->stall_count);
+
+        GL_EXTCALL(glDeleteBuffers(1, &ring->bo.id));
+        checkGLcall("upload ring destruction");
+    }
+
+    for (i = 0; i < ARRAY_SIZE(ring->fences); ++i)
+    {
+        if (ring->fences[i])
+            GL_EXTCALL(glDeleteSync(ring->fences[i]));
+    }
+
+    memset(ring, 0, sizeof(*ring));
+}
+
+/* A fence only covers the commands of the context it is issued in. Fences
+ * are flushed so that other contexts can wait on them, and a segment that
+ * already has a fence, possibly from another context, makes the new fence
+ * wait for it on the GPU, so that the new fence covers both.
+ *
+ * Context activation is done by the caller. */
+static void wined3d_upload_ring_gl_fence_segment(struct wined3d_upload_ring_gl *ring,
+        const struct wined3d_gl_info *gl_info, unsigned int segment)
+{
+    if (ring->fences[segment])
+    {
+        GL_EXTCALL(glWaitSync(ring->fences[segment], 0, GL_TIMEOUT_IGNORED));
+        GL_EXTCALL(glDeleteSync(ring->fences[segment]));
+    }
+    ring->fences[segment] = GL_EXTCALL(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    gl_info->gl_ops.gl.p_glFlush();
+    checkGLcall("upload ring fence");
+}
+
+/* Context activation is done by the caller. */
+static void wined3d_upload_ring_gl_enter_segment(struct wined3d_upload_ring_gl *ring,
+        struct wined3d_context_gl *context_gl, unsigned int segment)
+{
+    const struct wined3d_gl_info *gl_info = context_gl->gl_info;
+    GLenum ret;
+
+    wined3d_upload_ring_gl_fence_segment(ring, gl_info, ring->segment);
+    ring->segment = segment;
+    ring->copy_context = NULL;
+    ++ring->generations[segment];
+
+    if (!ring->fences[segment])
+        return;
+
+    if ((ret = GL_EXTCALL(glClientWaitSync(ring->fences[segment], 0, 0))) == GL_TIMEOUT_EXPIRED)
+    {
+        ++ring->stall_count;
+        WARN_(d3d_perf)("Waiting for upload ring segment %u.\n", segment);
+        /* See wined3d_fence_wait() for the timeout. */
+        ret = GL_EXTCALL(glClientWaitSync(ring->fences[segment], 0, ~(GLuint64)0 >> 1));
+    }
+    if (ret != GL_ALREADY_SIGNALED && ret != GL_CONDITION_SATISFIED)
+        ERR("glClientWaitSync returned %#x.\n", ret);
+
+    GL_EXTCALL(glDeleteSync(ring->fences[segment]));
+    ring->fences[segment] = NULL;
+    checkGLcall("upload ring wait");
+}
+
+/* Allocates "size" bytes from the ring, in a range that doesn't cross a
+ * segment boundary; the segment fences issued before the copies out of the
+ * range are recorded wouldn't cover them otherwise. Segments with buffers
+ * mapped through them can't be entered, the allocation fails instead.
+ *
+ * Context activation is done by the caller. */
+static BOOL wined3d_upload_ring_gl_alloc(struct wined3d_upload_ring_gl *ring,
+        struct wined3d_context_gl *context_gl, unsigned int size, unsigned int *offset)
+{
+    const unsigned int segment_size = WINED3D_UPLOAD_RING_SIZE / WINED3D_UPLOAD_RING_SEGMENT_COUNT;
+    unsigned int start, segment, last_segment;
+    BOOL wrap = FALSE;
+
+    /* Larger uploads would have to wait for several segments at once. */
+    if (!size || size > segment_size)
+        return FALSE;
+
+    start = (ring->head + RESOURCE_ALIGNMENT - 1) & ~(RESOURCE_ALIGNMENT - 1);
+    if (start / segment_size != (start + size - 1) / segment_size)
+        start = (start / segment_size + 1) * segment_size;
+    if (start + size > WINED3D_UPLOAD_RING_SIZE)
+    {
+        wrap = TRUE;
+        start = 0;
+    }
+    last_segment = (start + size - 1) / segment_size;
+
+    segment = wrap ? 0 : ring->segment + 1;
+    for (; segment <= last_segment; ++segment)
+    {
+        if (ring->pin_counts[segment])
+        {
+            TRACE("Upload ring segment %u is in use by a mapped buffer.\n", segment);
+            return FALSE;
+        }
+    }
+
+    if (wrap)
+    {
+        TRACE("Wrapping the upload ring.\n");
+        ++ring->wrap_count;
+        wined3d_upload_ring_gl_enter_segment(ring, context_gl, 0);
+    }
+    while (ring->segment != last_segment)
+        wined3d_upload_ring_gl_enter_segment(ring, context_gl, ring->segment + 1);
+
+    ring->head = start + size;
+    *offset = start;
+
+    return TRUE;
+}
+
+/* Context activation is done by the caller. */
+static void wined3d_upload_ring_gl_copy(struct wined3d_upload_ring_gl *ring, struct wined3d_context_gl *context_gl,
+        const struct wined3d_bo_gl *dst_bo, unsigned int dst_offset, unsigned int src_offset, unsigned int size)
+{
+    const unsigned int segment_size = WINED3D_UPLOAD_RING_SIZE / WINED3D_UPLOAD_RING_SEGMENT_COUNT;
+    const struct wined3d_gl_info *gl_info = context_gl->gl_info;
+
+    /* Switching away from a context fences its copies, see
+     * wined3d_upload_ring_gl_leave_context(). */
+    if (src_offset / segment_size == ring->segment)
+        ring->copy_context = context_gl;
+
+    GL_EXTCALL(glBindBuffer(GL_COPY_READ_BUFFER, ring->bo.id));
+    GL_EXTCALL(glBindBuffer(GL_COPY_WRITE_BUFFER, dst_bo->id));
+    GL_EXTCALL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src_offset, dst_offset, size));
+    checkGLcall("upload ring copy");
+}
+
+/* Called while "context_gl" is still current, before another GL context is
+ * made current or the context is destroyed. Fences issued later in another
+ * context wouldn't cover the copies recorded in this one. */
+void wined3d_upload_ring_gl_leave_context(struct wined3d_upload_ring_gl *ring, struct wined3d_context_gl *context_gl)
+{
+    if (ring->copy_context != context_gl)
+        return;
+
+    if (wglGetCurrentContext() == context_gl->gl_ctx)
+        wined3d_upload_ring_gl_fence_segment(ring, context_gl->gl_info, ring->segment);
+    else
+        ERR("Context %p is not current, not fencing upload ring segment %u.\n", context_gl, ring->segment);
+    ring->copy_context = NULL;
+}
+
+/* Stages "data" through the upload ring and copies it into the destination
+ * buffer object. This avoids glBufferSubData() stalls when the destination is
+ * in use.
+ *
+ * Context activation is done by the caller. */
+static BOOL wined3d_upload_ring_gl_upload(struct wined3d_upload_ring_gl *ring, struct wined3d_context_gl *context_gl,
+        const struct wined3d_bo_gl *dst_bo, unsigned int dst_offset, const void *data, unsigned int size)
+{
+    unsigned int offset;
+
+    if (!ring->map_ptr || !wined3d_upload_ring_gl_alloc(ring, context_gl, size, &offset))
+        return FALSE;
+
+    memcpy(ring->map_ptr + offset, data, size);
+    wined3d_upload_ring_gl_copy(ring, context_gl, dst_bo, dst_offset, offset, size);
+    ++ring->upload_count;
+
+    return TRUE;
+}
+
+/* Whether a copy out of the ring into the buffer may still be pending. Once
+ * the ring has come back to the segment the buffer was mapped through, the
+ * segment fence, and with it the copy, has completed. */
+static BOOL wined3d_buffer_gl_ring_copy_pending(const struct wined3d_buffer_gl *buffer_gl,
+        const struct wined3d_upload_ring_gl *ring)
+{
+    const unsigned int segment_size = WINED3D_UPLOAD_RING_SIZE / WINED3D_UPLOAD_RING_SEGMENT_COUNT;
+
+    return buffer_gl->ring_generation
+            && ring->generations[buffer_gl->ring_offset / segment_size] == buffer_gl->ring_generation;
+}
+
+/* Serves DISCARD and NOOVERWRITE maps of dynamic buffers from the upload
+ * ring. DISCARD maps get a new range, NOOVERWRITE maps and redundant DISCARD
+ * maps reuse the range of the previous DISCARD map, as long as the ring hasn't
+ * come back to it, since it holds everything written to the buffer since.
+ * The mapped ranges are copied into the buffer object on unmap.
+ *
+ * Context activation is done by the caller. */
+static void *wined3d_buffer_gl_map_ring(struct wined3d_buffer_gl *buffer_gl,
+        struct wined3d_context_gl *context_gl, uint32_t flags)
+{
+    const unsigned int segment_size = WINED3D_UPLOAD_RING_SIZE / WINED3D_UPLOAD_RING_SEGMENT_COUNT;
+    struct wined3d_upload_ring_gl *ring = &wined3d_device_gl(context_gl->c.device)->upload_ring;
+    struct wined3d_buffer *buffer = &buffer_gl->b;
+    unsigned int offset;
+
+    if (!ring->map_ptr || !(flags & WINED3D_MAP_WRITE)
+            || !(flags & (WINED3D_MAP_DISCARD | WINED3D_MAP_NOOVERWRITE)))
+        return NULL;
+
+    if ((buffer->flags & WINED3D_BUFFER_RING_BACKED) && wined3d_buffer_gl_ring_copy_pending(buffer_gl, ring)
+            && (!(flags & WINED3D_MAP_DISCARD) || (buffer->flags & WINED3D_BUFFER_DISCARD)))
+    {
+        offset = buffer_gl->ring_offset;
+    }
+    else if (flags & WINED3D_MAP_DISCARD)
+    {
+        if (!wined3d_upload_ring_gl_alloc(ring, context_gl, buffer->resource.size, &offset))
+            return NULL;
+        buffer_gl->ring_offset = offset;
+        buffer_gl->ring_generation = ring->generations[offset / segment_size];
+    }
+    else
+    {
+        return NULL;
+    }
+
+    ++ring->pin_counts[offset / segment_size];
+    ++ring->map_count;
+    buffer->flags |= WINED3D_BUFFER_RING_MAPPED | WINED3D_BUFFER_RING_BACKED;
+
+    return ring->map_ptr + offset;
+}
+
+/* Context activation is done by the caller. */
+static void wined3d_buffer_gl_unmap_ring(struct wined3d_buffer_gl *buffer_gl, struct wined3d_context_gl *context_gl)
+{
+    const unsigned int segment_size = WINED3D_UPLOAD_RING_SIZE / WINED3D_UPLOAD_RING_SEGMENT_COUNT;
+    struct wined3d_upload_ring_gl *ring = &wined3d_device_gl(context_gl->c.device)->upload_ring;
+    unsigned int i, segment = buffer_gl->ring_offset / segment_size;
+    struct wined3d_buffer *buffer = &buffer_gl->b;
+
+    for (i = 0; i < buffer->modified_areas; ++i)
+    {
+        wined3d_upload_ring_gl_copy(ring, context_gl, &buffer_gl->bo, buffer->maps[i].offset,
+                buffer_gl->ring_offset + buffer->maps[i].offset, buffer->maps[i].size);
+    }
+
+    /* The head may have left the segment while the buffer was mapped, in
+     * which case the segment fence doesn't cover the copies. */
+    if (ring->segment != segment)
+        wined3d_upload_ring_gl_fence_segment(ring, context_gl->gl_info, segment);
+
+    --ring->pin_counts[segment];
+    buffer->flags &= ~WINED3D_BUFFER_RING_MAPPED;
+}
+
 /* Context activation is done by the caller. */
 static void wined3d_buffer_gl_upload_ranges(struct wined3d_buffer *buffer, struct wined3d_context *context,
         const void *data, unsigned int data_offset, unsigned int range_count, const struct wined3d_range *ranges)
 {
     struct wined3d_context_gl *context_gl = wined3d_context_gl(context);
     struct wined3d_buffer_gl *buffer_gl = wined3d_buffer_gl(buffer);
+    struct wined3d_upload_ring_gl *ring = &wined3d_device_gl(context->device)->upload_ring;
     const struct wined3d_gl_info *gl_info = context_gl->gl_info;
     const struct wined3d_range *range;
+    const BYTE *src;
+    BOOL use_ring;
 
     TRACE("buffer %p, context %p, data %p, data_offset %u, range_count %u, ranges %p.\n",
             buffer, context, data, data_offset, range_count, ranges);
 
     wined3d_buffer_gl_bind(buffer_gl, context_gl);
 
+    /* The first upload into a buffer object can't stall, don't add a copy to it. */
+    use_ring = buffer->flags & WINED3D_BUFFER_UPLOADED;
+    buffer->flags |= WINED3D_BUFFER_UPLOADED;
+    buffer->flags &= ~WINED3D_BUFFER_RING_BACKED;
+
     while (range_count--)
     {
         range = &ranges[range_count];
-        GL_EXTCALL(glBufferSubData(buffer_gl->bo.binding,
-                range->offset, range->size, (BYTE *)data + range->offset - data_offset));
+        src = (const BYTE *)data + range->offset - data_offset;
+        if (!use_ring || !wined3d_upload_ring_gl_upload(ring, context_gl,
+                &buffer_gl->bo, range->offset, src, range->size))
+            GL_EXTCALL(glBufferSubData(buffer_gl->bo.binding, range->offset, range->size, src));
     }
     checkGLcall("buffer upload");
 }
@@ -1578,6 +1927,11 @@ HRESULT wined3d_buffer_gl_init(struct wined3d_buffer_gl *buffer_gl, struct wined
     else
         buffer_gl->b.flags |= WINED3D_BUFFER_USE_BO;
 
+    /* Buffers written by the GPU can't be mirrored in the upload ring. */
+    if ((buffer_gl->b.flags & WINED3D_BUFFER_USE_BO) && (desc->usage & WINED3DUSAGE_DYNAMIC)
+            && !(desc->bind_flags & (WINED3D_BIND_STREAM_OUTPUT | WINED3D_BIND_UNORDERED_ACCESS)))
+        buffer_gl->b.flags |= WINED3D_BUFFER_RING;
+
     return wined3d_buffer_init(&buffer_gl->b, device, desc, data, parent, parent_ops, &wined3d_buffer_gl_ops);
 }
 
@@ -1327,6 +1327,12 @@ static void wined3d_context_gl_cleanup(struct wined3d_context_gl *context_gl)
 
     if (context_gl->valid)
     {
+        /* The device may be gone for contexts that were destroyed while current
+         * in another thread, but those haven't recorded any upload ring copies
+         * since they were last switched away from in the command stream thread. */
+        if (!context_gl->c.destroyed)
+            wined3d_upload_ring_gl_leave_context(&wined3d_device_gl(context_gl->c.device)->upload_ring, context_gl);
+
         if (context_gl->dummy_arbfp_prog)
             GL_EXTCALL(glDeleteProgramsARB(1, &context_gl->dummy_arbfp_prog));
 
@@ -1505,6 +1511,7 @@ BOOL wined3d_context_gl_set_current(struct wined3d_context_gl *context_gl)
             {
                 const struct wined3d_gl_info *gl_info = old->gl_info;
                 TRACE("Flushing context %p before switching to %p.\n", old, context_gl);
+                wined3d_upload_ring_gl_leave_context(&wined3d_device_gl(old->c.device)->upload_ring, old);
                 gl_info->gl_ops.gl.p_glFlush();
             }
             old->c.current = 0;
@@ -1559,6 +1566,7 @@ void wined3d_context_gl_release(struct wined3d_context_gl *context_gl)
         if (context_gl->restore_ctx)
         {
             TRACE("Restoring GL context %p on device context %p.\n", context_gl->restore_ctx, context_gl->restore_dc);
+            wined3d_upload_ring_gl_leave_context(&wined3d_device_gl(context_gl->c.device)->upload_ring, context_gl);
             context_restore_gl_context(context_gl->gl_info, context_gl->restore_dc, context_gl->restore_ctx);
             context_gl->restore_ctx = NULL;
             context_gl->restore_dc = NULL;
@@ -3578,7 +3586,11 @@ static BOOL context_apply_draw_state(struct wined3d_context *context,
 
     if (context->shader_update_mask & ~(1u << WINED3D_SHADER_TYPE_COMPUTE))
     {
-        device->shader_backend->shader_select(device->shader_priv, context, state);
+        if (!device->shader_backend->shader_select(device->shader_priv, context, state))
+        {
+            TRACE("Shaders are not ready yet.\n");
+            return FALSE;
+        }
         context->shader_update_mask &= 1u << WINED3D_SHADER_TYPE_COMPUTE;
     }
 
@@ -539,6 +539,15 @@ static void wined3d_cs_exec_present(struct wined3d_cs *cs, const void *data)
     InterlockedDecrement(&cs->pending_presents);
 }
 
+/* Wakes up the worker thread if it's waiting for packets. Anything that
+ * waits for the worker thread has to call this first, since packets queued
+ * inside a batch don't wake it. */
+void wined3d_cs_wake(struct wined3d_cs *cs)
+{
+    if (InterlockedCompareExchange(&cs->waiting_for_event, FALSE, TRUE))
+        SetEvent(cs->event);
+}
+
 void wined3d_cs_emit_present(struct wined3d_cs *cs, struct wined3d_swapchain *swapchain,
         const RECT *src_rect, const RECT *dst_rect, HWND dst_window_override,
         unsigned int swap_interval, DWORD flags)
@@ -570,6 +579,7 @@ void wined3d_cs_emit_present(struct wined3d_cs *cs, struct wined3d_swapchain *sw
      * ahead of the worker thread. */
     while (pending >= swapchain->max_frame_latency)
     {
+        wined3d_cs_wake(cs);
         wined3d_pause();
         pending = InterlockedCompareExchange(&cs->pending_presents, 0, 0);
     }
@@ -2686,8 +2696,24 @@ static void wined3d_cs_queue_submit(struct wined3d_cs_queue *queue, struct wined
     packet_size = FIELD_OFFSET(struct wined3d_cs_packet, data[packet->size]);
     InterlockedExchange(&queue->head, (queue->head + packet_size) & (WINED3D_CS_QUEUE_SIZE - 1));
 
-    if (InterlockedCompareExchange(&cs->waiting_for_event, FALSE, TRUE))
-        SetEvent(cs->event);
+    /* Inside a batch, the worker thread is woken once the batch ends, or
+     * when we have to wait for it. */
+    if (!cs->batch_depth)
+        wined3d_cs_wake(cs);
+}
+
+/* Packets submitted between wined3d_cs_begin_batch() and
+ * wined3d_cs_end_batch() are made visible to the worker thread as they're
+ * submitted, but the worker thread is only woken up once, at the end. */
+void wined3d_cs_begin_batch(struct wined3d_cs *cs)
+{
+    ++cs->batch_depth;
+}
+
+void wined3d_cs_end_batch(struct wined3d_cs *cs)
+{
+    if (!--cs->batch_depth)
+        wined3d_cs_wake(cs);
 }
 
 static void wined3d_cs_mt_submit(struct wined3d_cs *cs, enum wined3d_cs_queue_id queue_id)
@@ -2766,6 +2792,7 @@ static void *wined3d_cs_queue_require_space(struct wined3d_cs_queue *queue, size
 
         TRACE("Waiting for free space. Head %u, tail %u, packet size %lu.\n",
                 head, tail, (unsigned long)packet_size);
+        wined3d_cs_wake(cs);
     }
 
     packet = (struct wined3d_cs_packet *)&queue->data[queue->head];
@@ -2794,6 +2821,7 @@ static void wined3d_cs_mt_finish(struct wined3d_cs *cs, enum wined3d_cs_queue_id
     if (cs->thread_id == GetCurrentThreadId())
         return wined3d_cs_st_finish(cs, queue_id);
 
+    wined3d_cs_wake(cs);
     while (cs->queue[queue_id].head != *(volatile LONG *)&cs->queue[queue_id].tail)
         wined3d_pause();
 }
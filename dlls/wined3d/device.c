@@ -969,6 +969,7 @@ void wined3d_device_delete_opengl_contexts_cs(void *object)
     context_gl = wined3d_context_gl(context);
     device->blitter->ops->blitter_destroy(device->blitter, context);
     device->shader_backend->shader_free_private(device, context);
+    wined3d_upload_ring_gl_cleanup(&device_gl->upload_ring, context_gl);
     wined3d_device_gl_destroy_dummy_textures(device_gl, context_gl);
     wined3d_device_destroy_default_samplers(device, context);
     context_release(context);
@@ -1024,6 +1025,7 @@ void wined3d_device_create_primary_opengl_context_cs(void *object)
     wined3d_raw_blitter_create(&device->blitter, context_gl->gl_info);
 
     wined3d_device_gl_create_dummy_textures(wined3d_device_gl(device), context_gl);
+    wined3d_upload_ring_gl_init(&wined3d_device_gl(device)->upload_ring, context_gl);
     wined3d_device_create_default_samplers(device, context);
     context_release(context);
 }
@@ -3869,6 +3871,22 @@ HRESULT CDECL wined3d_device_get_display_mode(const struct wined3d_device *devic
     return wined3d_swapchain_get_display_mode(swapchain, mode, rotation);
 }
 
+/* Calls between wined3d_device_begin_batch() and wined3d_device_end_batch()
+ * are handed to the command stream thread as a single chain. */
+void CDECL wined3d_device_begin_batch(struct wined3d_device *device)
+{
+    TRACE("device %p.\n", device);
+
+    wined3d_cs_begin_batch(device->cs);
+}
+
+void CDECL wined3d_device_end_batch(struct wined3d_device *device)
+{
+    TRACE("device %p.\n", device);
+
+    wined3d_cs_end_batch(device->cs);
+}
+
 HRESULT CDECL wined3d_device_begin_scene(struct wined3d_device *device)
 {
     /* At the moment we have no need for any functionality at the beginning
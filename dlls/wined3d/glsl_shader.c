@@ -153,6 +153,9 @@ struct shader_glsl_priv
 
     GLuint ubo_modelview;
     struct wined3d_matrix *modelview_buffer;
+
+    unsigned int program_cache_hits;
+    unsigned int program_cache_misses;
 };
 
 struct glsl_vs_program
@@ -269,7 +272,10 @@ struct glsl_shader_prog_link
     unsigned int constant_version;
     DWORD shader_controlled_clip_distances : 1;
     DWORD clip_distance_mask : 8; /* WINED3D_MAX_CLIP_DISTANCES, 8 */
-    DWORD padding : 23;
+    DWORD pending : 1;
+    DWORD store_binary : 1;
+    DWORD padding : 21;
+    UINT64 cache_key;
 };
 
 struct glsl_program_key
@@ -565,6 +571,16 @@ void print_glsl_info_log(const struct wined3d_gl_info *gl_info, GLuint id, BOOL
 }
 
 /* Context activation is done by the caller. */
+static BOOL shader_glsl_use_program_cache(const struct wined3d_gl_info *gl_info)
+{
+    return wined3d_settings.shader_cache && gl_info->supported[ARB_GET_PROGRAM_BINARY];
+}
+
+static BOOL shader_glsl_use_async_compile(const struct wined3d_gl_info *gl_info)
+{
+    return wined3d_settings.async_shader_compile && gl_info->supported[ARB_PARALLEL_SHADER_COMPILE];
+}
+
 static void shader_glsl_compile(const struct wined3d_gl_info *gl_info, GLuint shader, const char *src)
 {
     const char *ptr, *line;
@@ -579,6 +595,11 @@ static void shader_glsl_compile(const struct wined3d_gl_info *gl_info, GLuint sh
 
     GL_EXTCALL(glShaderSource(shader, 1, &src, NULL));
     checkGLcall("glShaderSource");
+    /* With the program cache, compilation is deferred until the shader is
+     * linked, and skipped entirely if the program binary is in the cache.
+     * Asynchronous compilation starts right away, on the driver's threads. */
+    if (shader_glsl_use_program_cache(gl_info) && !shader_glsl_use_async_compile(gl_info))
+        return;
     GL_EXTCALL(glCompileShader(shader));
     checkGLcall("glCompileShader");
     print_glsl_info_log(gl_info, shader, FALSE);
@@ -654,6 +675,443 @@ void shader_glsl_validate_link(const struct wined3d_gl_info *gl_info, GLuint pro
     print_glsl_info_log(gl_info, program, TRUE);
 }
 
+/* On-disk cache of linked program binaries. Entries are keyed on the GLSL
+ * source of the attached shader objects, the state bound before linking and
+ * the driver identity. The source is stored along with the binary, so that a
+ * hash collision can't load the wrong program.
+ *
+ * File names start with the driver identity, which includes the GL version
+ * string and with it the driver version. The last write time of an entry is
+ * refreshed on every hit. When the cache grows over its size limit, entries
+ * of other drivers are evicted first, then the least recently used ones. */
+#define GLSL_PROGRAM_CACHE_MAGIC 0x50534c47 /* "GLSP" */
+#define GLSL_PROGRAM_CACHE_VERSION 1
+#define GLSL_PROGRAM_CACHE_MAX_SIZE (64 * 1024 * 1024)
+#define GLSL_PROGRAM_CACHE_MAX_TOTAL_SIZE (256 * 1024 * 1024)
+
+static CRITICAL_SECTION glsl_program_cache_cs;
+static CRITICAL_SECTION_DEBUG glsl_program_cache_cs_debug =
+{
+    0, 0, &glsl_program_cache_cs,
+    {&glsl_program_cache_cs_debug.ProcessLocksList,
+    &glsl_program_cache_cs_debug.ProcessLocksList},
+    0, 0, {(DWORD_PTR)(__FILE__ ": glsl_program_cache_cs")}
+};
+static CRITICAL_SECTION glsl_program_cache_cs = {&glsl_program_cache_cs_debug, -1, 0, 0, 0, 0};
+/* Total size of the cache directory, ~0 until it has been scanned. */
+static UINT64 glsl_program_cache_size = ~(UINT64)0;
+
+struct glsl_program_cache_file
+{
+    char name[MAX_PATH];
+    UINT64 size;
+    FILETIME time;
+    BOOL stale;
+};
+
+struct glsl_program_cache_header
+{
+    DWORD magic;
+    DWORD version;
+    UINT64 driver_id;
+    UINT64 key;
+    DWORD format;
+    DWORD source_size;
+    DWORD binary_size;
+    DWORD reserved;
+};
+
+static BOOL shader_glsl_get_program_cache_dir(char *dir, BOOL create)
+{
+    DWORD len;
+
+    if (wined3d_settings.shader_cache_path)
+    {
+        if (strlen(wined3d_settings.shader_cache_path) >= MAX_PATH)
+            return FALSE;
+        strcpy(dir, wined3d_settings.shader_cache_path);
+    }
+    else
+    {
+        static const char suffix[] = "\\wined3d-shader-cache";
+
+        if (!(len = GetEnvironmentVariableA("LOCALAPPDATA", dir, MAX_PATH)) || len + sizeof(suffix) > MAX_PATH)
+            return FALSE;
+        strcat(dir, suffix);
+    }
+
+    if (create && !CreateDirectoryA(dir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        WARN("Failed to create shader cache directory %s, error %u.\n", debugstr_a(dir), GetLastError());
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static BOOL shader_glsl_get_program_cache_path(char *path, size_t size,
+        const struct wined3d_gl_info *gl_info, UINT64 key, BOOL create)
+{
+    char dir[MAX_PATH];
+
+    if (!shader_glsl_get_program_cache_dir(dir, create))
+        return FALSE;
+
+    return snprintf(path, size, "%s\\%08x%08x-%08x%08x.bin", dir,
+            (DWORD)(gl_info->driver_id >> 32), (DWORD)gl_info->driver_id, (DWORD)(key >> 32), (DWORD)key) < size;
+}
+
+static int glsl_program_cache_file_compare(const void *a, const void *b)
+{
+    const struct glsl_program_cache_file *f1 = a, *f2 = b;
+
+    if (f1->stale != f2->stale)
+        return f1->stale ? -1 : 1;
+    return CompareFileTime(&f1->time, &f2->time);
+}
+
+/* Scans the cache directory and evicts entries until it's under "max_size".
+ * Returns the size of the remaining entries. */
+static UINT64 shader_glsl_trim_program_cache(const struct wined3d_gl_info *gl_info, UINT64 max_size)
+{
+    struct glsl_program_cache_file *files = NULL, *entry;
+    SIZE_T count = 0, capacity = 0, i;
+    char dir[MAX_PATH], path[MAX_PATH];
+    char driver_prefix[18];
+    WIN32_FIND_DATAA data;
+    UINT64 total = 0;
+    HANDLE find;
+
+    if (!shader_glsl_get_program_cache_dir(dir, FALSE)
+            || snprintf(path, sizeof(path), "%s\\*.bin", dir) >= sizeof(path))
+        return 0;
+    sprintf(driver_prefix, "%08x%08x-", (DWORD)(gl_info->driver_id >> 32), (DWORD)gl_info->driver_id);
+
+    if ((find = FindFirstFileA(path, &data)) == INVALID_HANDLE_VALUE)
+        return 0;
+    do
+    {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+        if (!wined3d_array_reserve((void **)&files, &capacity, count + 1, sizeof(*files)))
+            break;
+        entry = &files[count++];
+        strcpy(entry->name, data.cFileName);
+        entry->size = ((UINT64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        entry->time = data.ftLastWriteTime;
+        entry->stale = !!strncmp(data.cFileName, driver_prefix, strlen(driver_prefix));
+        total += entry->size;
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+
+    if (total > max_size)
+    {
+        /* Leave some room, so that the next few entries don't trigger
+         * another scan. */
+        max_size -= max_size / 4;
+        qsort(files, count, sizeof(*files), glsl_program_cache_file_compare);
+        for (i = 0; i < count && total > max_size; ++i)
+        {
+            if (snprintf(path, sizeof(path), "%s\\%s", dir, files[i].name) >= sizeof(path))
+                continue;
+            TRACE("Evicting %s program cache entry %s.\n", files[i].stale ? "stale" : "old", debugstr_a(path));
+            if (DeleteFileA(path))
+                total -= files[i].size;
+        }
+    }
+
+    heap_free(files);
+    return total;
+}
+
+/* Accounts for a newly written entry, and trims the cache when it gets too
+ * large. The directory is scanned on the first write of the process. */
+static void shader_glsl_add_program_cache_entry(const struct wined3d_gl_info *gl_info, UINT64 size)
+{
+    EnterCriticalSection(&glsl_program_cache_cs);
+    if (glsl_program_cache_size == ~(UINT64)0
+            || glsl_program_cache_size + size > GLSL_PROGRAM_CACHE_MAX_TOTAL_SIZE)
+        glsl_program_cache_size = shader_glsl_trim_program_cache(gl_info, GLSL_PROGRAM_CACHE_MAX_TOTAL_SIZE);
+    else
+        glsl_program_cache_size += size;
+    LeaveCriticalSection(&glsl_program_cache_cs);
+}
+
+/* Context activation is done by the caller. Returns the attached shader
+ * sources, each prefixed by its GL shader type and followed by its
+ * terminating null character. */
+static char *shader_glsl_get_program_sources(const struct wined3d_gl_info *gl_info,
+        GLuint program_id, GLuint **shaders, GLint *shader_count, DWORD *size)
+{
+    GLint i, length, type;
+    DWORD total = 0;
+    char *sources;
+
+    GL_EXTCALL(glGetProgramiv(program_id, GL_ATTACHED_SHADERS, shader_count));
+    if (!(*shaders = heap_calloc(*shader_count, sizeof(**shaders))))
+        return NULL;
+    GL_EXTCALL(glGetAttachedShaders(program_id, *shader_count, NULL, *shaders));
+
+    for (i = 0; i < *shader_count; ++i)
+    {
+        GL_EXTCALL(glGetShaderiv((*shaders)[i], GL_SHADER_SOURCE_LENGTH, &length));
+        total += sizeof(type) + length;
+    }
+
+    if (!(sources = heap_alloc(total)))
+    {
+        heap_free(*shaders);
+        return NULL;
+    }
+
+    *size = 0;
+    for (i = 0; i < *shader_count; ++i)
+    {
+        GL_EXTCALL(glGetShaderiv((*shaders)[i], GL_SHADER_TYPE, &type));
+        memcpy(sources + *size, &type, sizeof(type));
+        *size += sizeof(type);
+        GL_EXTCALL(glGetShaderSource((*shaders)[i], total - *size, &length, sources + *size));
+        *size += length + 1;
+    }
+    checkGLcall("get program sources");
+
+    return sources;
+}
+
+/* Context activation is done by the caller. */
+static BOOL shader_glsl_load_program_binary(const struct wined3d_gl_info *gl_info,
+        GLuint program_id, UINT64 key, const char *sources, DWORD source_size)
+{
+    struct glsl_program_cache_header header;
+    char path[MAX_PATH];
+    BOOL ret = FALSE;
+    DWORD size, read;
+    GLint status;
+    HANDLE file;
+    char *data;
+
+    if (!shader_glsl_get_program_cache_path(path, sizeof(path), gl_info, key, FALSE))
+        return FALSE;
+
+    /* Updating the write time may not be allowed on a shared cache. */
+    file = CreateFileA(path, GENERIC_READ | FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE && GetLastError() == ERROR_ACCESS_DENIED)
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    if (!ReadFile(file, &header, sizeof(header), &read, NULL) || read != sizeof(header)
+            || header.magic != GLSL_PROGRAM_CACHE_MAGIC || header.version != GLSL_PROGRAM_CACHE_VERSION
+            || header.driver_id != gl_info->driver_id || header.key != key
+            || header.source_size != source_size || !header.binary_size
+            || header.binary_size > GLSL_PROGRAM_CACHE_MAX_SIZE)
+    {
+        TRACE("Dropping stale or invalid program cache entry %s.\n", debugstr_a(path));
+        CloseHandle(file);
+        DeleteFileA(path);
+        return FALSE;
+    }
+
+    size = header.source_size + header.binary_size;
+    if (!(data = heap_alloc(size)))
+    {
+        CloseHandle(file);
+        return FALSE;
+    }
+
+    if (ReadFile(file, data, size, &read, NULL) && read == size && !memcmp(data, sources, source_size))
+    {
+        GL_EXTCALL(glProgramBinary(program_id, header.format, data + source_size, header.binary_size));
+        checkGLcall("glProgramBinary");
+        GL_EXTCALL(glGetProgramiv(program_id, GL_LINK_STATUS, &status));
+        if (!(ret = status))
+            WARN("Driver rejected cached binary for program %u.\n", program_id);
+    }
+
+    if (ret)
+    {
+        FILETIME now;
+
+        /* The write time orders the entries for eviction. */
+        GetSystemTimeAsFileTime(&now);
+        SetFileTime(file, NULL, NULL, &now);
+    }
+
+    heap_free(data);
+    CloseHandle(file);
+    return ret;
+}
+
+/* Context activation is done by the caller. */
+static void shader_glsl_store_program_binary(const struct wined3d_gl_info *gl_info,
+        GLuint program_id, UINT64 key, const char *sources, DWORD source_size)
+{
+    struct glsl_program_cache_header *header;
+    char path[MAX_PATH], tmp_path[MAX_PATH];
+    GLint status, length;
+    GLenum format;
+    DWORD written;
+    HANDLE file;
+    BOOL ret;
+
+    GL_EXTCALL(glGetProgramiv(program_id, GL_LINK_STATUS, &status));
+    if (!status)
+        return;
+    GL_EXTCALL(glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (length <= 0 || length > GLSL_PROGRAM_CACHE_MAX_SIZE)
+        return;
+
+    if (!shader_glsl_get_program_cache_path(path, sizeof(path), gl_info, key, TRUE)
+            || snprintf(tmp_path, sizeof(tmp_path), "%s.%x.tmp", path, GetCurrentThreadId()) >= sizeof(tmp_path))
+        return;
+
+    if (!(header = heap_alloc(sizeof(*header) + source_size + length)))
+        return;
+
+    GL_EXTCALL(glGetProgramBinary(program_id, length, &length, &format,
+            (char *)(header + 1) + source_size));
+    checkGLcall("glGetProgramBinary");
+
+    header->magic = GLSL_PROGRAM_CACHE_MAGIC;
+    header->version = GLSL_PROGRAM_CACHE_VERSION;
+    header->driver_id = gl_info->driver_id;
+    header->key = key;
+    header->format = format;
+    header->source_size = source_size;
+    header->binary_size = length;
+    header->reserved = 0;
+    memcpy(header + 1, sources, source_size);
+
+    /* Write to a temporary file and rename it, so that concurrent readers
+     * never see a partially written entry. */
+    file = CreateFileA(tmp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        ret = WriteFile(file, header, sizeof(*header) + source_size + length, &written, NULL)
+                && written == sizeof(*header) + source_size + length;
+        CloseHandle(file);
+        if (!ret || !MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING))
+        {
+            WARN("Failed to write program cache entry %s, error %u.\n", debugstr_a(path), GetLastError());
+            DeleteFileA(tmp_path);
+        }
+        else
+        {
+            shader_glsl_add_program_cache_entry(gl_info, written);
+        }
+    }
+
+    heap_free(header);
+}
+
+/* Context activation is done by the caller. "link_key" identifies any state
+ * bound to the program before linking that isn't part of the shader source.
+ * With "async", the link may still be in progress on return, in which case
+ * the entry is marked as pending until shader_glsl_finish_link() succeeds. */
+static void shader_glsl_link_program(const struct wined3d_gl_info *gl_info, struct shader_glsl_priv *priv,
+        struct glsl_shader_prog_link *entry, UINT64 link_key, BOOL cacheable, BOOL async)
+{
+    GLuint program_id = entry->id;
+    GLint i, shader_count, status;
+    DWORD source_size;
+    GLuint *shaders;
+    char *sources;
+    UINT64 key;
+
+    entry->pending = 0;
+    entry->store_binary = 0;
+
+    if (!shader_glsl_use_program_cache(gl_info) || !(sources = shader_glsl_get_program_sources(gl_info,
+            program_id, &shaders, &shader_count, &source_size)))
+    {
+        GL_EXTCALL(glLinkProgram(program_id));
+        if (async)
+            entry->pending = 1;
+        else
+            shader_glsl_validate_link(gl_info, program_id);
+        return;
+    }
+
+    key = wined3d_hash64(gl_info->driver_id, &link_key, sizeof(link_key));
+    key = wined3d_hash64(key, sources, source_size);
+
+    if (cacheable && shader_glsl_load_program_binary(gl_info, program_id, key, sources, source_size))
+    {
+        TRACE("Loaded program %u from the cache, key %s.\n", program_id, wine_dbgstr_longlong(key));
+        ++priv->program_cache_hits;
+    }
+    else
+    {
+        /* Compilation of the shader objects is deferred until they're
+         * actually needed, see shader_glsl_compile(). Asynchronously
+         * compiled shaders have already been submitted, and querying their
+         * status would wait for them. */
+        for (i = 0; i < shader_count && !shader_glsl_use_async_compile(gl_info); ++i)
+        {
+            GL_EXTCALL(glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &status));
+            if (status)
+                continue;
+            GL_EXTCALL(glCompileShader(shaders[i]));
+            checkGLcall("glCompileShader");
+            print_glsl_info_log(gl_info, shaders[i], FALSE);
+        }
+
+        if (cacheable)
+            GL_EXTCALL(glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        GL_EXTCALL(glLinkProgram(program_id));
+
+        if (async)
+        {
+            entry->pending = 1;
+            entry->store_binary = cacheable;
+            entry->cache_key = key;
+        }
+        else
+        {
+            shader_glsl_validate_link(gl_info, program_id);
+            if (cacheable)
+                shader_glsl_store_program_binary(gl_info, program_id, key, sources, source_size);
+        }
+
+        if (cacheable)
+            ++priv->program_cache_misses;
+    }
+
+    heap_free(sources);
+    heap_free(shaders);
+}
+
+/* Context activation is done by the caller. Returns FALSE while the driver
+ * is still linking the program. */
+static BOOL shader_glsl_finish_link(const struct wined3d_gl_info *gl_info, struct glsl_shader_prog_link *entry)
+{
+    GLint status, shader_count;
+    DWORD source_size;
+    GLuint *shaders;
+    char *sources;
+
+    GL_EXTCALL(glGetProgramiv(entry->id, GL_COMPLETION_STATUS_ARB, &status));
+    if (!status)
+        return FALSE;
+
+    TRACE("Program %u finished linking.\n", entry->id);
+    shader_glsl_validate_link(gl_info, entry->id);
+
+    if (entry->store_binary && (sources = shader_glsl_get_program_sources(gl_info,
+            entry->id, &shaders, &shader_count, &source_size)))
+    {
+        shader_glsl_store_program_binary(gl_info, entry->id, entry->cache_key, sources, source_size);
+        heap_free(sources);
+        heap_free(shaders);
+    }
+
+    entry->pending = 0;
+    entry->store_binary = 0;
+    return TRUE;
+}
+
 static BOOL shader_glsl_use_layout_qualifier(const struct wined3d_gl_info *gl_info)
 {
     /* Layout qualifiers were introduced in GLSL 1.40. The Nvidia Legacy GPU
@@ -10444,8 +10902,7 @@ static HRESULT shader_glsl_compile_compute_shader(struct shader_glsl_priv *priv,
     list_add_head(&shader->linked_programs, &entry->cs.shader_entry);
 
     TRACE("Linking GLSL shader program %u.\n", program_id);
-    GL_EXTCALL(glLinkProgram(program_id));
-    shader_glsl_validate_link(gl_info, program_id);
+    shader_glsl_link_program(gl_info, priv, entry, 0, TRUE, FALSE);
 
     GL_EXTCALL(glUseProgram(program_id));
     checkGLcall("glUseProgram");
@@ -10504,13 +10961,180 @@ static void set_glsl_compute_shader_program(const struct wined3d_context_gl *con
     ctx_data->glsl_program = entry;
 }
 
+/* Context activation is done by the caller. Sets up the program's uniform
+ * locations and bindings, once it's linked. */
+static void shader_glsl_init_program(const struct wined3d_context_gl *context_gl,
+        struct shader_glsl_priv *priv, struct glsl_shader_prog_link *entry,
+        const struct wined3d_shader *vshader, const struct wined3d_shader *hshader,
+        const struct wined3d_shader *dshader, const struct wined3d_shader *gshader,
+        const struct wined3d_shader *pshader)
+{
+    const struct wined3d_gl_info *gl_info = context_gl->gl_info;
+    const struct wined3d_shader *pre_rasterization_shader;
+    GLuint program_id = entry->id;
+    unsigned int i;
+
+    shader_glsl_init_vs_uniform_locations(gl_info, priv, program_id, &entry->vs,
+            vshader ? vshader->limits->constant_float : 0);
+    shader_glsl_init_ds_uniform_locations(gl_info, priv, program_id, &entry->ds);
+    shader_glsl_init_gs_uniform_locations(gl_info, priv, program_id, &entry->gs);
+    shader_glsl_init_ps_uniform_locations(gl_info, priv, program_id, &entry->ps,
+            pshader ? pshader->limits->constant_float : 0);
+    checkGLcall("find glsl program uniform locations");
+
+    pre_rasterization_shader = gshader ? gshader : dshader ? dshader : vshader;
+    if (pre_rasterization_shader && pre_rasterization_shader->reg_maps.shader_version.major >= 4)
+    {
+        unsigned int clip_distance_count = wined3d_popcount(pre_rasterization_shader->reg_maps.clip_distance_mask);
+        entry->shader_controlled_clip_distances = 1;
+        entry->clip_distance_mask = (1u << clip_distance_count) - 1;
+    }
+
+    if (needs_legacy_glsl_syntax(gl_info))
+    {
+        if (pshader && pshader->reg_maps.shader_version.major >= 3
+                && pshader->u.ps.declared_in_count > vec4_varyings(3, gl_info))
+        {
+            TRACE("Shader %d needs vertex color clamping disabled.\n", program_id);
+            entry->vs.vertex_color_clamp = GL_FALSE;
+        }
+        else
+        {
+            entry->vs.vertex_color_clamp = GL_FIXED_ONLY_ARB;
+        }
+    }
+    else
+    {
+        /* With core profile we never change vertex_color_clamp from
+         * GL_FIXED_ONLY_MODE (which is also the initial value) so we never call
+         * glClampColorARB(). */
+        entry->vs.vertex_color_clamp = GL_FIXED_ONLY_ARB;
+    }
+
+    /* Set the shader to allow uniform loading on it */
+    GL_EXTCALL(glUseProgram(program_id));
+    checkGLcall("glUseProgram");
+
+    entry->constant_update_mask = 0;
+    if (vshader)
+    {
+        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_F;
+        if (vshader->reg_maps.integer_constants)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_I;
+        if (vshader->reg_maps.boolean_constants)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_B;
+        if (entry->vs.pos_fixup_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
+        if (entry->vs.base_vertex_id_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_BASE_VERTEX_ID;
+
+        shader_glsl_load_program_resources(context_gl, priv, program_id, vshader);
+    }
+    else
+    {
+        entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_MODELVIEW
+                | WINED3D_SHADER_CONST_FFP_PROJ;
+
+        for (i = 0; i < MAX_VERTEX_BLENDS; ++i)
+        {
+            if (entry->vs.modelview_matrix_location[i] != -1)
+            {
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_VERTEXBLEND;
+                break;
+            }
+        }
+
+        if (entry->vs.modelview_block_index != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_VERTEXBLEND;
+
+        for (i = 0; i < WINED3D_MAX_TEXTURES; ++i)
+        {
+            if (entry->vs.texture_matrix_location[i] != -1)
+            {
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_TEXMATRIX;
+                break;
+            }
+        }
+        if (entry->vs.material_ambient_location != -1 || entry->vs.material_diffuse_location != -1
+                || entry->vs.material_specular_location != -1
+                || entry->vs.material_emissive_location != -1
+                || entry->vs.material_shininess_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_MATERIAL;
+        if (entry->vs.light_ambient_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_LIGHTS;
+    }
+    if (entry->vs.clip_planes_location != -1)
+        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_CLIP_PLANES;
+    if (entry->vs.pointsize_min_location != -1)
+        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_POINTSIZE;
+
+    if (hshader)
+        shader_glsl_load_program_resources(context_gl, priv, program_id, hshader);
+
+    if (dshader)
+    {
+        if (entry->ds.pos_fixup_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
+
+        shader_glsl_load_program_resources(context_gl, priv, program_id, dshader);
+    }
+
+    if (gshader)
+    {
+        if (entry->gs.pos_fixup_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
+
+        shader_glsl_load_program_resources(context_gl, priv, program_id, gshader);
+    }
+
+    if (entry->ps.id)
+    {
+        if (pshader)
+        {
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_F;
+            if (pshader->reg_maps.integer_constants)
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_I;
+            if (pshader->reg_maps.boolean_constants)
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_B;
+            if (entry->ps.ycorrection_location != -1)
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_Y_CORR;
+
+            shader_glsl_load_program_resources(context_gl, priv, program_id, pshader);
+            shader_glsl_load_images(gl_info, priv, program_id, &pshader->reg_maps);
+        }
+        else
+        {
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_PS;
+
+            shader_glsl_load_samplers(&context_gl->c, priv, program_id, NULL);
+        }
+
+        for (i = 0; i < WINED3D_MAX_TEXTURES; ++i)
+        {
+            if (entry->ps.bumpenv_mat_location[i] != -1)
+            {
+                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_BUMP_ENV;
+                break;
+            }
+        }
+
+        if (entry->ps.fog_color_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_FOG;
+        if (entry->ps.alpha_test_ref_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_ALPHA_TEST;
+        if (entry->ps.np2_fixup_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_NP2_FIXUP;
+        if (entry->ps.color_key_location != -1)
+            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_COLOR_KEY;
+    }
+}
+
 /* Context activation is done by the caller. */
 static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl, const struct wined3d_state *state,
         struct shader_glsl_priv *priv, struct glsl_context_data *ctx_data)
 {
     const struct wined3d_d3d_info *d3d_info = context_gl->c.d3d_info;
     const struct wined3d_gl_info *gl_info = context_gl->gl_info;
-    const struct wined3d_shader *pre_rasterization_shader;
     const struct ps_np2fixup_info *np2fixup_info = NULL;
     struct wined3d_shader *hshader, *dshader, *gshader;
     struct glsl_shader_prog_link *entry = NULL;
@@ -10527,6 +11151,8 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
     GLuint ps_id = 0;
     struct list *ps_list, *vs_list;
     WORD attribs_map;
+    BOOL stream_output;
+    UINT64 link_key;
     struct wined3d_string_buffer *tmp_name;
 
     if (!(context_gl->c.shader_update_mask & (1u << WINED3D_SHADER_TYPE_VERTEX)) && ctx_data->glsl_program)
@@ -10638,6 +11264,8 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
     key.cs_id = 0;
     if ((!vs_id && !hs_id && !ds_id && !gs_id && !ps_id) || (entry = get_glsl_program_entry(priv, &key)))
     {
+        if (entry && entry->pending && shader_glsl_finish_link(gl_info, entry))
+            shader_glsl_init_program(context_gl, priv, entry, vshader, hshader, dshader, gshader, pshader);
         ctx_data->glsl_program = entry;
         return;
     }
@@ -10696,6 +11324,10 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
         attribs_map = (1u << WINED3D_FFP_ATTRIBS_COUNT) - 1;
     }
 
+    link_key = attribs_map;
+    if (state->blend_state && state->blend_state->dual_source)
+        link_key |= (UINT64)1 << 32;
+
     if (!shader_glsl_use_explicit_attrib_location(gl_info))
     {
         /* Bind vertex attributes to a corresponding index number to match
@@ -10781,196 +11413,85 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
 
     /* Link the program */
     TRACE("Linking GLSL shader program %u.\n", program_id);
-    GL_EXTCALL(glLinkProgram(program_id));
-    shader_glsl_validate_link(gl_info, program_id);
-
-    shader_glsl_init_vs_uniform_locations(gl_info, priv, program_id, &entry->vs,
-            vshader ? vshader->limits->constant_float : 0);
-    shader_glsl_init_ds_uniform_locations(gl_info, priv, program_id, &entry->ds);
-    shader_glsl_init_gs_uniform_locations(gl_info, priv, program_id, &entry->gs);
-    shader_glsl_init_ps_uniform_locations(gl_info, priv, program_id, &entry->ps,
-            pshader ? pshader->limits->constant_float : 0);
-    checkGLcall("find glsl program uniform locations");
-
-    pre_rasterization_shader = gshader ? gshader : dshader ? dshader : vshader;
-    if (pre_rasterization_shader && pre_rasterization_shader->reg_maps.shader_version.major >= 4)
-    {
-        unsigned int clip_distance_count = wined3d_popcount(pre_rasterization_shader->reg_maps.clip_distance_mask);
-        entry->shader_controlled_clip_distances = 1;
-        entry->clip_distance_mask = (1u << clip_distance_count) - 1;
-    }
-
-    if (needs_legacy_glsl_syntax(gl_info))
-    {
-        if (pshader && pshader->reg_maps.shader_version.major >= 3
-                && pshader->u.ps.declared_in_count > vec4_varyings(3, gl_info))
-        {
-            TRACE("Shader %d needs vertex color clamping disabled.\n", program_id);
-            entry->vs.vertex_color_clamp = GL_FALSE;
-        }
-        else
-        {
-            entry->vs.vertex_color_clamp = GL_FIXED_ONLY_ARB;
-        }
-    }
-    else
-    {
-        /* With core profile we never change vertex_color_clamp from
-         * GL_FIXED_ONLY_MODE (which is also the initial value) so we never call
-         * glClampColorARB(). */
-        entry->vs.vertex_color_clamp = GL_FIXED_ONLY_ARB;
-    }
-
-    /* Set the shader to allow uniform loading on it */
-    GL_EXTCALL(glUseProgram(program_id));
-    checkGLcall("glUseProgram");
-
-    entry->constant_update_mask = 0;
-    if (vshader)
-    {
-        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_F;
-        if (vshader->reg_maps.integer_constants)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_I;
-        if (vshader->reg_maps.boolean_constants)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_B;
-        if (entry->vs.pos_fixup_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
-        if (entry->vs.base_vertex_id_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_BASE_VERTEX_ID;
-
-        shader_glsl_load_program_resources(context_gl, priv, program_id, vshader);
-    }
-    else
-    {
-        entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_MODELVIEW
-                | WINED3D_SHADER_CONST_FFP_PROJ;
-
-        for (i = 0; i < MAX_VERTEX_BLENDS; ++i)
-        {
-            if (entry->vs.modelview_matrix_location[i] != -1)
-            {
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_VERTEXBLEND;
-                break;
-            }
-        }
-
-        if (entry->vs.modelview_block_index != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_VERTEXBLEND;
-
-        for (i = 0; i < WINED3D_MAX_TEXTURES; ++i)
-        {
-            if (entry->vs.texture_matrix_location[i] != -1)
-            {
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_TEXMATRIX;
-                break;
-            }
-        }
-        if (entry->vs.material_ambient_location != -1 || entry->vs.material_diffuse_location != -1
-                || entry->vs.material_specular_location != -1
-                || entry->vs.material_emissive_location != -1
-                || entry->vs.material_shininess_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_MATERIAL;
-        if (entry->vs.light_ambient_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_LIGHTS;
-    }
-    if (entry->vs.clip_planes_location != -1)
-        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_CLIP_PLANES;
-    if (entry->vs.pointsize_min_location != -1)
-        entry->constant_update_mask |= WINED3D_SHADER_CONST_VS_POINTSIZE;
-
-    if (hshader)
-        shader_glsl_load_program_resources(context_gl, priv, program_id, hshader);
+    /* Draws with stream output can't be skipped. */
+    stream_output = gshader && gshader->u.gs.so_desc.element_count;
+    shader_glsl_link_program(gl_info, priv, entry, link_key, !stream_output,
+            !stream_output && shader_glsl_use_async_compile(gl_info));
 
-    if (dshader)
-    {
-        if (entry->ds.pos_fixup_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
-
-        shader_glsl_load_program_resources(context_gl, priv, program_id, dshader);
-    }
-
-    if (gshader)
-    {
-        if (entry->gs.pos_fixup_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_POS_FIXUP;
-
-        shader_glsl_load_program_resources(context_gl, priv, program_id, gshader);
-    }
-
-    if (ps_id)
-    {
-        if (pshader)
-        {
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_F;
-            if (pshader->reg_maps.integer_constants)
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_I;
-            if (pshader->reg_maps.boolean_constants)
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_B;
-            if (entry->ps.ycorrection_location != -1)
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_Y_CORR;
-
-            shader_glsl_load_program_resources(context_gl, priv, program_id, pshader);
-            shader_glsl_load_images(gl_info, priv, program_id, &pshader->reg_maps);
-        }
-        else
-        {
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_PS;
-
-            shader_glsl_load_samplers(&context_gl->c, priv, program_id, NULL);
-        }
-
-        for (i = 0; i < WINED3D_MAX_TEXTURES; ++i)
-        {
-            if (entry->ps.bumpenv_mat_location[i] != -1)
-            {
-                entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_BUMP_ENV;
-                break;
-            }
-        }
-
-        if (entry->ps.fog_color_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_FOG;
-        if (entry->ps.alpha_test_ref_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_ALPHA_TEST;
-        if (entry->ps.np2_fixup_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_PS_NP2_FIXUP;
-        if (entry->ps.color_key_location != -1)
-            entry->constant_update_mask |= WINED3D_SHADER_CONST_FFP_COLOR_KEY;
-    }
+    if (!entry->pending)
+        shader_glsl_init_program(context_gl, priv, entry, vshader, hshader, dshader, gshader, pshader);
 }
 
 static void shader_glsl_precompile(void *shader_priv, struct wined3d_shader *shader)
 {
+    enum wined3d_shader_type type = shader->reg_maps.shader_version.type;
+    const struct wined3d_state *state = &shader->device->cs->state;
     struct wined3d_device *device = shader->device;
+    const struct ps_np2fixup_info *np2fixup_info;
+    struct shader_glsl_priv *priv = shader_priv;
+    struct ps_compile_args ps_compile_args;
+    struct vs_compile_args vs_compile_args;
     struct wined3d_context *context;
 
-    if (shader->reg_maps.shader_version.type == WINED3D_SHADER_TYPE_COMPUTE)
+    if (type == WINED3D_SHADER_TYPE_COMPUTE)
     {
         context = context_acquire(device, NULL, 0);
         shader_glsl_compile_compute_shader(shader_priv, wined3d_context_gl(context), shader);
         context_release(context);
+        return;
+    }
+
+    /* With asynchronous compilation, start compiling the variant for the
+     * current state right away, as it's the one most likely to be drawn
+     * with. Other variants are still compiled on first use. */
+    if (!shader_glsl_use_async_compile(&device->adapter->gl_info)
+            || (type != WINED3D_SHADER_TYPE_VERTEX && type != WINED3D_SHADER_TYPE_PIXEL))
+        return;
+
+    context = context_acquire(device, NULL, 0);
+    if (type == WINED3D_SHADER_TYPE_VERTEX)
+    {
+        find_vs_compile_args(state, shader, context->stream_info.swizzle_map, &vs_compile_args, context);
+        find_glsl_vertex_shader(wined3d_context_gl(context), priv, shader, &vs_compile_args);
+    }
+    else
+    {
+        find_ps_compile_args(state, shader, context->stream_info.position_transformed, &ps_compile_args, context);
+        find_glsl_fragment_shader(wined3d_context_gl(context), &priv->shader_buffer, &priv->string_buffers,
+                shader, &ps_compile_args, &np2fixup_info);
     }
+    context_release(context);
 }
 
 /* Context activation is done by the caller. */
-static void shader_glsl_select(void *shader_priv, struct wined3d_context *context,
+static BOOL shader_glsl_select(void *shader_priv, struct wined3d_context *context,
         const struct wined3d_state *state)
 {
     struct wined3d_context_gl *context_gl = wined3d_context_gl(context);
     struct glsl_context_data *ctx_data = context->shader_backend_data;
+    struct glsl_shader_prog_link *glsl_program, *prev_program;
     const struct wined3d_gl_info *gl_info = context_gl->gl_info;
     struct shader_glsl_priv *priv = shader_priv;
-    struct glsl_shader_prog_link *glsl_program;
     GLenum current_vertex_color_clamp;
     GLuint program_id, prev_id;
 
     priv->vertex_pipe->vp_enable(context, !use_vs(state));
     priv->fragment_pipe->fp_enable(context, !use_ps(state));
 
-    prev_id = ctx_data->glsl_program ? ctx_data->glsl_program->id : 0;
+    prev_program = ctx_data->glsl_program;
+    prev_id = prev_program ? prev_program->id : 0;
     set_glsl_shader_program(context_gl, state, priv, ctx_data);
     glsl_program = ctx_data->glsl_program;
 
+    if (glsl_program && glsl_program->pending)
+    {
+        /* The shader update mask is left as is, so that the next draw checks
+         * again. */
+        TRACE("GLSL program %u is still being linked.\n", glsl_program->id);
+        ctx_data->glsl_program = prev_program;
+        return FALSE;
+    }
+
     if (glsl_program)
     {
         program_id = glsl_program->id;
@@ -11010,6 +11531,8 @@ static void shader_glsl_select(void *shader_priv, struct wined3d_context *contex
     }
 
     context->shader_update_mask |= (1u << WINED3D_SHADER_TYPE_COMPUTE);
+
+    return TRUE;
 }
 
 /* Context activation is done by the caller. */
@@ -11456,6 +11979,7 @@ static void shader_glsl_free(struct wined3d_device *device, struct wined3d_conte
         checkGLcall("glDeleteBuffers");
         priv->ubo_vs_c = -1;
     }
+    TRACE("Program cache hits %u, misses %u.\n", priv->program_cache_hits, priv->program_cache_misses);
     heap_free(device->shader_priv);
     device->shader_priv = NULL;
 }
@@ -3199,13 +3199,15 @@ static void shader_none_free_context_data(struct wined3d_context *context) {}
 static void shader_none_init_context_state(struct wined3d_context *context) {}
 
 /* Context activation is done by the caller. */
-static void shader_none_select(void *shader_priv, struct wined3d_context *context,
+static BOOL shader_none_select(void *shader_priv, struct wined3d_context *context,
         const struct wined3d_state *state)
 {
     struct shader_none_priv *priv = shader_priv;
 
     priv->vertex_pipe->vp_enable(context, !use_vs(state));
     priv->fragment_pipe->fp_enable(context, !use_ps(state));
+
+    return TRUE;
 }
 
 /* Context activation is done by the caller. */
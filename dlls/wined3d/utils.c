@@ -1127,19 +1127,166 @@ static BOOL color_in_range(const struct wined3d_color_key *color_key, DWORD colo
             && color <= color_key->color_space_high_value;
 }
 
+/* The color key conversions run for every upload of a color keyed texture,
+ * which makes them hot for older d3d applications streaming textures. The
+ * SSE2 row functions below handle as many pixels of a row as they can, and
+ * return the number of pixels converted; the scalar loops convert the rest.
+ * Both produce identical results. */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) \
+        && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+#define WINED3D_COLOR_KEY_SSE2
+
+typedef DWORD wined3d_u32x4 __attribute__((vector_size(16)));
+typedef DWORD wined3d_u32x4_u __attribute__((vector_size(16), aligned(1), may_alias));
+typedef WORD wined3d_u16x8 __attribute__((vector_size(16)));
+typedef WORD wined3d_u16x8_u __attribute__((vector_size(16), aligned(1), may_alias));
+
+static BOOL color_key_use_sse2(void)
+{
+    static int use_sse2 = -1;
+
+    if (use_sse2 == -1)
+        use_sse2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+    return use_sse2;
+}
+
+static unsigned int __attribute__((target("sse2"))) convert_b5g6r5_color_key_row_sse2(const WORD *src,
+        WORD *dst, unsigned int width, const struct wined3d_color_key *color_key)
+{
+    const WORD l = color_key->color_space_low_value, h = min(color_key->color_space_high_value, 0xffff);
+    const wined3d_u16x8 low = {l, l, l, l, l, l, l, l}, high = {h, h, h, h, h, h, h, h};
+    const wined3d_u16x8 rg_mask = {0xffc0, 0xffc0, 0xffc0, 0xffc0, 0xffc0, 0xffc0, 0xffc0, 0xffc0};
+    const wined3d_u16x8 b_mask = {0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f};
+    const wined3d_u16x8 alpha = {0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000};
+    wined3d_u16x8 c, in_range;
+    unsigned int x;
+
+    if (color_key->color_space_low_value > 0xffff)
+        return 0;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        c = *(const wined3d_u16x8_u *)&src[x];
+        in_range = (wined3d_u16x8)((c >= low) & (c <= high));
+        *(wined3d_u16x8_u *)&dst[x] = ((c & rg_mask) >> 1) | (c & b_mask) | (~in_range & alpha);
+    }
+
+    return x;
+}
+
+static unsigned int __attribute__((target("sse2"))) convert_b5g5r5x1_color_key_row_sse2(const WORD *src,
+        WORD *dst, unsigned int width, const struct wined3d_color_key *color_key)
+{
+    const WORD l = color_key->color_space_low_value, h = min(color_key->color_space_high_value, 0xffff);
+    const wined3d_u16x8 low = {l, l, l, l, l, l, l, l}, high = {h, h, h, h, h, h, h, h};
+    const wined3d_u16x8 alpha = {0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000, 0x8000};
+    wined3d_u16x8 c, in_range;
+    unsigned int x;
+
+    if (color_key->color_space_low_value > 0xffff)
+        return 0;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        c = *(const wined3d_u16x8_u *)&src[x];
+        in_range = (wined3d_u16x8)((c >= low) & (c <= high));
+        *(wined3d_u16x8_u *)&dst[x] = (c | alpha) & ~(in_range & alpha);
+    }
+
+    return x;
+}
+
+static unsigned int __attribute__((target("sse2"))) convert_b8g8r8_color_key_row_sse2(const BYTE *src,
+        DWORD *dst, unsigned int width, const struct wined3d_color_key *color_key)
+{
+    const DWORD l = color_key->color_space_low_value, h = color_key->color_space_high_value;
+    const wined3d_u32x4 low = {l, l, l, l}, high = {h, h, h, h};
+    const wined3d_u32x4 alpha = {0xff000000, 0xff000000, 0xff000000, 0xff000000};
+    const wined3d_u32x4 rgb_mask = {0x00ffffff, 0x00ffffff, 0x00ffffff, 0x00ffffff};
+    wined3d_u32x4 c, in_range;
+    DWORD p[4];
+    unsigned int x;
+
+    /* Each pixel is loaded as a DWORD, so the last pixel of the row is left
+     * to the scalar loop to avoid reading past the end of the row. Pixels
+     * inside the color key range are left untouched in the destination, like
+     * the scalar loop does. */
+    for (x = 0; x + 4 < width; x += 4)
+    {
+        memcpy(&p[0], &src[x * 3], sizeof(*p));
+        memcpy(&p[1], &src[x * 3 + 3], sizeof(*p));
+        memcpy(&p[2], &src[x * 3 + 6], sizeof(*p));
+        memcpy(&p[3], &src[x * 3 + 9], sizeof(*p));
+        c = (wined3d_u32x4){p[0], p[1], p[2], p[3]} & rgb_mask;
+        in_range = (wined3d_u32x4)((c >= low) & (c <= high));
+        *(wined3d_u32x4_u *)&dst[x] = (*(const wined3d_u32x4_u *)&dst[x] & in_range) | ((c | alpha) & ~in_range);
+    }
+
+    return x;
+}
+
+static unsigned int __attribute__((target("sse2"))) convert_b8g8r8x8_color_key_row_sse2(const DWORD *src,
+        DWORD *dst, unsigned int width, const struct wined3d_color_key *color_key)
+{
+    const DWORD l = color_key->color_space_low_value, h = color_key->color_space_high_value;
+    const wined3d_u32x4 low = {l, l, l, l}, high = {h, h, h, h};
+    const wined3d_u32x4 alpha = {0xff000000, 0xff000000, 0xff000000, 0xff000000};
+    wined3d_u32x4 c, in_range;
+    unsigned int x;
+
+    for (x = 0; x + 4 <= width; x += 4)
+    {
+        c = *(const wined3d_u32x4_u *)&src[x];
+        in_range = (wined3d_u32x4)((c >= low) & (c <= high));
+        *(wined3d_u32x4_u *)&dst[x] = (c | alpha) & ~(in_range & alpha);
+    }
+
+    return x;
+}
+
+static unsigned int __attribute__((target("sse2"))) convert_b8g8r8a8_color_key_row_sse2(const DWORD *src,
+        DWORD *dst, unsigned int width, const struct wined3d_color_key *color_key)
+{
+    const DWORD l = color_key->color_space_low_value, h = color_key->color_space_high_value;
+    const wined3d_u32x4 low = {l, l, l, l}, high = {h, h, h, h};
+    const wined3d_u32x4 alpha = {0xff000000, 0xff000000, 0xff000000, 0xff000000};
+    wined3d_u32x4 c, in_range;
+    unsigned int x;
+
+    for (x = 0; x + 4 <= width; x += 4)
+    {
+        c = *(const wined3d_u32x4_u *)&src[x];
+        in_range = (wined3d_u32x4)((c >= low) & (c <= high));
+        *(wined3d_u32x4_u *)&dst[x] = c & ~(in_range & alpha);
+    }
+
+    return x;
+}
+#endif
+
 static void convert_b5g6r5_unorm_b5g5r5a1_unorm_color_key(const BYTE *src, unsigned int src_pitch,
         BYTE *dst, unsigned int dst_pitch, unsigned int width, unsigned int height,
         const struct wined3d_color_key *color_key)
 {
+    BOOL use_sse2 = FALSE;
     const WORD *src_row;
     unsigned int x, y;
     WORD *dst_row;
 
+#ifdef WINED3D_COLOR_KEY_SSE2
+    use_sse2 = color_key_use_sse2();
+#endif
+
     for (y = 0; y < height; ++y)
     {
         src_row = (WORD *)&src[src_pitch * y];
         dst_row = (WORD *)&dst[dst_pitch * y];
-        for (x = 0; x < width; ++x)
+        x = 0;
+#ifdef WINED3D_COLOR_KEY_SSE2
+        if (use_sse2)
+            x = convert_b5g6r5_color_key_row_sse2(src_row, dst_row, width, color_key);
+#endif
+        for (; x < width; ++x)
         {
             WORD src_color = src_row[x];
             if (!color_in_range(color_key, src_color))
@@ -1154,15 +1301,25 @@ static void convert_b5g5r5x1_unorm_b5g5r5a1_unorm_color_key(const BYTE *src, uns
         BYTE *dst, unsigned int dst_pitch, unsigned int width, unsigned int height,
         const struct wined3d_color_key *color_key)
 {
+    BOOL use_sse2 = FALSE;
     const WORD *src_row;
     unsigned int x, y;
     WORD *dst_row;
 
+#ifdef WINED3D_COLOR_KEY_SSE2
+    use_sse2 = color_key_use_sse2();
+#endif
+
     for (y = 0; y < height; ++y)
     {
         src_row = (WORD *)&src[src_pitch * y];
         dst_row = (WORD *)&dst[dst_pitch * y];
-        for (x = 0; x < width; ++x)
+        x = 0;
+#ifdef WINED3D_COLOR_KEY_SSE2
+        if (use_sse2)
+            x = convert_b5g5r5x1_color_key_row_sse2(src_row, dst_row, width, color_key);
+#endif
+        for (; x < width; ++x)
         {
             WORD src_color = src_row[x];
             if (color_in_range(color_key, src_color))
@@ -1177,15 +1334,25 @@ static void convert_b8g8r8_unorm_b8g8r8a8_unorm_color_key(const BYTE *src, unsig
         BYTE *dst, unsigned int dst_pitch, unsigned int width, unsigned int height,
         const struct wined3d_color_key *color_key)
 {
+    BOOL use_sse2 = FALSE;
     const BYTE *src_row;
     unsigned int x, y;
     DWORD *dst_row;
 
+#ifdef WINED3D_COLOR_KEY_SSE2
+    use_sse2 = color_key_use_sse2();
+#endif
+
     for (y = 0; y < height; ++y)
     {
         src_row = &src[src_pitch * y];
         dst_row = (DWORD *)&dst[dst_pitch * y];
-        for (x = 0; x < width; ++x)
+        x = 0;
+#ifdef WINED3D_COLOR_KEY_SSE2
+        if (use_sse2)
+            x = convert_b8g8r8_color_key_row_sse2(src_row, dst_row, width, color_key);
+#endif
+        for (; x < width; ++x)
         {
             DWORD src_color = (src_row[x * 3 + 2] << 16) | (src_row[x * 3 + 1] << 8) | src_row[x * 3];
             if (!color_in_range(color_key, src_color))
@@ -1198,15 +1365,25 @@ static void convert_b8g8r8x8_unorm_b8g8r8a8_unorm_color_key(const BYTE *src, uns
         BYTE *dst, unsigned int dst_pitch, unsigned int width, unsigned int height,
         const struct wined3d_color_key *color_key)
 {
+    BOOL use_sse2 = FALSE;
     const DWORD *src_row;
     unsigned int x, y;
     DWORD *dst_row;
 
+#ifdef WINED3D_COLOR_KEY_SSE2
+    use_sse2 = color_key_use_sse2();
+#endif
+
     for (y = 0; y < height; ++y)
     {
         src_row = (DWORD *)&src[src_pitch * y];
         dst_row = (DWORD *)&dst[dst_pitch * y];
-        for (x = 0; x < width; ++x)
+        x = 0;
+#ifdef WINED3D_COLOR_KEY_SSE2
+        if (use_sse2)
+            x = convert_b8g8r8x8_color_key_row_sse2(src_row, dst_row, width, color_key);
+#endif
+        for (; x < width; ++x)
         {
             DWORD src_color = src_row[x];
             if (color_in_range(color_key, src_color))
@@ -1221,15 +1398,25 @@ static void convert_b8g8r8a8_unorm_b8g8r8a8_unorm_color_key(const BYTE *src, uns
         BYTE *dst, unsigned int dst_pitch, unsigned int width, unsigned int height,
         const struct wined3d_color_key *color_key)
 {
+    BOOL use_sse2 = FALSE;
     const DWORD *src_row;
     unsigned int x, y;
     DWORD *dst_row;
 
+#ifdef WINED3D_COLOR_KEY_SSE2
+    use_sse2 = color_key_use_sse2();
+#endif
+
     for (y = 0; y < height; ++y)
     {
         src_row = (DWORD *)&src[src_pitch * y];
         dst_row = (DWORD *)&dst[dst_pitch * y];
-        for (x = 0; x < width; ++x)
+        x = 0;
+#ifdef WINED3D_COLOR_KEY_SSE2
+        if (use_sse2)
+            x = convert_b8g8r8a8_color_key_row_sse2(src_row, dst_row, width, color_key);
+#endif
+        for (; x < width; ++x)
         {
             DWORD src_color = src_row[x];
             if (color_in_range(color_key, src_color))
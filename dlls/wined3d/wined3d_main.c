@@ -120,6 +120,9 @@ struct wined3d_settings wined3d_settings =
     ~0u,            /* No CS shader model limit by default. */
     WINED3D_RENDERER_AUTO,
     WINED3D_SHADER_BACKEND_AUTO,
+    TRUE,           /* Cache linked GLSL programs on disk. */
+    NULL,           /* Shader cache in the user's local application data by default. */
+    FALSE,          /* Link shader programs synchronously by default. */
 };
 
 struct wined3d * CDECL wined3d_create(DWORD flags)
@@ -395,6 +398,27 @@ static BOOL wined3d_dll_init(HINSTANCE hInstDLL)
                 wined3d_settings.renderer = WINED3D_RENDERER_NO3D;
             }
         }
+        if (!get_config_key(hkey, appkey, "ShaderCache", buffer, size)
+                && !strcmp(buffer, "disabled"))
+        {
+            TRACE("Disabling the shader cache.\n");
+            wined3d_settings.shader_cache = FALSE;
+        }
+        if (!get_config_key(hkey, appkey, "ShaderCachePath", buffer, size))
+        {
+            size_t len = strlen(buffer) + 1;
+
+            if (!(wined3d_settings.shader_cache_path = heap_alloc(len)))
+                ERR("Failed to allocate shader cache path memory.\n");
+            else
+                memcpy(wined3d_settings.shader_cache_path, buffer, len);
+        }
+        if (!get_config_key(hkey, appkey, "AsyncShaderCompile", buffer, size)
+                && !strcmp(buffer, "enabled"))
+        {
+            ERR_(winediag)("Compiling shaders asynchronously. Draws will be skipped until their shaders are ready.\n");
+            wined3d_settings.async_shader_compile = TRUE;
+        }
     }
 
     if (appkey) RegCloseKey( appkey );
@@ -435,6 +459,7 @@ static BOOL wined3d_dll_destroy(HINSTANCE hInstDLL)
     heap_free(hook_table.hooks);
 
     heap_free(wined3d_settings.logo);
+    heap_free(wined3d_settings.shader_cache_path);
     UnregisterClassA(WINED3D_OPENGL_WINDOW_CLASS_NAME, hInstDLL);
 
     DeleteCriticalSection(&wined3d_wndproc_cs);
@@ -390,6 +390,22 @@ static inline void wined3d_pause(void)
 #endif
 }
 
+/* 64-bit FNV-1a. Start with WINED3D_HASH64_INIT, and chain calls by passing
+ * the previous result as "hash". */
+#define WINED3D_HASH64_INIT 0xcbf29ce484222325ull
+
+static inline UINT64 wined3d_hash64(UINT64 hash, const void *data, size_t size)
+{
+    const BYTE *p = data;
+
+    while (size--)
+    {
+        hash ^= *p++;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
 #define ORM_BACKBUFFER  0
 #define ORM_FBO         1
 
@@ -437,6 +453,9 @@ struct wined3d_settings
     unsigned int max_sm_cs;
     enum wined3d_renderer renderer;
     enum wined3d_shader_backend shader_backend;
+    BOOL shader_cache;
+    char *shader_cache_path;
+    BOOL async_shader_compile;
 };
 
 extern struct wined3d_settings wined3d_settings DECLSPEC_HIDDEN;
@@ -1446,7 +1465,8 @@ struct wined3d_shader_backend_ops
 {
     void (*shader_handle_instruction)(const struct wined3d_shader_instruction *);
     void (*shader_precompile)(void *shader_priv, struct wined3d_shader *shader);
-    void (*shader_select)(void *shader_priv, struct wined3d_context *context,
+    /* Returns FALSE if the shaders for "state" aren't ready to be used yet. */
+    BOOL (*shader_select)(void *shader_priv, struct wined3d_context *context,
             const struct wined3d_state *state);
     void (*shader_select_compute)(void *shader_priv, struct wined3d_context *context,
             const struct wined3d_state *state);
@@ -2877,6 +2897,7 @@ struct wined3d_gl_info
     struct wined3d_gl_limits limits;
     DWORD reserved_glsl_constants, reserved_arb_constants;
     DWORD quirks;
+    UINT64 driver_id;
     BOOL supported[WINED3D_GL_EXT_COUNT];
     GLint wrap_lookup[WINED3D_TADDRESS_MIRROR_ONCE - WINED3D_TADDRESS_WRAP + 1];
 
@@ -3490,12 +3511,49 @@ static inline struct wined3d_device_no3d *wined3d_device_no3d(struct wined3d_dev
     return CONTAINING_RECORD(device, struct wined3d_device_no3d, d);
 }
 
+#define WINED3D_UPLOAD_RING_SIZE            (8 * 1024 * 1024)
+#define WINED3D_UPLOAD_RING_SEGMENT_COUNT   8
+
+/* A persistently mapped, coherent buffer object that buffer uploads and
+ * dynamic buffer maps are staged through. It is split into segments; a fence
+ * is issued when the head leaves a segment, and waited on before the head
+ * enters it again. Segments with buffers mapped through them are never
+ * entered. Copies out of the current segment recorded in another GL context
+ * are fenced in that context when it stops being current. */
+struct wined3d_upload_ring_gl
+{
+    struct wined3d_bo_gl bo;
+    BYTE *map_ptr;
+    unsigned int head;
+    unsigned int segment;
+    GLsync fences[WINED3D_UPLOAD_RING_SEGMENT_COUNT];
+    unsigned int generations[WINED3D_UPLOAD_RING_SEGMENT_COUNT];
+    unsigned int pin_counts[WINED3D_UPLOAD_RING_SEGMENT_COUNT];
+    /* Context with unfenced copies out of the current segment. */
+    struct wined3d_context_gl *copy_context;
+
+    /* Statistics, traced when the ring is destroyed. */
+    unsigned int upload_count;  /* buffer uploads staged through the ring */
+    unsigned int map_count;     /* buffer maps served from the ring */
+    unsigned int wrap_count;
+    unsigned int stall_count;   /* waits for the GPU to release a segment */
+};
+
+void wined3d_upload_ring_gl_cleanup(struct wined3d_upload_ring_gl *ring,
+        struct wined3d_context_gl *context_gl) DECLSPEC_HIDDEN;
+void wined3d_upload_ring_gl_init(struct wined3d_upload_ring_gl *ring,
+        struct wined3d_context_gl *context_gl) DECLSPEC_HIDDEN;
+void wined3d_upload_ring_gl_leave_context(struct wined3d_upload_ring_gl *ring,
+        struct wined3d_context_gl *context_gl) DECLSPEC_HIDDEN;
+
 struct wined3d_device_gl
 {
     struct wined3d_device d;
 
     /* Textures for when no other textures are bound. */
     struct wined3d_dummy_textures dummy_textures;
+
+    struct wined3d_upload_ring_gl upload_ring;
 };
 
 static inline struct wined3d_device_gl *wined3d_device_gl(struct wined3d_device *device)
@@ -4249,12 +4307,16 @@ struct wined3d_cs
     HANDLE event;
     BOOL waiting_for_event;
     LONG pending_presents;
+    unsigned int batch_depth;
 };
 
+void wined3d_cs_begin_batch(struct wined3d_cs *cs) DECLSPEC_HIDDEN;
 struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device) DECLSPEC_HIDDEN;
 void wined3d_cs_destroy(struct wined3d_cs *cs) DECLSPEC_HIDDEN;
 void wined3d_cs_destroy_object(struct wined3d_cs *cs,
         void (*callback)(void *object), void *object) DECLSPEC_HIDDEN;
+void wined3d_cs_end_batch(struct wined3d_cs *cs) DECLSPEC_HIDDEN;
+void wined3d_cs_wake(struct wined3d_cs *cs) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_add_dirty_texture_region(struct wined3d_cs *cs,
         struct wined3d_texture *texture, unsigned int layer) DECLSPEC_HIDDEN;
 void wined3d_cs_emit_blt_sub_resource(struct wined3d_cs *cs, struct wined3d_resource *dst_resource,
@@ -4358,11 +4420,15 @@ static inline void wined3d_cs_push_constants(struct wined3d_cs *cs, enum wined3d
 
 static inline void wined3d_resource_wait_idle(struct wined3d_resource *resource)
 {
-    const struct wined3d_cs *cs = resource->device->cs;
+    struct wined3d_cs *cs = resource->device->cs;
 
     if (!cs->thread || cs->thread_id == GetCurrentThreadId())
         return;
 
+    if (!InterlockedCompareExchange(&resource->access_count, 0, 0))
+        return;
+
+    wined3d_cs_wake(cs);
     while (InterlockedCompareExchange(&resource->access_count, 0, 0))
         wined3d_pause();
 }
@@ -4440,6 +4506,10 @@ struct wined3d_buffer_gl
 
     struct wined3d_bo_gl bo;
     GLenum buffer_object_usage;
+
+    /* Upload ring range of the last DISCARD map served from the ring. */
+    unsigned int ring_offset;
+    unsigned int ring_generation;
 };
 
 static inline struct wined3d_buffer_gl *wined3d_buffer_gl(struct wined3d_buffer *buffer)
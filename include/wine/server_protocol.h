@@ -56,6 +56,7 @@ struct request_max_size
 typedef struct
 {
     unsigned int last_input_time;
+    unsigned int registry_seq;
 } shmglobal_t;
 
 typedef struct
@@ -66,6 +67,19 @@ typedef struct
     user_handle_t   input_active;
 } shmlocal_t;
 
+#define SHARED_HANDLE_ENTRIES  16384
+#define SHARED_HANDLE_IN_USE   0x80000000
+
+
+typedef struct
+{
+    unsigned int    seq;
+    unsigned int    flags;
+    unsigned int    access;
+    unsigned int    type;
+    unsigned __int64 object;
+} shared_handle_t;
+
 
 typedef union
 {
@@ -1662,6 +1676,18 @@ struct get_shared_memory_reply
 
 
 
+struct get_shared_handles_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_shared_handles_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct flush_request
 {
     struct request_header __header;
@@ -2471,6 +2497,36 @@ struct get_mapping_file_reply
 
 
 
+struct add_image_cache_request
+{
+    struct request_header __header;
+    obj_handle_t mapping;
+    obj_handle_t pages;
+    char __pad_20[4];
+    client_ptr_t base;
+};
+struct add_image_cache_reply
+{
+    struct reply_header __header;
+};
+
+
+
+struct get_image_cache_request
+{
+    struct request_header __header;
+    obj_handle_t mapping;
+    client_ptr_t base;
+};
+struct get_image_cache_reply
+{
+    struct reply_header __header;
+    obj_handle_t pages;
+    char __pad_12[4];
+};
+
+
+
 struct get_mapping_committed_range_request
 {
     struct request_header __header;
@@ -5682,6 +5738,28 @@ struct remove_completion_reply
 };
 
 
+struct completion_msg
+{
+    apc_param_t   ckey;
+    apc_param_t   cvalue;
+    apc_param_t   information;
+    unsigned int  status;
+    int           __pad;
+};
+
+
+struct remove_completions_request
+{
+    struct request_header __header;
+    obj_handle_t  handle;
+};
+struct remove_completions_reply
+{
+    struct reply_header __header;
+    /* VARARG(msgs,completion_msgs); */
+};
+
+
 
 struct query_completion_request
 {
@@ -6281,6 +6359,7 @@ enum request
     REQ_get_handle_fd,
     REQ_get_directory_cache_entry,
     REQ_get_shared_memory,
+    REQ_get_shared_handles,
     REQ_flush,
     REQ_get_file_info,
     REQ_get_volume_info,
@@ -6325,6 +6404,8 @@ enum request
     REQ_map_view,
     REQ_unmap_view,
     REQ_get_mapping_file,
+    REQ_add_image_cache,
+    REQ_get_image_cache,
     REQ_get_mapping_committed_range,
     REQ_add_mapping_committed_range,
     REQ_is_same_mapping,
@@ -6517,6 +6598,7 @@ enum request
     REQ_open_completion,
     REQ_add_completion,
     REQ_remove_completion,
+    REQ_remove_completions,
     REQ_query_completion,
     REQ_set_completion_info,
     REQ_add_fd_completion,
@@ -6609,6 +6691,7 @@ union generic_request
     struct get_handle_fd_request get_handle_fd_request;
     struct get_directory_cache_entry_request get_directory_cache_entry_request;
     struct get_shared_memory_request get_shared_memory_request;
+    struct get_shared_handles_request get_shared_handles_request;
     struct flush_request flush_request;
     struct get_file_info_request get_file_info_request;
     struct get_volume_info_request get_volume_info_request;
@@ -6653,6 +6736,8 @@ union generic_request
     struct map_view_request map_view_request;
     struct unmap_view_request unmap_view_request;
     struct get_mapping_file_request get_mapping_file_request;
+    struct add_image_cache_request add_image_cache_request;
+    struct get_image_cache_request get_image_cache_request;
     struct get_mapping_committed_range_request get_mapping_committed_range_request;
     struct add_mapping_committed_range_request add_mapping_committed_range_request;
     struct is_same_mapping_request is_same_mapping_request;
@@ -6845,6 +6930,7 @@ union generic_request
     struct open_completion_request open_completion_request;
     struct add_completion_request add_completion_request;
     struct remove_completion_request remove_completion_request;
+    struct remove_completions_request remove_completions_request;
     struct query_completion_request query_completion_request;
     struct set_completion_info_request set_completion_info_request;
     struct add_fd_completion_request add_fd_completion_request;
@@ -6935,6 +7021,7 @@ union generic_reply
     struct get_handle_fd_reply get_handle_fd_reply;
     struct get_directory_cache_entry_reply get_directory_cache_entry_reply;
     struct get_shared_memory_reply get_shared_memory_reply;
+    struct get_shared_handles_reply get_shared_handles_reply;
     struct flush_reply flush_reply;
     struct get_file_info_reply get_file_info_reply;
     struct get_volume_info_reply get_volume_info_reply;
@@ -6979,6 +7066,8 @@ union generic_reply
     struct map_view_reply map_view_reply;
     struct unmap_view_reply unmap_view_reply;
     struct get_mapping_file_reply get_mapping_file_reply;
+    struct add_image_cache_reply add_image_cache_reply;
+    struct get_image_cache_reply get_image_cache_reply;
     struct get_mapping_committed_range_reply get_mapping_committed_range_reply;
     struct add_mapping_committed_range_reply add_mapping_committed_range_reply;
     struct is_same_mapping_reply is_same_mapping_reply;
@@ -7171,6 +7260,7 @@ union generic_reply
     struct open_completion_reply open_completion_reply;
     struct add_completion_reply add_completion_reply;
     struct remove_completion_reply remove_completion_reply;
+    struct remove_completions_reply remove_completions_reply;
     struct query_completion_reply query_completion_reply;
     struct set_completion_info_reply set_completion_info_reply;
     struct add_fd_completion_reply add_fd_completion_reply;
@@ -7210,7 +7300,7 @@ union generic_reply
 
 /* ### protocol_version begin ### */
 
-#define SERVER_PROTOCOL_VERSION 604
+#define SERVER_PROTOCOL_VERSION 610
 
 /* ### protocol_version end ### */
 
@@ -1712,14 +1712,14 @@ typedef struct _DEBUG_BUFFER {
   HANDLE SectionHandle;
   PVOID  SectionBase;
   PVOID  RemoteSectionBase;
-  ULONG  SectionBaseDelta;
+  ULONG_PTR SectionBaseDelta;
   HANDLE EventPairHandle;
-  ULONG  Unknown[2];
+  HANDLE Unknown[2];
   HANDLE RemoteThreadHandle;
   ULONG  InfoClassMask;
-  ULONG  SizeOfInfo;
-  ULONG  AllocatedSize;
-  ULONG  SectionSize;
+  SIZE_T SizeOfInfo;
+  SIZE_T AllocatedSize;
+  SIZE_T SectionSize;
   PVOID  ModuleInformation;
   PVOID  BackTraceInformation;
   PVOID  HeapInformation;
@@ -1764,8 +1764,8 @@ typedef struct _DEBUG_LOCK_INFORMATION {
   PVOID  Address;
   USHORT Type;
   USHORT CreatorBackTraceIndex;
-  ULONG  OwnerThreadId;
-  ULONG  ActiveCount;
+  ULONG_PTR OwnerThreadId;
+  LONG   ActiveCount;
   ULONG  ContentionCount;
   ULONG  EntryCount;
   ULONG  RecursionCount;
@@ -3037,6 +3037,7 @@ NTSYSAPI NTSTATUS  WINAPI RtlQueryInformationActivationContext(ULONG,HANDLE,PVOI
 NTSYSAPI BOOL      WINAPI RtlQueryPerformanceCounter(LARGE_INTEGER*);
 NTSYSAPI BOOL      WINAPI RtlQueryPerformanceFrequency(LARGE_INTEGER*);
 NTSYSAPI NTSTATUS  WINAPI RtlQueryProcessDebugInformation(ULONG,ULONG,PDEBUG_BUFFER);
+NTSYSAPI NTSTATUS  WINAPI RtlQueryProcessLockInformation(PDEBUG_BUFFER);
 NTSYSAPI NTSTATUS  WINAPI RtlQueryRegistryValues(ULONG, PCWSTR, PRTL_QUERY_REGISTRY_TABLE, PVOID, PVOID);
 NTSYSAPI NTSTATUS  WINAPI RtlQueryTimeZoneInformation(RTL_TIME_ZONE_INFORMATION*);
 NTSYSAPI BOOL      WINAPI RtlQueryUnbiasedInterruptTime(ULONGLONG*);
@@ -93,6 +93,12 @@
 #ifdef HAVE_SYS_SYSCALL_H
 #include <sys/syscall.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -500,8 +506,310 @@ static inline void fd_poll_event( struct fd *fd, int event )
 
 static int epoll_fd = -1;
 
+#ifdef HAVE_LINUX_IO_URING_H
+
+/* io_uring backend: fd polling is done with one-shot IORING_OP_POLL_ADD requests that are
+ * re-armed after each event, so that changes to the polled events get batched with the wait
+ * in a single io_uring_enter call instead of costing one epoll_ctl call each. */
+
+#define URING_ENTRIES      1024
+#define URING_TAG_INTERNAL (~(__u64)0)  /* user_data of removal and timeout requests */
+
+static struct
+{
+    int                  fd;         /* io_uring file descriptor */
+    void                *ring_ptr;   /* mapping of the submission and completion queue rings */
+    size_t               ring_size;
+    unsigned int        *sq_head;    /* submission queue ring */
+    unsigned int        *sq_tail;
+    unsigned int        *sq_mask;
+    unsigned int        *sq_array;
+    unsigned int         sq_entries;
+    unsigned int         to_submit;  /* number of queued entries not submitted yet */
+    struct io_uring_sqe *sqes;
+    unsigned int        *cq_head;    /* completion queue ring */
+    unsigned int        *cq_tail;
+    unsigned int        *cq_mask;
+    struct io_uring_cqe *cqes;
+} uring = { -1 };
+
+/* poll state of each user, indexed like the poll array */
+struct uring_user
+{
+    unsigned int gen;    /* generation, to recognize completions of cancelled polls */
+    unsigned int armed;  /* is a poll currently queued for this user? */
+};
+
+static struct uring_user *uring_users;
+static int uring_users_size;
+
+static inline int io_uring_setup( unsigned int entries, struct io_uring_params *params )
+{
+    return syscall( __NR_io_uring_setup, entries, params );
+}
+
+static inline int io_uring_enter( int fd, unsigned int to_submit, unsigned int min_complete,
+                                  unsigned int flags )
+{
+    return syscall( __NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0 );
+}
+
+static int init_uring(void)
+{
+    struct io_uring_params params;
+    const char *env = getenv( "WINEIOURING" );
+    size_t sq_size, cq_size;
+    char *sq_ptr, *cq_ptr;
+    void *sqes;
+    int fd;
+
+    if (!env || !atoi( env )) return 0;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = io_uring_setup( URING_ENTRIES, &params )) == -1) return 0;
+    /* we rely on the kernel not dropping completions when the ring is full */
+    if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_SINGLE_MMAP))
+        goto failed;
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_size > sq_size) sq_size = cq_size;
+
+    sq_ptr = mmap( NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQ_RING );
+    if (sq_ptr == MAP_FAILED) goto failed;
+    sqes = mmap( NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if (sqes == MAP_FAILED)
+    {
+        munmap( sq_ptr, sq_size );
+        goto failed;
+    }
+    cq_ptr = sq_ptr;
+
+    uring.sq_head    = (unsigned int *)(sq_ptr + params.sq_off.head);
+    uring.sq_tail    = (unsigned int *)(sq_ptr + params.sq_off.tail);
+    uring.sq_mask    = (unsigned int *)(sq_ptr + params.sq_off.ring_mask);
+    uring.sq_array   = (unsigned int *)(sq_ptr + params.sq_off.array);
+    uring.sq_entries = params.sq_entries;
+    uring.sqes       = sqes;
+    uring.cq_head    = (unsigned int *)(cq_ptr + params.cq_off.head);
+    uring.cq_tail    = (unsigned int *)(cq_ptr + params.cq_off.tail);
+    uring.cq_mask    = (unsigned int *)(cq_ptr + params.cq_off.ring_mask);
+    uring.cqes       = (struct io_uring_cqe *)(cq_ptr + params.cq_off.cqes);
+    uring.ring_ptr   = sq_ptr;
+    uring.ring_size  = sq_size;
+    uring.fd         = fd;
+    return 1;
+
+failed:
+    close( fd );
+    return 0;
+}
+
+/* give up on io_uring, the plain poll loop will take over */
+static void uring_failed( const char *func )
+{
+    perror( func );
+    munmap( uring.sqes, uring.sq_entries * sizeof(struct io_uring_sqe) );
+    munmap( uring.ring_ptr, uring.ring_size );
+    close( uring.fd );
+    uring.fd = -1;
+    uring.to_submit = 0;
+}
+
+/* submit the queued requests */
+static void uring_submit(void)
+{
+    int ret;
+
+    while (uring.to_submit)
+    {
+        if ((ret = io_uring_enter( uring.fd, uring.to_submit, 0, 0 )) == -1)
+        {
+            if (errno == EINTR) continue;
+            uring_failed( "io_uring_enter" );
+            return;
+        }
+        uring.to_submit -= ret;
+    }
+}
+
+/* get a free submission queue entry, flushing the queue if necessary */
+static struct io_uring_sqe *uring_get_sqe( __u8 opcode, __u64 user_data )
+{
+    unsigned int tail, index;
+    struct io_uring_sqe *sqe;
+
+    if (uring.fd == -1) return NULL;  /* the rings are gone */
+    tail = *uring.sq_tail;
+    if (tail - __atomic_load_n( uring.sq_head, __ATOMIC_ACQUIRE ) >= uring.sq_entries)
+    {
+        uring_submit();
+        if (uring.fd == -1) return NULL;
+    }
+    index = tail & *uring.sq_mask;
+    sqe = &uring.sqes[index];
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    uring.sq_array[index] = index;
+    __atomic_store_n( uring.sq_tail, tail + 1, __ATOMIC_RELEASE );
+    uring.to_submit++;
+    return sqe;
+}
+
+static inline __u64 get_uring_tag( int user )
+{
+    return ((__u64)uring_users[user].gen << 32) | user;
+}
+
+/* queue a poll request for a user */
+static void uring_arm( int user, int unix_fd, int events )
+{
+    struct io_uring_sqe *sqe;
+
+    if (user >= uring_users_size)
+    {
+        struct uring_user *new_users;
+        int new_size = max( allocated_users, user + 1 );
+
+        if (!(new_users = realloc( uring_users, new_size * sizeof(*new_users) )))
+        {
+            uring_failed( "realloc" );
+            return;
+        }
+        memset( new_users + uring_users_size, 0,
+                (new_size - uring_users_size) * sizeof(*new_users) );
+        uring_users = new_users;
+        uring_users_size = new_size;
+    }
+    if (!(sqe = uring_get_sqe( IORING_OP_POLL_ADD, get_uring_tag( user )))) return;
+    sqe->fd = unix_fd;
+    sqe->poll_events = events;
+    uring_users[user].armed = 1;
+}
+
+/* cancel the queued poll request of a user, if any */
+static void uring_disarm( int user )
+{
+    struct io_uring_sqe *sqe;
+
+    if (user >= uring_users_size || !uring_users[user].armed) return;
+    if (!(sqe = uring_get_sqe( IORING_OP_POLL_REMOVE, URING_TAG_INTERNAL ))) return;
+    sqe->addr = get_uring_tag( user );
+    uring_users[user].armed = 0;
+    uring_users[user].gen++;  /* ignore any completion already posted for it */
+}
+
+/* io_uring version of set_fd_epoll_events */
+static inline void set_fd_uring_events( struct fd *fd, int user, int events )
+{
+    if (events == -1)  /* stop waiting on this fd completely */
+    {
+        if (pollfd[user].fd == -1) return;  /* already removed */
+        uring_disarm( user );
+        uring_submit();  /* the poll holds a reference to the file, drop it now */
+        return;
+    }
+    if (pollfd[user].fd == -1)
+    {
+        if (pollfd[user].events) return;  /* stopped waiting on it, don't restart */
+    }
+    else if (pollfd[user].events == events && user < uring_users_size && uring_users[user].armed)
+        return;  /* nothing to do */
+
+    uring_disarm( user );
+    uring_arm( user, fd->unix_fd, events );
+}
+
+static inline void remove_uring_user( struct fd *fd, int user )
+{
+    if (pollfd[user].fd == -1) return;
+    uring_disarm( user );
+    uring_submit();
+}
+
+static inline void main_loop_uring(void)
+{
+    int i, count, user, timeout, users[128];
+    struct __kernel_timespec ts;
+    struct io_uring_sqe *sqe;
+    unsigned int head, tail;
+
+    while (active_users)
+    {
+        timeout = get_next_timeout();
+
+        if (!active_users) break;  /* last user removed by a timeout */
+        if (uring.fd == -1) break;  /* an error occurred with io_uring */
+
+        head = *uring.cq_head;
+        if (head == __atomic_load_n( uring.cq_tail, __ATOMIC_ACQUIRE ))
+        {
+            if (timeout != -1)
+            {
+                /* completes on timeout, or as soon as any other request completes */
+                ts.tv_sec  = timeout / 1000;
+                ts.tv_nsec = (timeout % 1000) * 1000000;
+                if (!(sqe = uring_get_sqe( IORING_OP_TIMEOUT, URING_TAG_INTERNAL ))) break;
+                sqe->addr = (unsigned long)&ts;
+                sqe->len = 1;
+                sqe->off = 1;
+            }
+            if (io_uring_enter( uring.fd, uring.to_submit, 1, IORING_ENTER_GETEVENTS ) == -1)
+            {
+                if (errno != EINTR)
+                {
+                    uring_failed( "io_uring_enter" );
+                    break;
+                }
+            }
+            else uring.to_submit = 0;
+        }
+        set_current_time();
+
+        /* put the events into the pollfd array first, like poll does */
+        head = *uring.cq_head;
+        tail = __atomic_load_n( uring.cq_tail, __ATOMIC_ACQUIRE );
+        for (count = 0; head != tail && count < ARRAY_SIZE(users); head++)
+        {
+            const struct io_uring_cqe *cqe = &uring.cqes[head & *uring.cq_mask];
+
+            if (cqe->user_data == URING_TAG_INTERNAL) continue;
+            user = (unsigned int)cqe->user_data;
+            if ((unsigned int)(cqe->user_data >> 32) != uring_users[user].gen) continue;  /* stale */
+            uring_users[user].armed = 0;
+            uring_users[user].gen++;
+            pollfd[user].revents = cqe->res < 0 ? POLLERR : cqe->res;
+            users[count++] = user;
+        }
+        __atomic_store_n( uring.cq_head, head, __ATOMIC_RELEASE );
+
+        /* read events from the pollfd array, as set_fd_events may modify them */
+        for (i = 0; i < count; i++)
+        {
+            user = users[i];
+            if (pollfd[user].revents) fd_poll_event( poll_users[user], pollfd[user].revents );
+        }
+
+        /* re-arm the one-shot polls that are still wanted */
+        for (i = 0; i < count && uring.fd != -1; i++)
+        {
+            user = users[i];
+            if (pollfd[user].fd == -1 || uring_users[user].armed) continue;
+            uring_arm( user, pollfd[user].fd, pollfd[user].events );
+        }
+    }
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
+
 static inline void init_epoll(void)
 {
+#ifdef HAVE_LINUX_IO_URING_H
+    if (init_uring()) return;
+#endif
     epoll_fd = epoll_create( 128 );
 }
 
@@ -511,6 +819,13 @@ static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
     struct epoll_event ev;
     int ctl;
 
+#ifdef HAVE_LINUX_IO_URING_H
+    if (uring.fd != -1)
+    {
+        set_fd_uring_events( fd, user, events );
+        return;
+    }
+#endif
     if (epoll_fd == -1) return;
 
     if (events == -1)  /* stop waiting on this fd completely */
@@ -546,6 +861,13 @@ static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
 
 static inline void remove_epoll_user( struct fd *fd, int user )
 {
+#ifdef HAVE_LINUX_IO_URING_H
+    if (uring.fd != -1)
+    {
+        remove_uring_user( fd, user );
+        return;
+    }
+#endif
     if (epoll_fd == -1) return;
 
     if (pollfd[user].fd != -1)
@@ -565,6 +887,13 @@ static inline void main_loop_epoll(void)
     assert( POLLERR == EPOLLERR );
     assert( POLLHUP == EPOLLHUP );
 
+#ifdef HAVE_LINUX_IO_URING_H
+    if (uring.fd != -1)
+    {
+        main_loop_uring();
+        return;
+    }
+#endif
     if (epoll_fd == -1) return;
 
     while (active_users)
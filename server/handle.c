@@ -33,6 +33,7 @@
 #include "windef.h"
 #include "winternl.h"
 
+#include "file.h"
 #include "handle.h"
 #include "process.h"
 #include "thread.h"
@@ -53,6 +54,8 @@ struct handle_table
     int                  last;        /* last used entry */
     int                  free;        /* first entry that may be free */
     struct handle_entry *entries;     /* handle entries */
+    int                  shared_fd;   /* fd of the shared memory mirror of the entries */
+    shared_handle_t     *shared;      /* shared memory mirror of the entries */
 };
 
 static struct handle_table *global_table;
@@ -97,6 +100,38 @@ static inline obj_handle_t handle_global_to_local( obj_handle_t handle )
     return handle ^ HANDLE_OBFUSCATOR;
 }
 
+/* update the shared memory mirror of a handle entry */
+static void update_shared_handle( struct handle_table *table, struct handle_entry *entry )
+{
+    unsigned int index = entry - table->entries;
+    shared_handle_t *shared;
+    struct object_type *type;
+
+    if (!table->shared || index >= SHARED_HANDLE_ENTRIES) return;
+    shared = &table->shared[index];
+
+    __atomic_store_n( &shared->seq, shared->seq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    if (entry->ptr)
+    {
+        shared->flags  = SHARED_HANDLE_IN_USE | ((entry->access & RESERVED_ALL) >> RESERVED_SHIFT);
+        shared->access = entry->access & ~RESERVED_ALL;
+        shared->object = entry->ptr->id;
+        if ((type = entry->ptr->ops->get_type( entry->ptr )))
+        {
+            shared->type = type_get_index( type );
+            release_object( type );
+        }
+        else shared->type = 0;
+    }
+    else
+    {
+        shared->flags = shared->access = shared->type = 0;
+        shared->object = 0;
+    }
+    __atomic_store_n( &shared->seq, shared->seq + 1, __ATOMIC_RELEASE );
+}
+
 /* grab an object and increment its handle count */
 static struct object *grab_object_for_handle( struct object *obj )
 {
@@ -190,6 +225,7 @@ static void handle_table_destroy( struct object *obj )
         if (obj) release_object_from_handle( obj );
     }
     free( table->entries );
+    release_shared_memory( table->shared_fd, table->shared, SHARED_HANDLE_ENTRIES * sizeof(*table->shared) );
 }
 
 /* close all the process handles and free the handle table */
@@ -213,6 +249,8 @@ struct handle_table *alloc_handle_table( struct process *process, int count )
     table->count   = count;
     table->last    = -1;
     table->free    = 0;
+    table->shared_fd = -1;
+    table->shared  = NULL;
     if ((table->entries = mem_alloc( count * sizeof(*table->entries) ))) return table;
     release_object( table );
     return NULL;
@@ -252,6 +290,7 @@ static obj_handle_t alloc_entry( struct handle_table *table, struct object *obj,
     table->free = i + 1;
     entry->ptr    = grab_object_for_handle( obj );
     entry->access = access;
+    update_shared_handle( table, entry );
 
     if (table->process)
         obj->ops->alloc_handle( obj, table->process, index_to_handle(i) );
@@ -407,6 +446,7 @@ unsigned int close_handle( struct process *process, obj_handle_t handle )
     if (!obj->ops->close_handle( obj, process, handle )) return STATUS_HANDLE_NOT_CLOSABLE;
     entry->ptr = NULL;
     table = handle_is_global(handle) ? global_table : process->handles;
+    update_shared_handle( table, entry );
     if (entry < table->entries + table->free) table->free = entry - table->entries;
     if (entry == table->entries + table->last) shrink_handle_table( table );
     release_object_from_handle( obj );
@@ -541,6 +581,7 @@ static int set_handle_flags( struct process *process, obj_handle_t handle, int m
     mask  = (mask << RESERVED_SHIFT) & RESERVED_ALL;
     flags = (flags << RESERVED_SHIFT) & mask;
     entry->access = (entry->access & ~mask) | flags;
+    if (!handle_is_global( handle )) update_shared_handle( process->handles, entry );
     return (old_access & RESERVED_ALL) >> RESERVED_SHIFT;
 }
 
@@ -855,3 +896,28 @@ DECL_HANDLER(get_system_handles)
         enum_processes( enum_handles, &info );
     }
 }
+
+/* get file descriptor to the shared memory mirror of the process handle table */
+DECL_HANDLER(get_shared_handles)
+{
+    struct handle_table *table = current->process->handles;
+    int i;
+
+    if (!table)
+    {
+        set_error( STATUS_PROCESS_IS_TERMINATING );
+        return;
+    }
+    if (!table->shared)
+    {
+        if (!allocate_shared_memory( &table->shared_fd, (void **)&table->shared,
+                                     SHARED_HANDLE_ENTRIES * sizeof(*table->shared) ))
+        {
+            set_error( STATUS_NOT_SUPPORTED );
+            return;
+        }
+        for (i = 0; i <= table->last; i++)
+            if (table->entries[i].ptr) update_shared_handle( table, &table->entries[i] );
+    }
+    send_client_fd( current->process, table->shared_fd, 0 );
+}
@@ -149,6 +149,56 @@ static const struct object_ops shared_map_ops =
 
 static struct list shared_map_list = LIST_INIT( shared_map_list );
 
+/* pages of a PE image prepared for a given base address, shared by the processes of the same user mapping it there */
+struct image_cache
+{
+    struct object   obj;             /* object header */
+    struct mapping *pages;           /* anonymous mapping holding the image pages */
+    client_ptr_t    base;            /* address the pages were prepared for */
+    dev_t           dev;             /* device of the PE file */
+    ino_t           ino;             /* inode of the PE file */
+    timeout_t       mtime;           /* modification time of the PE file when the pages were built */
+    file_pos_t      file_size;       /* size of the PE file when the pages were built */
+    SID            *user;            /* user of the process that built the pages */
+    struct list     entry;           /* entry in global image cache list */
+};
+
+static void image_cache_dump( struct object *obj, int verbose );
+static void image_cache_destroy( struct object *obj );
+
+static const struct object_ops image_cache_ops =
+{
+    sizeof(struct image_cache), /* size */
+    image_cache_dump,          /* dump */
+    no_get_type,               /* get_type */
+    no_add_queue,              /* add_queue */
+    NULL,                      /* remove_queue */
+    NULL,                      /* signaled */
+    NULL,                      /* get_esync_fd */
+    NULL,                      /* get_fsync_idx */
+    NULL,                      /* satisfied */
+    no_signal,                 /* signal */
+    no_get_fd,                 /* get_fd */
+    no_map_access,             /* map_access */
+    default_get_sd,            /* get_sd */
+    default_set_sd,            /* set_sd */
+    no_lookup_name,            /* lookup_name */
+    no_link_name,              /* link_name */
+    NULL,                      /* unlink_name */
+    no_open_file,              /* open_file */
+    no_kernel_obj_list,        /* get_kernel_obj_list */
+    no_alloc_handle,           /* alloc_handle */
+    no_close_handle,           /* close_handle */
+    image_cache_destroy        /* destroy */
+};
+
+/* the image cache list holds a reference on its entries, so that they outlive the processes
+ * that built them; it is kept in most recently used order and trimmed to MAX_IMAGE_CACHE entries.
+ * Entries don't keep the PE file open, so that it can still be replaced or deleted. */
+#define MAX_IMAGE_CACHE 64
+static struct list image_cache_list = LIST_INIT( image_cache_list );
+static unsigned int image_cache_count;
+
 /* memory view mapped in client address space */
 struct memory_view
 {
@@ -156,6 +206,7 @@ struct memory_view
     struct fd      *fd;              /* fd for mapped file */
     struct ranges  *committed;       /* list of committed ranges in this mapping */
     struct shared_map *shared;       /* temp file for shared PE mapping */
+    struct image_cache *cache;       /* cached image pages used by the view */
     unsigned int    flags;           /* SEC_* flags */
     client_ptr_t    base;            /* view base address (in process addr space) */
     mem_size_t      size;            /* view size */
@@ -257,6 +308,22 @@ static void shared_map_destroy( struct object *obj )
     list_remove( &shared->entry );
 }
 
+static void image_cache_dump( struct object *obj, int verbose )
+{
+    struct image_cache *cache = (struct image_cache *)obj;
+    fprintf( stderr, "Image cache dev=%lx ino=%lx pages=%p base=%08x%08x\n",
+             (unsigned long)cache->dev, (unsigned long)cache->ino, cache->pages,
+             (unsigned int)(cache->base >> 32), (unsigned int)cache->base );
+}
+
+static void image_cache_destroy( struct object *obj )
+{
+    struct image_cache *cache = (struct image_cache *)obj;
+
+    release_object( cache->pages );
+    free( cache->user );
+}
+
 /* extend a file beyond the current end of file */
 static int grow_file( int unix_fd, file_pos_t new_size )
 {
@@ -382,6 +449,21 @@ static int create_temp_file( file_pos_t size )
     return fd;
 }
 
+/* create a memory-backed file for large page anonymous mappings, so that they can use huge pages */
+static int create_large_pages_file( file_pos_t size )
+{
+#if defined(__linux__) && (defined(__i386__) || defined(__x86_64__))
+    int fd = syscall( __NR_memfd_create, "wine_large_pages", 0 );
+
+    if (fd != -1)
+    {
+        if (grow_file( fd, size )) return fd;
+        close( fd );
+    }
+#endif
+    return create_temp_file( size );
+}
+
 /* find a memory view from its base address */
 static struct memory_view *find_mapped_view( struct process *process, client_ptr_t base )
 {
@@ -399,6 +481,7 @@ static void free_memory_view( struct memory_view *view )
     if (view->fd) release_object( view->fd );
     if (view->committed) release_object( view->committed );
     if (view->shared) release_object( view->shared );
+    if (view->cache) release_object( view->cache );
     list_remove( &view->entry );
     free( view );
 }
@@ -423,6 +506,57 @@ static struct shared_map *get_shared_file( struct fd *fd )
     return NULL;
 }
 
+/* remove an entry from the image cache list, views still using it keep it alive */
+static void remove_image_cache( struct image_cache *cache )
+{
+    list_remove( &cache->entry );
+    image_cache_count--;
+    release_object( cache );
+}
+
+/* modification time of a file, with the best available precision */
+static timeout_t get_file_mtime( const struct stat *st )
+{
+    timeout_t mtime = (timeout_t)st->st_mtime * TICKS_PER_SEC;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    mtime += st->st_mtim.tv_nsec / 100;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    mtime += st->st_mtimespec.tv_nsec / 100;
+#endif
+    return mtime;
+}
+
+/* find the cached pages of a PE file for a given base address */
+static struct image_cache *find_image_cache( struct fd *fd, client_ptr_t base, const SID *user )
+{
+    struct image_cache *cache;
+    struct stat st;
+    int unix_fd;
+
+    if ((unix_fd = get_unix_fd( fd )) == -1 || fstat( unix_fd, &st ) == -1)
+    {
+        clear_error();
+        return NULL;
+    }
+
+    LIST_FOR_EACH_ENTRY( cache, &image_cache_list, struct image_cache, entry )
+    {
+        if (cache->base != base || cache->dev != st.st_dev || cache->ino != st.st_ino) continue;
+        /* the file may have been modified in place since the pages were built */
+        if (get_file_mtime( &st ) != cache->mtime || st.st_size != cache->file_size)
+        {
+            remove_image_cache( cache );
+            return NULL;
+        }
+        /* the pages come from the client, don't hand them to processes of other users */
+        if (!security_equal_sid( cache->user, user )) return NULL;
+        list_remove( &cache->entry );
+        list_add_head( &image_cache_list, &cache->entry );
+        return cache;
+    }
+    return NULL;
+}
+
 /* return the size of the memory mapping and file range of a given section */
 static inline void get_section_sizes( const IMAGE_SECTION_HEADER *sec, size_t *map_size,
                                       off_t *file_start, size_t *file_size )
@@ -957,7 +1091,9 @@ static struct object *create_mapping( struct object *root, const struct unicode_
         }
         if ((flags & SEC_RESERVE) && !(mapping->committed = create_ranges())) goto error;
         mapping->size = (mapping->size + page_mask) & ~((mem_size_t)page_mask);
-        if ((unix_fd = create_temp_file( mapping->size )) == -1) goto error;
+        if (flags & SEC_LARGE_PAGES) unix_fd = create_large_pages_file( mapping->size );
+        else unix_fd = create_temp_file( mapping->size );
+        if (unix_fd == -1) goto error;
         if (!(mapping->fd = create_anonymous_fd( &mapping_fd_ops, unix_fd, &mapping->obj,
                                                  FILE_SYNCHRONOUS_IO_NONALERT ))) goto error;
         allow_fd_caching( mapping->fd );
@@ -1140,6 +1276,10 @@ DECL_HANDLER(map_view)
         view->fd        = !is_fd_removable( mapping->fd ) ? (struct fd *)grab_object( mapping->fd ) : NULL;
         view->committed = mapping->committed ? (struct ranges *)grab_object( mapping->committed ) : NULL;
         view->shared    = mapping->shared ? (struct shared_map *)grab_object( mapping->shared ) : NULL;
+        view->cache     = NULL;
+        if ((mapping->flags & SEC_IMAGE) &&
+            (view->cache = find_image_cache( mapping->fd, req->base, token_get_user( current->process->token ))))
+            grab_object( view->cache );
         list_add_tail( &current->process->views, &view->entry );
     }
 
@@ -1212,3 +1352,63 @@ DECL_HANDLER(is_same_mapping)
         !is_same_file_fd( view1->fd, view2->fd ))
         set_error( STATUS_NOT_SAME_DEVICE );
 }
+
+/* add the prepared pages of an image mapped at a given address to the image cache */
+DECL_HANDLER(add_image_cache)
+{
+    struct mapping *mapping, *pages;
+    struct image_cache *cache;
+    const SID *user = token_get_user( current->process->token );
+    struct stat st;
+    int unix_fd;
+
+    if (!(mapping = get_mapping_obj( current->process, req->mapping, SECTION_MAP_READ ))) return;
+    if (!(pages = get_mapping_obj( current->process, req->pages, SECTION_MAP_READ )))
+    {
+        release_object( mapping );
+        return;
+    }
+
+    if (!(mapping->flags & SEC_IMAGE) || (pages->flags & (SEC_IMAGE | SEC_FILE)) ||
+        pages->size < mapping->image.map_size || (req->base & page_mask))
+        set_error( STATUS_INVALID_PARAMETER );
+    else if (!find_image_cache( mapping->fd, req->base, user ) &&
+             (unix_fd = get_unix_fd( mapping->fd )) != -1)
+    {
+        if (fstat( unix_fd, &st ) == -1) file_set_error();
+        else if ((cache = alloc_object( &image_cache_ops )))
+        {
+            cache->pages     = (struct mapping *)grab_object( pages );
+            cache->base      = req->base;
+            cache->dev       = st.st_dev;
+            cache->ino       = st.st_ino;
+            cache->mtime     = get_file_mtime( &st );
+            cache->file_size = st.st_size;
+            if (!(cache->user = memdup( user, security_sid_len( user ))))
+            {
+                release_object( cache );
+                goto done;
+            }
+            list_add_head( &image_cache_list, &cache->entry );
+            if (++image_cache_count > MAX_IMAGE_CACHE)
+                remove_image_cache( LIST_ENTRY( list_tail( &image_cache_list ), struct image_cache, entry ));
+        }
+    }
+done:
+    release_object( pages );
+    release_object( mapping );
+}
+
+/* get the cached pages of an image mapped at a given address */
+DECL_HANDLER(get_image_cache)
+{
+    struct mapping *mapping;
+    struct image_cache *cache;
+
+    if (!(mapping = get_mapping_obj( current->process, req->mapping, SECTION_MAP_READ ))) return;
+
+    if (!(mapping->flags & SEC_IMAGE)) set_error( STATUS_INVALID_PARAMETER );
+    else if ((cache = find_image_cache( mapping->fd, req->base, token_get_user( current->process->token ))))
+        reply->pages = alloc_handle( current->process, cache->pages, SECTION_MAP_READ | SECTION_QUERY, 0 );
+    release_object( mapping );
+}
@@ -49,6 +49,7 @@ struct namespace
     struct list         names[1];        /* array of hash entry lists */
 };
 
+static unsigned __int64 last_object_id;  /* id of the last allocated object */
 
 #ifdef DEBUG_OBJECTS
 static struct list object_list = LIST_INIT(object_list);
@@ -194,6 +195,7 @@ void *alloc_object( const struct object_ops *ops )
     {
         obj->refcount     = 1;
         obj->handle_count = 0;
+        obj->id           = ++last_object_id;
         obj->ops          = ops;
         obj->name         = NULL;
         obj->sd           = NULL;
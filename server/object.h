@@ -107,6 +107,7 @@ struct object
 {
     unsigned int              refcount;    /* reference count */
     unsigned int              handle_count;/* handle count */
+    unsigned __int64          id;          /* unique id of the object */
     const struct object_ops  *ops;
     struct list               wait_queue;
     struct object_name       *name;
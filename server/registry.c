@@ -78,6 +78,9 @@ struct key
     int               last_subkey; /* last in use subkey */
     int               nb_subkeys;  /* count of allocated subkeys */
     struct key      **subkeys;     /* subkeys array */
+    struct key      **subkey_hash; /* hash index of the subkeys, for keys with many subkeys */
+    unsigned int      hash_size;   /* number of buckets in the subkey hash index */
+    struct key       *hash_next;   /* next key in the same bucket of the parent hash index */
     int               last_value;  /* last in use value */
     int               nb_values;   /* count of allocated values in array */
     struct key_value *values;      /* values array */
@@ -105,6 +108,7 @@ struct key_value
 };
 
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
+#define MIN_HASHED_SUBKEYS 32  /* min. number of subkeys to build a hash index */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
 
 #define MAX_NAME_LEN  256    /* max. length of a key name */
@@ -443,6 +447,7 @@ static void key_destroy( struct object *obj )
         release_object( key->subkeys[i] );
     }
     free( key->subkeys );
+    free( key->subkey_hash );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -505,6 +510,9 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->last_subkey = -1;
         key->nb_subkeys  = 0;
         key->subkeys     = NULL;
+        key->subkey_hash = NULL;
+        key->hash_size   = 0;
+        key->hash_next   = NULL;
         key->nb_values   = 0;
         key->last_value  = -1;
         key->values      = NULL;
@@ -562,6 +570,7 @@ static void touch_key( struct key *key, unsigned int change )
 
     key->modif = current_time;
     make_dirty( key );
+    if (shmglobal) shmglobal->registry_seq++;
 
     /* do notifications */
     check_notify( key, change, 1 );
@@ -594,6 +603,37 @@ static int grow_subkeys( struct key *key )
     return 1;
 }
 
+/* add a subkey to the hash index of its parent */
+static void hash_subkey( struct key *parent, struct key *key )
+{
+    unsigned int bucket = hash_strW( key->name, key->namelen, parent->hash_size );
+
+    key->hash_next = parent->subkey_hash[bucket];
+    parent->subkey_hash[bucket] = key;
+}
+
+/* remove a subkey from the hash index of its parent */
+static void unhash_subkey( struct key *parent, struct key *key )
+{
+    struct key **ptr = &parent->subkey_hash[hash_strW( key->name, key->namelen, parent->hash_size )];
+
+    while (*ptr != key) ptr = &(*ptr)->hash_next;
+    *ptr = key->hash_next;
+    key->hash_next = NULL;
+}
+
+/* rebuild the subkey hash index with a given number of buckets */
+/* on failure the index is dropped and lookups fall back to a binary search */
+static void build_subkey_hash( struct key *key, unsigned int size )
+{
+    int i;
+
+    free( key->subkey_hash );
+    key->hash_size = size;
+    if (!(key->subkey_hash = calloc( size, sizeof(*key->subkey_hash) ))) return;
+    for (i = 0; i <= key->last_subkey; i++) hash_subkey( key, key->subkeys[i] );
+}
+
 /* allocate a subkey for a given key, and return its index */
 static struct key *alloc_subkey( struct key *parent, const struct unicode_str *name,
                                  int index, timeout_t modif )
@@ -617,6 +657,10 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
         for (i = ++parent->last_subkey; i > index; i--)
             parent->subkeys[i] = parent->subkeys[i-1];
         parent->subkeys[index] = key;
+        if (parent->subkey_hash && parent->last_subkey < parent->hash_size)
+            hash_subkey( parent, key );
+        else if (parent->last_subkey + 1 >= MIN_HASHED_SUBKEYS)
+            build_subkey_hash( parent, max( 2 * parent->hash_size, 2 * MIN_HASHED_SUBKEYS ));
         if (is_wow6432node( key->name, key->namelen ) && !is_wow6432node( parent->name, parent->namelen ))
             parent->flags |= KEY_WOW64;
     }
@@ -633,6 +677,7 @@ static void free_subkey( struct key *parent, int index )
     assert( index <= parent->last_subkey );
 
     key = parent->subkeys[index];
+    if (parent->subkey_hash) unhash_subkey( parent, key );
     for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
     parent->last_subkey--;
     key->flags |= KEY_DELETED;
@@ -653,12 +698,22 @@ static void free_subkey( struct key *parent, int index )
     }
 }
 
-/* find the named child of a given key and return its index */
+/* find the named child of a given key */
+/* if not found, index is set to the position where it should be inserted */
 static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
 
+    if (key->subkey_hash)
+    {
+        struct key *subkey = key->subkey_hash[hash_strW( name->str, name->len, key->hash_size )];
+
+        for ( ; subkey; subkey = subkey->hash_next)
+            if (subkey->namelen == name->len && !memicmp_strW( subkey->name, name->str, name->len ))
+                return subkey;
+    }
+
     min = 0;
     max = key->last_subkey;
     while (min <= max)
@@ -1727,6 +1782,7 @@ static void load_registry( struct key *key, obj_handle_t handle )
         {
             load_keys( key, NULL, f, -1 );
             fclose( f );
+            if (shmglobal) shmglobal->registry_seq++;
         }
         else file_set_error();
     }
@@ -136,6 +136,12 @@ int config_dir_fd = -1;    /* file descriptor for the config dir */
 static struct master_socket *master_socket;  /* the master socket object */
 static struct timeout_user *master_timeout;
 
+/* buffer receiving the request data along with the header, for requests that fit in it */
+/* handlers access the data through structure pointers, so align it like a malloc'ed block */
+static char DECLSPEC_ALIGN(16) req_data_buffer[4096];
+
+static struct request_stats req_stats[REQ_NB_REQUESTS];  /* service time statistics */
+
 /* complain about a protocol error and terminate the client connection */
 void fatal_protocol_error( struct thread *thread, const char *err, ... )
 {
@@ -296,11 +302,43 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
+/* return a monotonic time in nanoseconds, for request statistics */
+static inline unsigned __int64 get_stats_time(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && !defined(__APPLE__)
+    struct timespec ts;
+
+    if (!clock_gettime( CLOCK_MONOTONIC, &ts ))
+        return (unsigned __int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    return monotonic_counter() * 100;
+}
+
+/* account the service time of a request */
+static void update_request_stats( enum request req, unsigned __int64 time )
+{
+    struct request_stats *stats = &req_stats[req];
+    unsigned int bucket = 0;
+
+    while (bucket < REQUEST_STATS_BUCKETS - 1 && (time >> (bucket + 1))) bucket++;
+    stats->count++;
+    stats->total_time += time;
+    if (time > stats->max_time) stats->max_time = time;
+    stats->histogram[bucket]++;
+}
+
+/* dump the request statistics to stderr */
+void dump_request_stats(void)
+{
+    trace_request_stats( req_stats, REQ_NB_REQUESTS );
+}
+
 /* call a request handler */
 static void call_req_handler( struct thread *thread )
 {
     union generic_reply reply;
     enum request req = thread->req.request_header.req;
+    unsigned __int64 start;
 
     current = thread;
     current->reply_size = 0;
@@ -310,7 +348,11 @@ static void call_req_handler( struct thread *thread )
     if (debug_level) trace_request();
 
     if (req < REQ_NB_REQUESTS)
+    {
+        start = get_stats_time();
         req_handlers[req]( &current->req, &reply );
+        update_request_stats( req, get_stats_time() - start );
+    }
     else
         set_error( STATUS_NOT_IMPLEMENTED );
 
@@ -332,6 +374,13 @@ static void call_req_handler( struct thread *thread )
     current = NULL;
 }
 
+/* free the variable-size data of the current request of a thread */
+void free_req_data( struct thread *thread )
+{
+    if (thread->req_data != req_data_buffer) free( thread->req_data );
+    thread->req_data = NULL;
+}
+
 /* read a request from a thread */
 void read_request( struct thread *thread )
 {
@@ -339,23 +388,45 @@ void read_request( struct thread *thread )
 
     if (!thread->req_toread)  /* no pending request */
     {
-        if ((ret = read( get_unix_fd( thread->request_fd ), &thread->req,
-                         sizeof(thread->req) )) != sizeof(thread->req)) goto error;
-        if (!(thread->req_toread = thread->req.request_header.request_size))
+        struct iovec vec[2];
+        data_size_t size;
+
+        /* the client sends the whole request at once, so try to get the data
+         * along with the header to save a malloc and a second read */
+        vec[0].iov_base = &thread->req;
+        vec[0].iov_len  = sizeof(thread->req);
+        vec[1].iov_base = req_data_buffer;
+        vec[1].iov_len  = sizeof(req_data_buffer);
+
+        if ((ret = readv( get_unix_fd( thread->request_fd ), vec, 2 )) < (int)sizeof(thread->req))
+            goto error;
+        ret -= sizeof(thread->req);
+        size = thread->req.request_header.request_size;
+        if (ret > size)
+        {
+            fatal_protocol_error( thread, "request %d: got %d bytes of data, expected %u\n",
+                                  thread->req.request_header.req, ret, size );
+            return;
+        }
+        if (ret == size)
         {
-            /* no data, handle request at once */
+            /* got everything, handle request at once */
+            if (size) thread->req_data = req_data_buffer;
             call_req_handler( thread );
+            thread->req_data = NULL;
             return;
         }
-        if (!(thread->req_data = malloc( thread->req_toread )))
+        if (!(thread->req_data = malloc( size )))
         {
             fatal_protocol_error( thread, "no memory for %u bytes request %d\n",
-                                  thread->req_toread, thread->req.request_header.req );
+                                  size, thread->req.request_header.req );
             return;
         }
+        memcpy( thread->req_data, req_data_buffer, ret );
+        thread->req_toread = size - ret;
     }
 
-    /* read the variable sized data */
+    /* read the remaining variable sized data */
     for (;;)
     {
         ret = read( get_unix_fd( thread->request_fd ),
@@ -366,8 +437,7 @@ void read_request( struct thread *thread )
         if (!(thread->req_toread -= ret))
         {
             call_req_handler( thread );
-            free( thread->req_data );
-            thread->req_data = NULL;
+            free_req_data( thread );
             return;
         }
     }
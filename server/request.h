@@ -33,6 +33,17 @@
 #define DECL_HANDLER(name) \
     void req_##name( const struct name##_request *req, struct name##_reply *reply )
 
+#define REQUEST_STATS_BUCKETS 32
+
+/* service time statistics for a request code */
+struct request_stats
+{
+    unsigned int     count;         /* number of requests handled */
+    unsigned __int64 total_time;    /* total service time in nanoseconds */
+    unsigned __int64 max_time;      /* longest service time in nanoseconds */
+    unsigned int     histogram[REQUEST_STATS_BUCKETS];  /* counts by log2 of service time in ns */
+};
+
 /* request functions */
 
 #ifdef __GNUC__
@@ -53,6 +64,8 @@ extern const void *get_req_data_after_objattr( const struct object_attributes *a
 extern int receive_fd( struct process *process );
 extern int send_client_fd( struct process *process, int fd, obj_handle_t handle );
 extern void read_request( struct thread *thread );
+extern void free_req_data( struct thread *thread );
+extern void dump_request_stats(void);
 extern void write_reply( struct thread *thread );
 extern timeout_t monotonic_counter(void);
 extern void open_master_socket(void);
@@ -63,8 +76,10 @@ extern int kill_lock_owner( int sig );
 extern char *server_dir;
 extern int server_dir_fd, config_dir_fd;
 
+extern const char *get_req_name( enum request req );
 extern void trace_request(void);
 extern void trace_reply( enum request req, const union generic_reply *reply );
+extern void trace_request_stats( const struct request_stats *stats, unsigned int count );
 
 /* get current tick count to return to client */
 static inline unsigned int get_tick_count(void)
@@ -169,6 +184,7 @@ DECL_HANDLER(get_handle_unix_name);
 DECL_HANDLER(get_handle_fd);
 DECL_HANDLER(get_directory_cache_entry);
 DECL_HANDLER(get_shared_memory);
+DECL_HANDLER(get_shared_handles);
 DECL_HANDLER(flush);
 DECL_HANDLER(get_file_info);
 DECL_HANDLER(get_volume_info);
@@ -213,6 +229,8 @@ DECL_HANDLER(get_mapping_info);
 DECL_HANDLER(map_view);
 DECL_HANDLER(unmap_view);
 DECL_HANDLER(get_mapping_file);
+DECL_HANDLER(add_image_cache);
+DECL_HANDLER(get_image_cache);
 DECL_HANDLER(get_mapping_committed_range);
 DECL_HANDLER(add_mapping_committed_range);
 DECL_HANDLER(is_same_mapping);
@@ -405,6 +423,7 @@ DECL_HANDLER(create_completion);
 DECL_HANDLER(open_completion);
 DECL_HANDLER(add_completion);
 DECL_HANDLER(remove_completion);
+DECL_HANDLER(remove_completions);
 DECL_HANDLER(query_completion);
 DECL_HANDLER(set_completion_info);
 DECL_HANDLER(add_fd_completion);
@@ -496,6 +515,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_get_handle_fd,
     (req_handler)req_get_directory_cache_entry,
     (req_handler)req_get_shared_memory,
+    (req_handler)req_get_shared_handles,
     (req_handler)req_flush,
     (req_handler)req_get_file_info,
     (req_handler)req_get_volume_info,
@@ -540,6 +560,8 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_map_view,
     (req_handler)req_unmap_view,
     (req_handler)req_get_mapping_file,
+    (req_handler)req_add_image_cache,
+    (req_handler)req_get_image_cache,
     (req_handler)req_get_mapping_committed_range,
     (req_handler)req_add_mapping_committed_range,
     (req_handler)req_is_same_mapping,
@@ -732,6 +754,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_open_completion,
     (req_handler)req_add_completion,
     (req_handler)req_remove_completion,
+    (req_handler)req_remove_completions,
     (req_handler)req_query_completion,
     (req_handler)req_set_completion_info,
     (req_handler)req_add_fd_completion,
@@ -1110,6 +1133,7 @@ C_ASSERT( FIELD_OFFSET(struct get_directory_cache_entry_reply, entry) == 8 );
 C_ASSERT( sizeof(struct get_directory_cache_entry_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_shared_memory_request, tid) == 12 );
 C_ASSERT( sizeof(struct get_shared_memory_request) == 16 );
+C_ASSERT( sizeof(struct get_shared_handles_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct flush_request, async) == 16 );
 C_ASSERT( sizeof(struct flush_request) == 56 );
 C_ASSERT( FIELD_OFFSET(struct flush_reply, event) == 8 );
@@ -1388,6 +1412,15 @@ C_ASSERT( FIELD_OFFSET(struct get_mapping_file_request, addr) == 16 );
 C_ASSERT( sizeof(struct get_mapping_file_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct get_mapping_file_reply, handle) == 8 );
 C_ASSERT( sizeof(struct get_mapping_file_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct add_image_cache_request, mapping) == 12 );
+C_ASSERT( FIELD_OFFSET(struct add_image_cache_request, pages) == 16 );
+C_ASSERT( FIELD_OFFSET(struct add_image_cache_request, base) == 24 );
+C_ASSERT( sizeof(struct add_image_cache_request) == 32 );
+C_ASSERT( FIELD_OFFSET(struct get_image_cache_request, mapping) == 12 );
+C_ASSERT( FIELD_OFFSET(struct get_image_cache_request, base) == 16 );
+C_ASSERT( sizeof(struct get_image_cache_request) == 24 );
+C_ASSERT( FIELD_OFFSET(struct get_image_cache_reply, pages) == 8 );
+C_ASSERT( sizeof(struct get_image_cache_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_mapping_committed_range_request, base) == 16 );
 C_ASSERT( FIELD_OFFSET(struct get_mapping_committed_range_request, offset) == 24 );
 C_ASSERT( sizeof(struct get_mapping_committed_range_request) == 32 );
@@ -2456,6 +2489,9 @@ C_ASSERT( FIELD_OFFSET(struct remove_completion_reply, cvalue) == 16 );
 C_ASSERT( FIELD_OFFSET(struct remove_completion_reply, information) == 24 );
 C_ASSERT( FIELD_OFFSET(struct remove_completion_reply, status) == 32 );
 C_ASSERT( sizeof(struct remove_completion_reply) == 40 );
+C_ASSERT( FIELD_OFFSET(struct remove_completions_request, handle) == 12 );
+C_ASSERT( sizeof(struct remove_completions_request) == 16 );
+C_ASSERT( sizeof(struct remove_completions_reply) == 8 );
 C_ASSERT( FIELD_OFFSET(struct query_completion_request, handle) == 12 );
 C_ASSERT( sizeof(struct query_completion_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct query_completion_reply, depth) == 8 );
@@ -1283,6 +1283,25 @@ static void dump_varargs_handle_infos( const char *prefix, data_size_t size )
     fputc( '}', stderr );
 }
 
+static void dump_varargs_completion_msgs( const char *prefix, data_size_t size )
+{
+    const struct completion_msg *msg;
+
+    fprintf( stderr, "%s{", prefix );
+    while (size >= sizeof(*msg))
+    {
+        msg = cur_data;
+        dump_uint64( "{ckey=", &msg->ckey );
+        dump_uint64( ",cvalue=", &msg->cvalue );
+        dump_uint64( ",information=", &msg->information );
+        fprintf( stderr, ",status=%s}", get_status_name( msg->status ) );
+        size -= sizeof(*msg);
+        remove_data( sizeof(*msg) );
+        if (size) fputc( ',', stderr );
+    }
+    fputc( '}', stderr );
+}
+
 typedef void (*dump_func)( const void *req );
 
 /* Everything below this line is generated automatically by tools/make_requests */
@@ -1901,6 +1920,10 @@ static void dump_get_shared_memory_request( const struct get_shared_memory_reque
     fprintf( stderr, " tid=%04x", req->tid );
 }
 
+static void dump_get_shared_handles_request( const struct get_shared_handles_request *req )
+{
+}
+
 static void dump_flush_request( const struct flush_request *req )
 {
     dump_async_data( " async=", &req->async );
@@ -2415,6 +2438,24 @@ static void dump_get_mapping_file_reply( const struct get_mapping_file_reply *re
     fprintf( stderr, " handle=%04x", req->handle );
 }
 
+static void dump_add_image_cache_request( const struct add_image_cache_request *req )
+{
+    fprintf( stderr, " mapping=%04x", req->mapping );
+    fprintf( stderr, ", pages=%04x", req->pages );
+    dump_uint64( ", base=", &req->base );
+}
+
+static void dump_get_image_cache_request( const struct get_image_cache_request *req )
+{
+    fprintf( stderr, " mapping=%04x", req->mapping );
+    dump_uint64( ", base=", &req->base );
+}
+
+static void dump_get_image_cache_reply( const struct get_image_cache_reply *req )
+{
+    fprintf( stderr, " pages=%04x", req->pages );
+}
+
 static void dump_get_mapping_committed_range_request( const struct get_mapping_committed_range_request *req )
 {
     dump_uint64( " base=", &req->base );
@@ -4575,6 +4616,16 @@ static void dump_remove_completion_reply( const struct remove_completion_reply *
     fprintf( stderr, ", status=%08x", req->status );
 }
 
+static void dump_remove_completions_request( const struct remove_completions_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_remove_completions_reply( const struct remove_completions_reply *req )
+{
+    dump_varargs_completion_msgs( " msgs=", cur_size );
+}
+
 static void dump_query_completion_request( const struct query_completion_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -4947,6 +4998,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_handle_fd_request,
     (dump_func)dump_get_directory_cache_entry_request,
     (dump_func)dump_get_shared_memory_request,
+    (dump_func)dump_get_shared_handles_request,
     (dump_func)dump_flush_request,
     (dump_func)dump_get_file_info_request,
     (dump_func)dump_get_volume_info_request,
@@ -4991,6 +5043,8 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_map_view_request,
     (dump_func)dump_unmap_view_request,
     (dump_func)dump_get_mapping_file_request,
+    (dump_func)dump_add_image_cache_request,
+    (dump_func)dump_get_image_cache_request,
     (dump_func)dump_get_mapping_committed_range_request,
     (dump_func)dump_add_mapping_committed_range_request,
     (dump_func)dump_is_same_mapping_request,
@@ -5183,6 +5237,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_open_completion_request,
     (dump_func)dump_add_completion_request,
     (dump_func)dump_remove_completion_request,
+    (dump_func)dump_remove_completions_request,
     (dump_func)dump_query_completion_request,
     (dump_func)dump_set_completion_info_request,
     (dump_func)dump_add_fd_completion_request,
@@ -5271,6 +5326,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_get_handle_fd_reply,
     (dump_func)dump_get_directory_cache_entry_reply,
     NULL,
+    NULL,
     (dump_func)dump_flush_reply,
     (dump_func)dump_get_file_info_reply,
     (dump_func)dump_get_volume_info_reply,
@@ -5315,6 +5371,8 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     NULL,
     (dump_func)dump_get_mapping_file_reply,
+    NULL,
+    (dump_func)dump_get_image_cache_reply,
     (dump_func)dump_get_mapping_committed_range_reply,
     NULL,
     NULL,
@@ -5507,6 +5565,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_open_completion_reply,
     NULL,
     (dump_func)dump_remove_completion_reply,
+    (dump_func)dump_remove_completions_reply,
     (dump_func)dump_query_completion_reply,
     NULL,
     NULL,
@@ -5595,6 +5654,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "get_handle_fd",
     "get_directory_cache_entry",
     "get_shared_memory",
+    "get_shared_handles",
     "flush",
     "get_file_info",
     "get_volume_info",
@@ -5639,6 +5699,8 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "map_view",
     "unmap_view",
     "get_mapping_file",
+    "add_image_cache",
+    "get_image_cache",
     "get_mapping_committed_range",
     "add_mapping_committed_range",
     "is_same_mapping",
@@ -5831,6 +5893,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "open_completion",
     "add_completion",
     "remove_completion",
+    "remove_completions",
     "query_completion",
     "set_completion_info",
     "add_fd_completion",
@@ -6061,6 +6124,11 @@ static const char *get_status_name( unsigned int status )
     return buffer;
 }
 
+const char *get_req_name( enum request req )
+{
+    return req < REQ_NB_REQUESTS ? req_names[req] : "?";
+}
+
 void trace_request(void)
 {
     enum request req = current->req.request_header.req;
@@ -6097,3 +6165,20 @@ void trace_reply( enum request req, const union generic_reply *reply )
     else fprintf( stderr, "%04x: %d() = %s\n",
                   current->id, req, get_status_name(current->error) );
 }
+
+void trace_request_stats( const struct request_stats *stats, unsigned int count )
+{
+    unsigned int i, j, last;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!stats[i].count) continue;
+        fprintf( stderr, "stats: %s count=%u", get_req_name( i ), stats[i].count );
+        dump_uint64( " total=", &stats[i].total_time );
+        dump_uint64( " max=", &stats[i].max_time );
+        fprintf( stderr, " histogram={" );
+        for (last = REQUEST_STATS_BUCKETS - 1; last && !stats[i].histogram[last]; last--) ;
+        for (j = 0; j <= last; j++) fprintf( stderr, "%s%u", j ? "," : "", stats[i].histogram[j] );
+        fprintf( stderr, "}\n" );
+    }
+}